@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -14,9 +14,6 @@ TEMPLATE = app
 # for android, define this to 1
 DEFINES += MINIMALISTIC_INTERFACE=0
 
-SOURCES += main.cxx\
-        mapeditor.cxx
+SOURCES += main.cxx
 
-HEADERS  += mapeditor.hxx
-
-FORMS    += mapeditor.ui
+include(editor.pri)
@@ -0,0 +1,175 @@
+#include <QtConcurrent>
+
+#include <numeric>
+
+#include "autotiler.hxx"
+
+enum
+{
+	NORTH		=	1 << 0,
+	NORTH_EAST	=	1 << 1,
+	EAST		=	1 << 2,
+	SOUTH_EAST	=	1 << 3,
+	SOUTH		=	1 << 4,
+	SOUTH_WEST	=	1 << 5,
+	WEST		=	1 << 6,
+	NORTH_WEST	=	1 << 7,
+};
+
+const QVector<quint8> & Autotiler::blobIndices(void)
+{
+	static const QVector<quint8> indices = [] {
+		QVector<quint8> indices(256);
+		QVector<int> masks;
+		for (int mask = 0; mask < 256; mask ++)
+		{
+			auto m = mask;
+			/* corners only count when both of their edges are the same terrain */
+			if ((m & (NORTH | EAST)) != (NORTH | EAST)) m &= ~ NORTH_EAST;
+			if ((m & (SOUTH | EAST)) != (SOUTH | EAST)) m &= ~ SOUTH_EAST;
+			if ((m & (SOUTH | WEST)) != (SOUTH | WEST)) m &= ~ SOUTH_WEST;
+			if ((m & (NORTH | WEST)) != (NORTH | WEST)) m &= ~ NORTH_WEST;
+			if (!masks.contains(m))
+				masks << m;
+			indices[mask] = m;
+		}
+		std::sort(masks.begin(), masks.end());
+		for (auto & i : indices)
+			i = masks.indexOf(i);
+		return indices;
+	}();
+	return indices;
+}
+
+void Autotiler::rebuild(const TileInfo & tileInfo)
+{
+	for (auto & t : terrains)
+		t = Terrain();
+	tileSetColumns = tileInfo.width();
+	tileTerrains.fill(NO_TERRAIN, tileSetColumns * tileInfo.height());
+	for (int y = 0; y < tileInfo.height(); y ++)
+		for (int x = 0; x < tileSetColumns; x ++)
+		{
+			auto bits = quint32(tileInfo.terrain(x, y));
+			/* only tiles with a single terrain take part in autotiling */
+			if (!bits || (bits & (bits - 1)))
+				continue;
+			int terrain = qCountTrailingZeroBits(bits);
+			if (terrains[terrain].tiles.isEmpty())
+				terrains[terrain].layer = tileInfo.layer(x, y);
+			terrains[terrain].tiles << TileMap::tileIndex(x, y);
+			tileTerrains[y * tileSetColumns + x] = terrain;
+		}
+}
+
+TileIndex Autotiler::tile(int terrain, int mask) const
+{
+	auto & tiles = terrains[terrain].tiles;
+	if (tiles.size() >= EIGHT_NEIGHBOUR_TILES)
+		return tiles.at(blobIndices().at(mask & 0xff));
+	if (tiles.size() >= FOUR_NEIGHBOUR_TILES)
+		return tiles.at(((mask & NORTH) ? 1 : 0) | ((mask & EAST) ? 2 : 0) | ((mask & SOUTH) ? 4 : 0) | ((mask & WEST) ? 8 : 0));
+	return tiles.first();
+}
+
+QVector<quint8> Autotiler::cellTerrains(const TileMap & map, int layer, const QRect & cells) const
+{
+	QVector<quint8> result(cells.width() * cells.height(), NO_TERRAIN);
+	for (int y = 0; y < cells.height(); y ++)
+		for (int x = 0; x < cells.width(); x ++)
+		{
+			auto terrain = terrainOf(map.tile(layer, cells.x() + x, cells.y() + y));
+			if (terrain != -1 && terrains[terrain].layer == layer)
+				result[y * cells.width() + x] = terrain;
+		}
+	return result;
+}
+
+TileIndex Autotiler::pickTile(const quint8 * grid, int width, int height, int x, int y) const
+{
+	auto cell = grid + y * width + x;
+	auto terrain = * cell;
+	bool n = y > 0, e = x < width - 1, s = y < height - 1, w = x > 0;
+	int mask = 0;
+	if (!n || cell[- width] == terrain) mask |= NORTH;
+	if (!(n && e) || cell[- width + 1] == terrain) mask |= NORTH_EAST;
+	if (!e || cell[1] == terrain) mask |= EAST;
+	if (!(s && e) || cell[width + 1] == terrain) mask |= SOUTH_EAST;
+	if (!s || cell[width] == terrain) mask |= SOUTH;
+	if (!(s && w) || cell[width - 1] == terrain) mask |= SOUTH_WEST;
+	if (!w || cell[- 1] == terrain) mask |= WEST;
+	if (!(n && w) || cell[- width - 1] == terrain) mask |= NORTH_WEST;
+	return tile(terrain, mask);
+}
+
+QVector<Autotiler::CellTile> Autotiler::retile(const TileMap & map, int layer, const QRect & cells) const
+{
+	QVector<CellTile> changes;
+	auto r = cells & QRect(0, 0, map.width(), map.height());
+	if (r.isEmpty())
+		return changes;
+	/* the terrains of the cells around the rectangle are needed too */
+	auto area = r.adjusted(-1, -1, 1, 1) & QRect(0, 0, map.width(), map.height());
+	auto grid = cellTerrains(map, layer, area);
+	for (int y = r.top(); y <= r.bottom(); y ++)
+		for (int x = r.left(); x <= r.right(); x ++)
+		{
+			if (grid.at((y - area.y()) * area.width() + x - area.x()) == NO_TERRAIN)
+				continue;
+			auto tile = pickTile(grid.constData(), area.width(), area.height(), x - area.x(), y - area.y());
+			if (tile != map.tile(layer, x, y))
+				changes << CellTile { x, y, tile, };
+		}
+	return changes;
+}
+
+void Autotiler::retileLayer(TileMap & map, int layer) const
+{
+	int width = map.width(), height = map.height();
+	if (!width || !height)
+		return;
+	QVector<quint8> grid(width * height);
+	QVector<TileIndex> tiles(width * height);
+	QVector<int> bands(map.chunkCountY());
+	std::iota(bands.begin(), bands.end(), 0);
+	/* every band of chunk rows is handled by a single thread, which only writes to its own part of the buffers */
+	QtConcurrent::blockingMap(bands, [&] (int band) {
+		int y0 = band * TileMap::CHUNK_SIZE, y1 = std::min(y0 + int(TileMap::CHUNK_SIZE), height);
+		for (int y = y0; y < y1; y ++)
+		{
+			auto row = tiles.data() + y * width;
+			map.readRow(layer, y, row);
+			for (int x = 0; x < width; x ++)
+			{
+				auto terrain = terrainOf(row[x]);
+				grid.data()[y * width + x] = (terrain != -1 && terrains[terrain].layer == layer) ? terrain : NO_TERRAIN;
+			}
+		}
+	});
+	QtConcurrent::blockingMap(bands, [&] (int band) {
+		int y0 = band * TileMap::CHUNK_SIZE, y1 = std::min(y0 + int(TileMap::CHUNK_SIZE), height);
+		for (int y = y0; y < y1; y ++)
+			for (int x = 0; x < width; x ++)
+				if (grid.at(y * width + x) != NO_TERRAIN)
+					tiles.data()[y * width + x] = pickTile(grid.constData(), width, height, x, y);
+	});
+	/* the map itself is only written by this thread, and only where a tile changes */
+	QVector<TileIndex> row(width);
+	for (int y = 0; y < height; y ++)
+	{
+		map.readRow(layer, y, row.data());
+		auto newRow = tiles.constData() + y * width;
+		for (int x = 0; x < width; x ++)
+			if (newRow[x] != row.at(x))
+				map.setTile(layer, x, y, newRow[x]);
+	}
+}
+
+QVector<int> Autotiler::layers(void) const
+{
+	QVector<int> layers;
+	for (const auto & t : terrains)
+		if (!t.tiles.isEmpty() && !layers.contains(t.layer))
+			layers << t.layer;
+	return layers;
+}
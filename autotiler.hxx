@@ -0,0 +1,70 @@
+#ifndef AUTOTILER_HXX
+#define AUTOTILER_HXX
+
+#include <QVector>
+#include <QRect>
+
+#include "tilemap.hxx"
+#include "tileinfo.hxx"
+
+/* picks map tiles from the terrain of the neighbouring cells - the tiles tagged with exactly one terrain,
+ * in tile set row major order, make up the tile set of that terrain, and are placed in the layer of the
+ * first of them. A cell belongs to a terrain when its tile, in that layer, is in the terrain tile set.
+ * The tile for a cell is picked from the mask of its neighbours of the same terrain (cells outside of
+ * the map count as the same terrain); the number of tiles in a set decides how the mask is used:
+ *	- 47 or more tiles: the eight neighbours, with a corner only counting when both edges next to it do
+ *	  too, which leaves 47 distinct masks, and the tiles are in the ascending order of these masks
+ *	- 16 to 46 tiles: the four edge neighbours, the mask bits are north 1, east 2, south 4, west 8
+ *	- fewer tiles: the first tile is always used */
+class Autotiler
+{
+public:
+	enum
+	{
+		MAX_TERRAINS	=	32,
+		NO_TERRAIN	=	0xff,
+		FOUR_NEIGHBOUR_TILES	=	16,
+		EIGHT_NEIGHBOUR_TILES	=	47,
+	};
+	struct CellTile
+	{
+		int x, y;
+		TileIndex tile;
+	};
+private:
+	struct Terrain
+	{
+		int layer = 0;
+		QVector<TileIndex> tiles;
+	};
+	Terrain terrains[MAX_TERRAINS];
+	/* the terrain of each tile in the tile set, in row major order */
+	QVector<quint8> tileTerrains;
+	int tileSetColumns = 0;
+	/* maps eight neighbour masks to the index of their tile in a 47 tile set */
+	static const QVector<quint8> & blobIndices(void);
+	/* the terrains of the cells of a layer inside 'cells', one byte per cell, in row major order */
+	QVector<quint8> cellTerrains(const TileMap & map, int layer, const QRect & cells) const;
+	/* the tile for the cell at (x, y) of 'grid', the 'width' x 'height' cell terrains around it - the cells
+	 * outside of the grid must be outside of the map too */
+	TileIndex pickTile(const quint8 * grid, int width, int height, int x, int y) const;
+public:
+	void rebuild(const TileInfo & tileInfo);
+	bool hasTerrain(int terrain) const { return terrain >= 0 && terrain < MAX_TERRAINS && !terrains[terrain].tiles.isEmpty(); }
+	int layer(int terrain) const { return terrains[terrain].layer; }
+	int terrainOf(TileIndex tile) const
+	{
+		int x = TileMap::tileSetX(tile), y = TileMap::tileSetY(tile), i = y * tileSetColumns + x;
+		return (tile != TileMap::NO_TILE && x < tileSetColumns && i < tileTerrains.size() && tileTerrains.at(i) != NO_TERRAIN) ? tileTerrains.at(i) : -1;
+	}
+	/* the tile of a terrain for a cell with the same terrain neighbours in 'mask', bits going clockwise from north */
+	TileIndex tile(int terrain, int mask) const;
+	/* returns the cells in 'cells', of a map layer, whose tile does not match their neighbours anymore, with their new tiles */
+	QVector<CellTile> retile(const TileMap & map, int layer, const QRect & cells) const;
+	/* retiles a whole layer, spreading the work over all cores */
+	void retileLayer(TileMap & map, int layer) const;
+	/* the map layers that hold terrain tiles */
+	QVector<int> layers(void) const;
+};
+
+#endif // AUTOTILER_HXX
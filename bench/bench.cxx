@@ -0,0 +1,303 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QFileInfo>
+#include <QBuffer>
+#include <QPainter>
+#include <QThread>
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include "mapeditor.hxx"
+
+/* runs synthetic workloads through the map model and the map renderer, and prints the timings as json */
+
+static qint64 peakMemoryKB(void)
+{
+#ifdef Q_OS_UNIX
+	struct rusage usage;
+	if (!getrusage(RUSAGE_SELF, & usage))
+#ifdef Q_OS_MACOS
+		return usage.ru_maxrss / 1024;
+#else
+		return usage.ru_maxrss;
+#endif
+#endif
+	return -1;
+}
+
+/* a small deterministic generator, so that runs are comparable */
+class Random
+{
+	quint32 state;
+public:
+	Random(quint32 seed) : state(seed ? seed : 1) {}
+	quint32 next(void) { state ^= state << 13; state ^= state >> 17; state ^= state << 5; return state; }
+	int next(int limit) { return next() % limit; }
+};
+
+class Bench
+{
+	int iterations;
+	QJsonArray results;
+	QJsonObject * current = 0;
+public:
+	Bench(int iterations) : iterations(std::max(iterations, 1)) {}
+	const QJsonArray & json(void) const { return results; }
+	/* runs 'f' 'iterations' times, and records the median and fastest times; 'f' may
+	 * add details to the result, which is available through 'result()' */
+	template <typename F> void run(const QString & name, const QJsonObject & parameters, F f)
+	{
+		QVector<qint64> times;
+		QJsonObject result = parameters;
+		result["benchmark"] = name;
+		current = & result;
+		for (int i = 0; i < iterations; i ++)
+		{
+			QElapsedTimer timer;
+			timer.start();
+			f();
+			times << timer.nsecsElapsed();
+		}
+		current = 0;
+		std::sort(times.begin(), times.end());
+		result["iterations"] = iterations;
+		result["median-ms"] = times.at(times.size() / 2) / 1e6;
+		result["min-ms"] = times.first() / 1e6;
+		results << result;
+		fprintf(stderr, "%-24s %-12s %10.3f ms\n", qPrintable(name), qPrintable(parameters["map"].toString()), times.at(times.size() / 2) / 1e6);
+	}
+	QJsonObject & result(void) { return * current; }
+};
+
+/* a tile set with a limited number of distinct tiles, so that deduplication has work to do */
+static QImage syntheticTileSet(int tilesX, int tilesY, int tileWidth, int tileHeight, int distinctTiles)
+{
+	QImage image(tilesX * tileWidth, tilesY * tileHeight, QImage::Format_ARGB32);
+	QPainter p(& image);
+	for (int y = 0; y < tilesY; y ++)
+		for (int x = 0; x < tilesX; x ++)
+		{
+			auto id = (y * tilesX + x) % distinctTiles;
+			QRect r(x * tileWidth, y * tileHeight, tileWidth, tileHeight);
+			p.fillRect(r, QColor::fromHsv((id * 37) % 360, 128 + id % 128, 160 + id % 96));
+			p.setPen(QColor::fromHsv((id * 91) % 360, 255, 255 - id % 128));
+			p.drawLine(r.topLeft(), r.bottomRight() - QPoint(0, id % tileHeight));
+		}
+	return image;
+}
+
+/* the bottom layer is fully painted, the layers above are increasingly sparse */
+static void fillSyntheticMap(TileMap & map, int tilesX, int tilesY, quint32 seed)
+{
+	Random random(seed);
+	const int density[MAP_LAYERS] = { 100, 25, 5, 1, };
+	for (int layer = 0; layer < MAP_LAYERS; layer ++)
+		for (int y = 0; y < map.height(); y ++)
+			for (int x = 0; x < map.width(); x ++)
+				if (random.next(100) < density[layer])
+					map.setTile(layer, x, y, TileMap::tileIndex(random.next(tilesX), random.next(tilesY)));
+}
+
+int main(int argc, char *argv[])
+{
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	QApplication a(argc, argv);
+	QApplication::setApplicationName("MapBench");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("benchmarks map loading, saving, tile set slicing, terrain queries and map rendering");
+	parser.addHelpOption();
+	QCommandLineOption sizesOption("sizes", "comma separated map sizes, in cells per side", "sizes", "64,256,1024,4096");
+	QCommandLineOption iterationsOption("iterations", "times to run every benchmark", "count", "5");
+	QCommandLineOption tileSizeOption("tile-size", "tile width and height, in pixels", "pixels", "16");
+	QCommandLineOption tileSetOption("tile-set", "tile set columns and rows", "tiles", "64");
+	QCommandLineOption viewportOption("viewport", "rendered frame size, as WIDTHxHEIGHT", "size", "1920x1080");
+	QCommandLineOption outputOption("output", "write the results to this file, instead of the standard output", "file");
+	QCommandLineOption traceOption("trace", "also write a chrome trace of the instrumented code paths to this file", "file");
+	parser.addOptions({ sizesOption, iterationsOption, tileSizeOption, tileSetOption, viewportOption, outputOption, traceOption, });
+	parser.process(a);
+
+	QVector<int> sizes;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	for (auto s : parser.value(sizesOption).split(',', Qt::SkipEmptyParts))
+#else
+	for (auto s : parser.value(sizesOption).split(',', QString::SkipEmptyParts))
+#endif
+		if (s.toInt() > 0)
+			sizes << s.toInt();
+	int tileSize = std::max(parser.value(tileSizeOption).toInt(), int(MINIMUM_TILE_SIZE)), tileSetSide = std::max(parser.value(tileSetOption).toInt(), 1);
+	auto viewport = parser.value(viewportOption).split('x');
+	QSize frameSize(viewport.value(0).toInt(), viewport.value(1).toInt());
+	if (frameSize.isEmpty())
+		frameSize = QSize(1920, 1080);
+	QTemporaryDir directory;
+	if (!directory.isValid())
+	{
+		fprintf(stderr, "cannot create a temporary directory\n");
+		return 1;
+	}
+
+	Bench bench(parser.value(iterationsOption).toInt());
+	QJsonObject tileSetParameters { { "tile-size", tileSize }, { "tiles", tileSetSide * tileSetSide }, };
+
+	/* tile set slicing, deduplication and terrain queries do not depend on the map size */
+	auto tileSetImage = syntheticTileSet(tileSetSide, tileSetSide, tileSize, tileSize, std::max(tileSetSide * tileSetSide / 4, 1));
+	bench.run("tile-set-hash", tileSetParameters, [&] { TileSlicer::hashTiles(tileSetImage, tileSize, tileSize); });
+	bench.run("tile-set-deduplicate", tileSetParameters, [&] { bench.result()["unique-tiles"] = TileSlicer::index(tileSetImage, tileSize, tileSize).uniqueTiles.size(); });
+	QVector<TileIndex> allTiles;
+	for (int y = 0; y < tileSetSide; y ++)
+		for (int x = 0; x < tileSetSide; x ++)
+			allTiles << TileMap::tileIndex(x, y);
+	bench.run("tile-set-slice", tileSetParameters, [&] { TileSlicer::slice(tileSetImage, tileSize, tileSize, allTiles); });
+	bench.run("tile-set-mip-chain", tileSetParameters, [&] { TileSetMipChain().build(tileSetImage, tileSize, tileSize); });
+
+	enum { TERRAINS = 8, };
+	TileInfo tileInfo(tileSetSide, tileSetSide);
+	Random random(1);
+	for (int y = 0; y < tileSetSide; y ++)
+		for (int x = 0; x < tileSetSide; x ++)
+			tileInfo.setTerrain(x, y, random.next(1 << TERRAINS));
+	for (int i = 0; i < TERRAINS; i ++)
+		TileInfo::terrainNames() << QString("terrain-%1").arg(i);
+	QBuffer tileInfoJson;
+	tileInfoJson.open(QBuffer::ReadWrite);
+	bench.run("tile-info-write-json", tileSetParameters, [&] { tileInfoJson.seek(0); tileInfo.writeJson(tileInfoJson, TileInfo::terrainNames()); });
+	bench.run("tile-info-read-json", tileSetParameters, [&] { TileInfo().readJson(QJsonDocument::fromJson(tileInfoJson.data()).object()); });
+	TerrainIndex terrainIndex;
+	bench.run("terrain-index-rebuild", tileSetParameters, [&] { terrainIndex.rebuild(tileInfo); });
+	bench.run("terrain-query", tileSetParameters, [&] {
+		int matches = 0;
+		for (int terrain = 1; terrain < (1 << TERRAINS); terrain ++)
+			matches += terrainIndex.tiles(terrainIndex.query(terrain, false)).size() + terrainIndex.tiles(terrainIndex.query(terrain, true)).size();
+		bench.result()["matches"] = matches;
+	});
+
+	/* the first tiles of the tile set make up an eight neighbour autotiling set */
+	TileInfo autotileInfo(tileSetSide, tileSetSide);
+	for (int i = 0; i < std::min(int(Autotiler::EIGHT_NEIGHBOUR_TILES), tileSetSide * tileSetSide); i ++)
+		autotileInfo.setTerrain(i % tileSetSide, i / tileSetSide, 1);
+	Autotiler autotiler;
+	autotiler.rebuild(autotileInfo);
+
+	TileSet tileSet;
+	tileSet.setTileWidth(tileSize);
+	tileSet.setTileHeight(tileSize);
+	tileSet.setImage(tileSetImage);
+	/* the mip chain is otherwise built in the background, while the first frames are drawn without it */
+	tileSet.waitForMipChain();
+
+	for (auto size : sizes)
+	{
+		QJsonObject parameters { { "map", QString("%1x%1").arg(size) }, { "layers", int(MAP_LAYERS) }, };
+		TileMap map(size, size);
+		bench.run("map-generate", parameters, [&] { map.resize(size, size); fillSyntheticMap(map, tileSetSide, tileSetSide, size); });
+		parameters["map-memory-bytes"] = map.memoryUsage();
+		{
+			/* fills work on a copy, which shares the chunks of the map until they are written */
+			TileMap copy;
+			bench.run("map-fill-rect", parameters, [&] { copy = map; copy.fillRect(1, QRect(3, 5, size - 7, size - 9), TileMap::tileIndex(1, 1)); });
+			bench.run("map-flood-fill", parameters, [&] { copy = map; copy.fillLayer(3, TileMap::NO_TILE); copy.floodFill(3, 0, 0, TileMap::tileIndex(1, 1)); });
+			bench.run("map-autotile-layer", parameters, [&] { copy = map; autotiler.retileLayer(copy, 0); });
+		}
+
+		for (auto suffix : { "tmap", "json", })
+		{
+			auto fileName = directory.filePath(QString("map-%1.%2").arg(size).arg(suffix));
+			bench.run(QString("map-save-%1").arg(suffix), parameters, [&] { if (!map.save(fileName)) bench.result()["error"] = "save failed"; });
+			parameters["file-bytes"] = QFileInfo(fileName).size();
+			TileMap loaded;
+			bench.run(QString("map-load-%1").arg(suffix), parameters, [&] { if (!loaded.load(fileName)) bench.result()["error"] = "load failed"; });
+			parameters.remove("file-bytes");
+			QFile::remove(fileName);
+		}
+
+		QGraphicsScene scene;
+		scene.setItemIndexMethod(QGraphicsScene::NoIndex);
+		auto item = new TileMapItem(& map, & tileSet);
+		scene.addItem(item);
+		QImage frame(frameSize, QImage::Format_ARGB32_Premultiplied);
+		QRectF view(QPointF(), QSizeF(frameSize).boundedTo(item->boundingRect().size()));
+		auto render = [&] { QPainter p(& frame); scene.render(& p, QRectF(QPointF(), view.size()), view); };
+		bench.run("render-frame-cold", parameters, [&] { item->mapChanged(); render(); });
+		bench.run("render-frame-cached", parameters, render);
+		/* scrolling diagonally across the map, one viewport per frame */
+		bench.run("render-frame-scrolling", parameters, [&] {
+			view.translate(view.width() / 2, view.height() / 2);
+			if (!item->boundingRect().contains(view))
+				view.moveTopLeft(QPointF());
+			render();
+		});
+		bench.run("map-overview-build", parameters, [&] { item->mapChanged(); item->waitForOverview(); });
+		{
+			/* a diagonal drag with a 2x2 stamp repeated 4x4 times, the view is updated once per four mouse moves,
+			 * as the editor does at mouse rates; the stroke starts over on a fresh copy of the map every time */
+			TileMap copy;
+			EditHistory history(& copy, & autotileInfo);
+			Brush brush;
+			brush.setTiles({ TileMap::tileIndex(0, 0), TileMap::tileIndex(1, 0), TileMap::tileIndex(0, 1), TileMap::tileIndex(1, 1), }, autotileInfo);
+			brush.setRepeat(4, 4);
+			bench.run("brush-stroke", parameters, [&] {
+				copy = map;
+				history.clear();
+				history.beginCommand();
+				QPoint cell;
+				QRect dirty = brush.paint(history, copy, cell, cell);
+				for (int i = 1; i <= 256; i ++)
+				{
+					QPoint next(std::min(i * 3, size - 1), std::min(i * 2, size - 1));
+					dirty |= brush.paintLine(history, copy, cell, next, QPoint());
+					cell = next;
+					if (!(i % 4))
+						item->cellsChanged(dirty), dirty = QRect(), render();
+				}
+				history.endCommand();
+			});
+			item->mapChanged();
+			item->waitForOverview();
+		}
+		/* the whole map in a single frame, drawn from the tile set mip chain, or from the overview */
+		bench.run("render-frame-whole-map", parameters, [&] { QPainter p(& frame); scene.render(& p, QRectF(frame.rect()), item->boundingRect()); });
+	}
+
+	QJsonObject json
+	{
+		{ "qt-version", qVersion() },
+		{ "threads", QThread::idealThreadCount() },
+		/* the high water mark of the whole run, it cannot be told apart per benchmark */
+		{ "process-peak-memory-kb", peakMemoryKB() },
+		{ "results", bench.json() },
+	};
+	auto output = QJsonDocument(json).toJson();
+	if (parser.isSet(outputOption))
+	{
+		QFile file(parser.value(outputOption));
+		if (!file.open(QFile::WriteOnly) || file.write(output) != output.size())
+		{
+			fprintf(stderr, "cannot write %s\n", qPrintable(parser.value(outputOption)));
+			return 1;
+		}
+	}
+	else
+		fwrite(output.constData(), 1, output.size(), stdout);
+	if (parser.isSet(traceOption))
+	{
+		Profiler::sampleCounters();
+		QFile file(parser.value(traceOption));
+		if (!file.open(QFile::WriteOnly) || !Profiler::writeChromeTrace(file))
+		{
+			fprintf(stderr, "cannot write %s\n", qPrintable(parser.value(traceOption)));
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# headless benchmarks of the editor model and map rendering,
+# run with QT_QPA_PLATFORM=offscreen (the default when unset)
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent widgets
+
+TARGET = MapBench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += MINIMALISTIC_INTERFACE=0
+
+SOURCES += bench.cxx
+
+include(../editor.pri)
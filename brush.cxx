@@ -0,0 +1,74 @@
+#include "brush.hxx"
+#include "profiler.hxx"
+
+void Brush::setTiles(const QVector<TileIndex> & tiles, const TileInfo & tileInfo)
+{
+	this->tiles.clear();
+	layers.clear();
+	stampWidth = stampHeight = 0;
+	/* the rows of the stamp, as ranges of 'tiles' */
+	QVector<int> rowStarts;
+	for (int i = 0; i < tiles.size(); i ++)
+		if (!i || TileMap::tileSetY(tiles.at(i)) != TileMap::tileSetY(tiles.at(i - 1)))
+			rowStarts << i;
+	rowStarts << tiles.size();
+	for (int row = 0; row < rowStarts.size() - 1; row ++)
+		stampWidth = std::max(stampWidth, rowStarts.at(row + 1) - rowStarts.at(row));
+	if (!stampWidth)
+		return;
+	stampHeight = rowStarts.size() - 1;
+	this->tiles.fill(TileMap::NO_TILE, stampWidth * stampHeight);
+	layers.fill(0, stampWidth * stampHeight);
+	for (int row = 0; row < stampHeight; row ++)
+		for (int i = rowStarts.at(row); i < rowStarts.at(row + 1); i ++)
+		{
+			auto tile = tiles.at(i);
+			int cell = row * stampWidth + i - rowStarts.at(row);
+			this->tiles[cell] = tile;
+			layers[cell] = tileInfo.layer(TileMap::tileSetX(tile), TileMap::tileSetY(tile));
+		}
+}
+
+QRect Brush::paint(EditHistory & history, const TileMap & map, const QPoint & cell, const QPoint & origin) const
+{
+	auto r = QRect(cell.x(), cell.y(), width(), height()) & QRect(0, 0, map.width(), map.height());
+	if (isEmpty() || r.isEmpty())
+		return QRect();
+	QRect changed;
+	int count = 0;
+	history.beginCommand();
+	for (int y = r.top(); y <= r.bottom(); y ++)
+		for (int x = r.left(); x <= r.right(); x ++)
+		{
+			int i = stampCell(x, y, origin), layer = layers.at(i);
+			auto tile = tiles.at(i);
+			if (tile == TileMap::NO_TILE || map.tile(layer, x, y) == tile)
+				continue;
+			history.setTile(layer, x, y, tile);
+			changed |= QRect(x, y, 1, 1);
+			count ++;
+		}
+	history.endCommand();
+	Profiler::count(Profiler::TILES_STAMPED, count);
+	return changed;
+}
+
+QRect Brush::paintLine(EditHistory & history, const TileMap & map, const QPoint & from, const QPoint & to, const QPoint & origin) const
+{
+	/* the mouse can move several cells between two events, the cells in between are painted too */
+	int dx = std::abs(to.x() - from.x()), dy = - std::abs(to.y() - from.y()), sx = from.x() < to.x() ? 1 : -1, sy = from.y() < to.y() ? 1 : -1;
+	int error = dx + dy, x = from.x(), y = from.y();
+	QRect changed;
+	history.beginCommand();
+	while (x != to.x() || y != to.y())
+	{
+		int e2 = error * 2;
+		if (e2 >= dy)
+			error += dy, x += sx;
+		if (e2 <= dx)
+			error += dx, y += sy;
+		changed |= paint(history, map, QPoint(x, y), origin);
+	}
+	history.endCommand();
+	return changed;
+}
@@ -0,0 +1,44 @@
+#ifndef BRUSH_HXX
+#define BRUSH_HXX
+
+#include <QVector>
+#include <QRect>
+#include <QPoint>
+
+#include "tilemap.hxx"
+#include "tileinfo.hxx"
+#include "edithistory.hxx"
+
+/* a stamp of tiles, built once from a palette selection, together with the layer of every tile - the brush
+ * repeats the stamp a number of times along each axis, and the pattern is lined up on the cell where a stroke
+ * started, so that the overlapping stamps painted while dragging continue the same pattern. Cells that already
+ * hold the tile the brush would paint are left alone, so dragging over painted cells costs only the reads */
+class Brush
+{
+	int stampWidth = 0, stampHeight = 0, repeatX = 1, repeatY = 1;
+	/* row major, NO_TILE where the stamp has no tile */
+	QVector<TileIndex> tiles;
+	QVector<quint8> layers;
+	/* the index in 'tiles' of the stamp cell painted at map cell (x, y) */
+	int stampCell(int x, int y, const QPoint & origin) const
+	{
+		int sx = (x - origin.x()) % stampWidth, sy = (y - origin.y()) % stampHeight;
+		return (sx < 0 ? sx + stampWidth : sx) + (sy < 0 ? sy + stampHeight : sy) * stampWidth;
+	}
+public:
+	/* 'tiles' are tile set tiles sorted by row, and then by column - every tile set row is a row of
+	 * the stamp, with its tiles packed to the left */
+	void setTiles(const QVector<TileIndex> & tiles, const TileInfo & tileInfo);
+	void setRepeat(int x, int y) { repeatX = std::max(x, 1); repeatY = std::max(y, 1); }
+	bool isEmpty(void) const { return tiles.isEmpty(); }
+	/* in cells */
+	int width(void) const { return stampWidth * repeatX; }
+	int height(void) const { return stampHeight * repeatY; }
+	/* these return the bounding rectangle of the changed cells; the brush is painted with its top left corner
+	 * at the given cell, and 'origin' is the cell the pattern is lined up on */
+	QRect paint(EditHistory & history, const TileMap & map, const QPoint & cell, const QPoint & origin) const;
+	/* paints the brush at the cells of the line from 'from' to 'to', except at 'from' itself */
+	QRect paintLine(EditHistory & history, const TileMap & map, const QPoint & from, const QPoint & to, const QPoint & origin) const;
+};
+
+#endif // BRUSH_HXX
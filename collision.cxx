@@ -0,0 +1,52 @@
+#include "collision.hxx"
+
+qint32 CollisionMap::terrainAt(const QRectF & box) const
+{
+	if (!tileMap || !tileInfo || tileWidth <= 0 || tileHeight <= 0)
+		return 0;
+	Profiler::count(Profiler::COLLISION_QUERIES);
+	int x0 = std::max(0, int(std::floor(box.left() / tileWidth))), x1 = std::min(tileMap->width() - 1, int(std::floor(box.right() / tileWidth)));
+	int y0 = std::max(0, int(std::floor(box.top() / tileHeight))), y1 = std::min(tileMap->height() - 1, int(std::floor(box.bottom() / tileHeight)));
+	qint32 terrain = 0;
+	for (int layer = 0; layer < MAP_LAYERS; layer ++)
+		for (int y = y0; y <= y1; y ++)
+			for (int x = x0; x <= x1; x ++)
+			{
+				auto tile = tileMap->tile(layer, x, y);
+				if (tile != TileMap::NO_TILE)
+					terrain |= tileTerrain(tile);
+			}
+	return terrain;
+}
+
+void SpatialHash::insert(int id, const QRectF & box)
+{
+	forEachCell(box, [&] (quint64 k) {
+		auto entry = qMakePair(k, id);
+		entries.insert(std::lower_bound(entries.begin(), entries.end(), entry), entry);
+	});
+}
+
+void SpatialHash::remove(int id, const QRectF & box)
+{
+	forEachCell(box, [&] (quint64 k) {
+		auto entry = qMakePair(k, id);
+		auto i = std::lower_bound(entries.begin(), entries.end(), entry);
+		if (i != entries.end() && * i == entry)
+			entries.erase(i);
+	});
+}
+
+const QVector<int> & SpatialHash::query(const QRectF & box) const
+{
+	results.resize(0);
+	forEachCell(box, [&] (quint64 k) {
+		auto range = std::equal_range(entries.begin(), entries.end(), qMakePair(k, 0),
+			[] (const QPair<quint64, int> & a, const QPair<quint64, int> & b) { return a.first < b.first; });
+		for (auto i = range.first; i != range.second; ++ i)
+			results << i->second;
+	});
+	std::sort(results.begin(), results.end());
+	results.erase(std::unique(results.begin(), results.end()), results.end());
+	return results;
+}
@@ -0,0 +1,57 @@
+#ifndef COLLISION_HXX
+#define COLLISION_HXX
+
+#include <QRectF>
+#include <QVector>
+#include <QPair>
+
+#include <cmath>
+#include <algorithm>
+
+#include "tilemap.hxx"
+#include "tileinfo.hxx"
+#include "profiler.hxx"
+
+/* answers map versus entity collision queries by looking up the map cells under a box directly - the
+ * terrain bits of the tiles in these cells, in all layers, serve as the collision masks */
+class CollisionMap
+{
+	const TileMap * tileMap = 0;
+	const TileInfo * tileInfo = 0;
+	int tileWidth = 0, tileHeight = 0;
+	qint32 tileTerrain(TileIndex tile) const { return tileInfo->terrain(TileMap::tileSetX(tile), TileMap::tileSetY(tile)); }
+public:
+	CollisionMap(const TileMap * tileMap = 0, const TileInfo * tileInfo = 0) { this->tileMap = tileMap; this->tileInfo = tileInfo; }
+	void setTileSize(int width, int height) { tileWidth = width, tileHeight = height; }
+	/* the terrain bits of all tiles under a box, in map coordinates */
+	qint32 terrainAt(const QRectF & box) const;
+	bool collides(const QRectF & box, qint32 terrainMask) const { return terrainMask && (terrainAt(box) & terrainMask); }
+};
+
+/* a uniform grid of buckets for finding the entities that may overlap a box - the buckets are kept as
+ * a single sorted array, that entities are inserted into and removed from in place, so it is never rebuilt */
+class SpatialHash
+{
+	double cellSize;
+	QVector<QPair<quint64, int>> entries;
+	mutable QVector<int> results;
+	static quint64 key(int x, int y) { return (quint64(quint32(y)) << 32) | quint32(x); }
+	template <typename F> void forEachCell(const QRectF & box, F f) const
+	{
+		int x0 = int(std::floor(box.left() / cellSize)), x1 = int(std::floor(box.right() / cellSize)), x;
+		int y0 = int(std::floor(box.top() / cellSize)), y1 = int(std::floor(box.bottom() / cellSize)), y;
+		for (y = y0; y <= y1; y ++)
+			for (x = x0; x <= x1; x ++)
+				f(key(x, y));
+	}
+public:
+	SpatialHash(double cellSize = 64) { this->cellSize = cellSize; }
+	void clear(void) { entries.resize(0); }
+	void insert(int id, const QRectF & box);
+	/* 'box' must be the box the entity was inserted with */
+	void remove(int id, const QRectF & box);
+	/* the ids of the entities in the cells under a box, each one only once */
+	const QVector<int> & query(const QRectF & box) const;
+};
+
+#endif // COLLISION_HXX
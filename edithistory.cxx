@@ -0,0 +1,393 @@
+#include "edithistory.hxx"
+
+void EditHistory::put(quint32 word)
+{
+	auto i = head ++ % capacity;
+	if (i >= buffer.size())
+		buffer.resize(int(std::min(capacity, std::max(i + 1, qint64(buffer.size()) * 2))));
+	buffer[int(i)] = word;
+}
+
+bool EditHistory::reserve(qint64 words)
+{
+	if (overflow)
+		return false;
+	auto & command = commands.last();
+	if (head + words - command.start > capacity)
+	{
+		/* the command being recorded does not fit in the history by itself */
+		overflow = true;
+		return false;
+	}
+	while (commands.size() > 1 && head + words - commands.first().start > capacity)
+		commands.removeFirst(), current --;
+	return true;
+}
+
+void EditHistory::clear(void)
+{
+	commands.clear();
+	pendingCells.clear();
+	buffer.clear();
+	head = 0;
+	current = 0;
+	if (nesting)
+		startCommand();
+}
+
+void EditHistory::startCommand(void)
+{
+	/* a new command discards the commands that could be redone */
+	while (commands.size() > current)
+	{
+		head = commands.last().start;
+		commands.removeLast();
+	}
+	Command command;
+	command.start = command.end = head;
+	commands << command;
+	current ++;
+	overflow = false;
+}
+
+void EditHistory::finishCommand(void)
+{
+	flushPendingCells();
+	auto & command = commands.last();
+	command.end = head;
+	if (overflow)
+		/* the edit could not be recorded, so none of the older commands can be undone either */
+		clear();
+	else if (command.start == command.end && !command.hasMaps)
+		commands.removeLast(), current --;
+}
+
+void EditHistory::beginCommand(void)
+{
+	if (!nesting ++)
+		startCommand();
+}
+
+void EditHistory::endCommand(void)
+{
+	if (nesting && !-- nesting)
+		finishCommand();
+}
+
+void EditHistory::setTile(int layer, int x, int y, TileIndex tile)
+{
+	if (layer < 0 || layer >= MAP_LAYERS || !map->contains(x, y))
+		return;
+	beginCommand();
+	PendingCell cell = { layer, x, y, map->tile(layer, x, y), };
+	pendingCells << cell;
+	map->setTile(layer, x, y, tile);
+	endCommand();
+}
+
+QRect EditHistory::setTiles(int layer, const QRect & cells, TileIndex tile)
+{
+	auto r = cells & QRect(0, 0, map->width(), map->height());
+	if (layer < 0 || layer >= MAP_LAYERS || r.isEmpty())
+		return QRect();
+	/* a snapshot of the map would take up at least the words of the filled cells, twice, so fills are always recorded */
+	auto first = map->tile(layer, r.left(), r.top());
+	bool oldUniform = true;
+	for (int y = r.top(); y <= r.bottom() && oldUniform; y ++)
+		for (int x = r.left(); x <= r.right() && oldUniform; x ++)
+			oldUniform = map->tile(layer, x, y) == first;
+	if (oldUniform && first == tile)
+		return r;
+	beginCommand();
+	flushPendingCells();
+	int count = r.width() * r.height();
+	if (oldUniform)
+		writeRect(layer, r, & first, true, & tile, true);
+	/* the old tiles are only gathered when they fit in the history */
+	else if (reserve(5 + count + 1))
+	{
+		QVector<TileIndex> oldTiles;
+		oldTiles.reserve(count);
+		for (int y = r.top(); y <= r.bottom(); y ++)
+			for (int x = r.left(); x <= r.right(); x ++)
+				oldTiles << map->tile(layer, x, y);
+		writeRect(layer, r, oldTiles.constData(), false, & tile, true);
+	}
+	map->fillRect(layer, r, tile);
+	endCommand();
+	return r;
+}
+
+QRect EditHistory::floodFill(int layer, int x, int y, TileIndex tile)
+{
+	auto target = map->tile(layer, x, y);
+	QVector<QRect> spans;
+	auto dirty = map->floodFill(layer, x, y, tile, & spans);
+	if (spans.isEmpty())
+		return dirty;
+	/* row runs with the same columns, in consecutive rows, are merged in rectangles */
+	std::sort(spans.begin(), spans.end(), [] (const QRect & a, const QRect & b)
+		{ return a.left() != b.left() ? a.left() < b.left() : (a.width() != b.width() ? a.width() < b.width() : a.top() < b.top()); });
+	int count = 0;
+	for (const auto & span : spans)
+		if (count && spans.at(count - 1).left() == span.left() && spans.at(count - 1).width() == span.width() && spans.at(count - 1).bottom() + 1 == span.top())
+			spans[count - 1].setBottom(span.bottom());
+		else
+			spans[count ++] = span;
+	spans.resize(count);
+	qint64 words = 0;
+	for (const auto & span : spans)
+		words += span.width() * span.height() == 1 ? 5 : 7;
+	if (!nesting && fillSnapshotWords(layer, spans) < words)
+	{
+		/* the runs take up more words than a snapshot of the map - the map before the fill is rebuilt from them instead */
+		auto before = * map;
+		for (const auto & span : spans)
+			before.fillRect(layer, span, target);
+		recordMaps(before);
+		return dirty;
+	}
+	beginCommand();
+	flushPendingCells();
+	for (const auto & span : spans)
+		writeRect(layer, span, & target, true, & tile, true);
+	endCommand();
+	return dirty;
+}
+
+qint64 EditHistory::fillSnapshotWords(int layer, const QVector<QRect> & cells) const
+{
+	/* every chunk the fill touches is copied, the map before the fill keeps the old one if there was one */
+	QVector<bool> touched(map->chunkCountX() * map->chunkCountY());
+	qint64 words = qint64(touched.size()) * 2 * MAP_LAYERS * sizeof(void *) / sizeof(quint32);
+	for (const auto & r : cells)
+		for (int y = r.top() >> TileMap::CHUNK_SIZE_LOG2; y <= r.bottom() >> TileMap::CHUNK_SIZE_LOG2; y ++)
+			for (int x = r.left() >> TileMap::CHUNK_SIZE_LOG2; x <= r.right() >> TileMap::CHUNK_SIZE_LOG2; x ++)
+				if (!touched.at(y * map->chunkCountX() + x))
+				{
+					touched[y * map->chunkCountX() + x] = true;
+					words += (map->chunkCells(layer, x, y) ? 2 : 1) * TileMap::CHUNK_CELLS;
+				}
+	return words;
+}
+
+void EditHistory::setTerrain(int tileX, int tileY, qint32 terrain, int layer)
+{
+	if (!tileInfo->contains(tileX, tileY))
+		return;
+	auto oldTerrain = tileInfo->terrain(tileX, tileY), oldLayer = tileInfo->layer(tileX, tileY);
+	if (oldTerrain == terrain && oldLayer == layer)
+		return;
+	beginCommand();
+	flushPendingCells();
+	if (reserve(7))
+	{
+		put(RECORD_TERRAIN), put(tileX), put(tileY);
+		put(oldTerrain), put(terrain), put(oldLayer), put(layer);
+	}
+	tileInfo->setTerrain(tileX, tileY, terrain);
+	tileInfo->setLayer(tileX, tileY, layer);
+	endCommand();
+}
+
+void EditHistory::recordMaps(const TileMap & before)
+{
+	Q_ASSERT(!nesting);
+	startCommand();
+	auto & command = commands.last();
+	command.hasMaps = true;
+	command.before = before;
+	command.after = * map;
+	/* the snapshots take up room in the ring buffer, so that they are dropped along with the oldest commands;
+	 * snapshots larger than the whole buffer drop all the other commands, but are kept, so the edit can be undone */
+	auto words = std::min(snapshotWords(before, * map), capacity);
+	if (reserve(words))
+		head += words;
+	finishCommand();
+}
+
+qint64 EditHistory::snapshotWords(const TileMap & before, const TileMap & after)
+{
+	/* the chunk pointers of both maps */
+	qint64 words = (qint64(before.chunkCountX()) * before.chunkCountY() + qint64(after.chunkCountX()) * after.chunkCountY())
+			* MAP_LAYERS * sizeof(void *) / sizeof(quint32);
+	bool sameSize = before.chunkCountX() == after.chunkCountX() && before.chunkCountY() == after.chunkCountY();
+	for (int layer = 0; layer < MAP_LAYERS; layer ++)
+	{
+		for (int y = 0; y < before.chunkCountY(); y ++)
+			for (int x = 0; x < before.chunkCountX(); x ++)
+				if (auto cells = before.chunkCells(layer, x, y))
+					if (!sameSize || cells != after.chunkCells(layer, x, y))
+						words += TileMap::CHUNK_CELLS;
+		for (int y = 0; y < after.chunkCountY(); y ++)
+			for (int x = 0; x < after.chunkCountX(); x ++)
+				if (auto cells = after.chunkCells(layer, x, y))
+					if (!sameSize || cells != before.chunkCells(layer, x, y))
+						words += TileMap::CHUNK_CELLS;
+	}
+	return words;
+}
+
+bool EditHistory::dropsOlderCommands(const TileMap & map) const
+{
+	if (!current)
+		return false;
+	/* the commands that could be redone are discarded anyway, the new command starts where they did */
+	auto start = current < commands.size() ? commands.at(current).start : head;
+	return start + snapshotWords(* this->map, map) - commands.first().start > capacity;
+}
+
+void EditHistory::setMap(const TileMap & map)
+{
+	auto before = * this->map;
+	* this->map = map;
+	recordMaps(before);
+}
+
+void EditHistory::writeRect(int layer, const QRect & cells, const TileIndex * oldTiles, bool oldUniform, const TileIndex * newTiles, bool newUniform)
+{
+	int count = cells.width() * cells.height(), i;
+	if (count == 1)
+	{
+		if (reserve(5))
+			put(RECORD_CELL | (layer << 8)), put(cells.x()), put(cells.y()), put(* oldTiles), put(* newTiles);
+		return;
+	}
+	if (!reserve(5 + (oldUniform ? 1 : count) + (newUniform ? 1 : count)))
+		return;
+	put(RECORD_RECT | (layer << 8) | (((oldUniform ? OLD_UNIFORM : 0) | (newUniform ? NEW_UNIFORM : 0)) << 16));
+	put(cells.x()), put(cells.y()), put(cells.width()), put(cells.height());
+	for (i = 0; i < (oldUniform ? 1 : count); i ++)
+		put(oldTiles[i]);
+	for (i = 0; i < (newUniform ? 1 : count); i ++)
+		put(newTiles[i]);
+}
+
+void EditHistory::flushPendingCells(void)
+{
+	if (pendingCells.isEmpty())
+		return;
+	/* the first change of a cell holds its tile from before the command */
+	std::stable_sort(pendingCells.begin(), pendingCells.end(), [] (const PendingCell & a, const PendingCell & b)
+		{ return a.layer != b.layer ? a.layer < b.layer : (a.y != b.y ? a.y < b.y : a.x < b.x); });
+	pendingCells.erase(std::unique(pendingCells.begin(), pendingCells.end(), [] (const PendingCell & a, const PendingCell & b)
+		{ return a.layer == b.layer && a.x == b.x && a.y == b.y; }), pendingCells.end());
+	pendingCells.erase(std::remove_if(pendingCells.begin(), pendingCells.end(), [this] (const PendingCell & c)
+		{ return map->tile(c.layer, c.x, c.y) == c.oldTile; }), pendingCells.end());
+
+	QVector<TileIndex> oldTiles, newTiles;
+	for (int first = 0, last; first < pendingCells.size(); first = last)
+	{
+		auto layer = pendingCells.at(first).layer;
+		QRect bounds;
+		for (last = first; last < pendingCells.size() && pendingCells.at(last).layer == layer; last ++)
+			bounds |= QRect(pendingCells.at(last).x, pendingCells.at(last).y, 1, 1);
+		int count = last - first;
+		if (count * 2 >= bounds.width() * bounds.height())
+		{
+			/* dense changes are stored as a rectangle, the unchanged cells in it have the same old and new tiles */
+			oldTiles.resize(0), newTiles.resize(0);
+			int i = first;
+			for (int y = bounds.top(); y <= bounds.bottom(); y ++)
+				for (int x = bounds.left(); x <= bounds.right(); x ++)
+				{
+					newTiles << map->tile(layer, x, y);
+					if (i < last && pendingCells.at(i).x == x && pendingCells.at(i).y == y)
+						oldTiles << pendingCells.at(i ++).oldTile;
+					else
+						oldTiles << newTiles.last();
+				}
+			writeRect(layer, bounds, oldTiles.constData(), false, newTiles.constData(), false);
+		}
+		else
+			for (int i = first; i < last; i ++)
+			{
+				auto & c = pendingCells.at(i);
+				auto tile = map->tile(layer, c.x, c.y);
+				writeRect(layer, QRect(c.x, c.y, 1, 1), & c.oldTile, true, & tile, true);
+			}
+	}
+	pendingCells.clear();
+}
+
+void EditHistory::apply(const Command & command, bool undo, Changes & changes)
+{
+	if (command.hasMaps)
+	{
+		* map = undo ? command.before : command.after;
+		changes.mapReplaced = true;
+		return;
+	}
+	/* records are replayed in order on redo, and in reverse order on undo */
+	QVector<qint64> records;
+	for (auto position = command.start; position < command.end;)
+	{
+		records << position;
+		auto header = word(position);
+		switch (header & 0xff)
+		{
+		case RECORD_CELL: position += 5; break;
+		case RECORD_TERRAIN: position += 7; break;
+		case RECORD_RECT:
+		{
+			auto count = qint64(word(position + 3)) * word(position + 4);
+			position += 5 + ((header & (OLD_UNIFORM << 16)) ? 1 : count) + ((header & (NEW_UNIFORM << 16)) ? 1 : count);
+			break;
+		}
+		default:
+			Q_ASSERT(0);
+			return;
+		}
+	}
+	for (int i = 0; i < records.size(); i ++)
+	{
+		auto position = records.at(undo ? records.size() - 1 - i : i);
+		auto header = word(position);
+		int layer = (header >> 8) & 0xff, x = word(position + 1), y = word(position + 2);
+		switch (header & 0xff)
+		{
+		case RECORD_CELL:
+			map->setTile(layer, x, y, word(position + (undo ? 3 : 4)));
+			changes.cells |= QRect(x, y, 1, 1);
+			break;
+		case RECORD_RECT:
+		{
+			int w = word(position + 3), h = word(position + 4), count = w * h;
+			bool oldUniform = header & (OLD_UNIFORM << 16), newUniform = header & (NEW_UNIFORM << 16);
+			auto tiles = position + 5 + (undo ? 0 : (oldUniform ? 1 : count));
+			if (undo ? oldUniform : newUniform)
+				for (int row = 0; row < h; row ++)
+					map->setTiles(layer, x, y + row, w, word(tiles));
+			else
+				for (int row = 0; row < h; row ++)
+					for (int column = 0; column < w; column ++)
+						map->setTile(layer, x + column, y + row, word(tiles ++));
+			changes.cells |= QRect(x, y, w, h);
+			break;
+		}
+		case RECORD_TERRAIN:
+		{
+			changes.terrains << qMakePair(QPoint(x, y), tileInfo->terrain(x, y));
+			tileInfo->setTerrain(x, y, word(position + (undo ? 3 : 4)));
+			tileInfo->setLayer(x, y, word(position + (undo ? 5 : 6)));
+			break;
+		}
+		}
+	}
+}
+
+EditHistory::Changes EditHistory::undo(void)
+{
+	Changes changes;
+	if (canUndo())
+		apply(commands.at(-- current), true, changes);
+	return changes;
+}
+
+EditHistory::Changes EditHistory::redo(void)
+{
+	Changes changes;
+	if (canRedo())
+		apply(commands.at(current ++), false, changes);
+	return changes;
+}
@@ -0,0 +1,123 @@
+#ifndef EDITHISTORY_HXX
+#define EDITHISTORY_HXX
+
+#include <QVector>
+#include <QList>
+#include <QRect>
+#include <QPoint>
+#include <QPair>
+
+#include "tilemap.hxx"
+#include "tileinfo.hxx"
+
+/* the undo/redo history of map and terrain edits - edits are made through this class, which records them
+ * as deltas (the changed cells, with their tiles before and after the edit) in a ring buffer of words;
+ * the oldest commands are dropped when the buffer fills up. The edits between 'beginCommand()' and
+ * 'endCommand()' make up one command, and the cells changed by a command are coalesced in rectangles
+ * per layer, so a stamp or a fill costs two words per cell, and nothing at all for the rest of the map.
+ * Edits that replace the whole map keep the map before and after the edit instead - maps share their
+ * chunks, so these only hold the chunks that the two maps do not share, and the words of those chunks
+ * are counted against the capacity of the history, as if they were records, up to the whole capacity */
+class EditHistory
+{
+public:
+	/* what an undo or redo changed, for updating the views and indices */
+	struct Changes
+	{
+		/* the bounding rectangle of the changed map cells, in all layers */
+		QRect cells;
+		bool mapReplaced = false;
+		/* the tile set positions whose terrain changed, with the terrain they had before */
+		QVector<QPair<QPoint, qint32>> terrains;
+	};
+	enum
+	{
+		/* in 32 bit words */
+		DEFAULT_CAPACITY	=	4 * 1024 * 1024,
+	};
+private:
+	enum
+	{
+		/* record types, in the lowest byte of the first record word; a cell record is laid out as
+		 * (header, x, y, old tile, new tile), a rectangle record as (header, x, y, width, height,
+		 * old tiles, new tiles), with a single tile instead of all of them for the uniform flags below,
+		 * and a terrain record as (header, x, y, old terrain, new terrain, old layer, new layer) */
+		RECORD_CELL	=	1,
+		RECORD_RECT,
+		RECORD_TERRAIN,
+		/* the layer is in the second byte of the header, and these flags are in the third */
+		OLD_UNIFORM	=	1,
+		NEW_UNIFORM	=	2,
+	};
+	struct Command
+	{
+		/* the position of the first record word, counted from the start of the history */
+		qint64 start;
+		qint64 end;
+		/* set for edits that replaced the whole map, these have no records, their words are left unused */
+		bool hasMaps = false;
+		TileMap before, after;
+	};
+	struct PendingCell
+	{
+		int layer, x, y;
+		TileIndex oldTile;
+	};
+	TileMap * map;
+	TileInfo * tileInfo;
+	qint64 capacity;
+	QVector<quint32> buffer;
+	/* 'head' is where the next record word goes */
+	qint64 head = 0;
+	QList<Command> commands;
+	/* the commands before this one are done, the rest can be redone */
+	int current = 0;
+	int nesting = 0;
+	bool overflow = false;
+	QVector<PendingCell> pendingCells;
+
+	quint32 word(qint64 position) const { return buffer.at(position % capacity); }
+	void put(quint32 word);
+	/* makes room for 'words' more words, by dropping the oldest commands */
+	bool reserve(qint64 words);
+	void flushPendingCells(void);
+	void writeRect(int layer, const QRect & cells, const TileIndex * oldTiles, bool oldUniform, const TileIndex * newTiles, bool newUniform);
+	void apply(const Command & command, bool undo, Changes & changes);
+	/* records a command that changed the map from 'before' to the current map */
+	void recordMaps(const TileMap & before);
+	/* the words that the chunks of two maps, that the maps do not share, take up */
+	static qint64 snapshotWords(const TileMap & before, const TileMap & after);
+	/* the words that a snapshot of the map would take up, if the given cells of a layer were filled */
+	qint64 fillSnapshotWords(int layer, const QVector<QRect> & cells) const;
+	void startCommand(void);
+	void finishCommand(void);
+public:
+	EditHistory(TileMap * map, TileInfo * tileInfo, qint64 capacity = DEFAULT_CAPACITY)
+		: map(map), tileInfo(tileInfo), capacity(std::max(capacity, qint64(64))) {}
+	/* forgets all commands, this must be called when the map or the tile information are changed
+	 * in some other way than through this class */
+	void clear(void);
+	/* groups the edits up to the matching 'endCommand()' into a single command - these can be nested */
+	void beginCommand(void);
+	void endCommand(void);
+	void setTile(int layer, int x, int y, TileIndex tile);
+	/* these return the bounding rectangle of the changed cells */
+	QRect setTiles(int layer, const QRect & cells, TileIndex tile);
+	QRect floodFill(int layer, int x, int y, TileIndex tile);
+	void setTerrain(int tileX, int tileY, qint32 terrain, int layer);
+	/* replaces the whole map, as a command of its own - this must not be called between
+	 * 'beginCommand()' and 'endCommand()' */
+	void setMap(const TileMap & map);
+	/* whether replacing the whole map with 'map' would drop commands that can be undone now */
+	bool dropsOlderCommands(const TileMap & map) const;
+
+	bool canUndo(void) const { return current > 0 && !nesting; }
+	bool canRedo(void) const { return current < commands.size() && !nesting; }
+	Changes undo(void);
+	Changes redo(void);
+	int commandCount(void) const { return commands.size(); }
+	/* the ring buffer memory in use, in bytes */
+	qint64 memoryUsage(void) const { return buffer.capacity() * sizeof(quint32); }
+};
+
+#endif // EDITHISTORY_HXX
@@ -0,0 +1,21 @@
+# the editor, without its main() function
+
+include($$PWD/model.pri)
+
+SOURCES += $$PWD/mapeditor.cxx \
+        $$PWD/tilemapitem.cxx \
+        $$PWD/spritesheet.cxx \
+        $$PWD/maploader.cxx \
+        $$PWD/minimap.cxx \
+        $$PWD/profileroverlay.cxx \
+        $$PWD/tilepalette.cxx
+
+HEADERS += $$PWD/mapeditor.hxx \
+        $$PWD/tilemapitem.hxx \
+        $$PWD/spritesheet.hxx \
+        $$PWD/maploader.hxx \
+        $$PWD/minimap.hxx \
+        $$PWD/profileroverlay.hxx \
+        $$PWD/tilepalette.hxx
+
+FORMS += $$PWD/mapeditor.ui
@@ -0,0 +1,183 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QFileInfo>
+#include <QDir>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include <cstdio>
+
+#include "tilemap.hxx"
+#include "tileinfo.hxx"
+#include "mappack.hxx"
+
+/* bakes map files into packs for the game (see MapPack), a map per worker thread; a pack that was built
+ * from the same inputs, with the same settings, is left as it is */
+
+struct Job
+{
+	QString mapFileName, packFileName;
+	enum { FAILED, BUILT, SKIPPED, } result = FAILED;
+	QString error;
+};
+
+/* what all packs are built from, besides their maps */
+struct Inputs
+{
+	QImage tileSet;
+	TileInfo tileInfo;
+	MapPack::Settings settings;
+	QByteArray hash;
+	bool force = false;
+};
+
+static QByteArray readFile(const QString & fileName, bool * ok = 0)
+{
+	QFile f(fileName);
+	bool result = f.open(QFile::ReadOnly);
+	auto data = result ? f.readAll() : QByteArray();
+	if (ok)
+		* ok = result;
+	return data;
+}
+
+static void exportMap(Job & job, const Inputs & inputs)
+{
+	bool ok;
+	auto data = readFile(job.mapFileName, & ok);
+	if (!ok)
+	{
+		job.error = "cannot read the map";
+		return;
+	}
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(inputs.hash);
+	hash.addData(data);
+	auto inputHash = hash.result();
+	if (!inputs.force && MapPack::inputHash(job.packFileName) == inputHash)
+	{
+		job.result = Job::SKIPPED;
+		return;
+	}
+	TileMap map;
+	if (!(TileMap::isBinaryFileName(job.mapFileName) ? map.readBinary(reinterpret_cast<const uchar *>(data.constData()), data.size())
+			: map.readJson(QJsonDocument::fromJson(data).object())))
+	{
+		job.error = "not a valid map";
+		return;
+	}
+	if (!MapPack::save(job.packFileName, map, inputs.tileSet, inputs.tileInfo, inputs.settings, inputHash))
+	{
+		job.error = "cannot write the pack";
+		return;
+	}
+	job.result = Job::BUILT;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+	QCoreApplication::setApplicationName("MapExport");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("bakes maps into packs for the game - each pack holds an atlas of the tiles the map uses, "
+			"the map layers with the tiles renumbered to match, and the terrain masks of the tiles; packs that are up to date are skipped");
+	parser.addHelpOption();
+	parser.addPositionalArgument("maps", "map files, in the json or the binary map format", "maps...");
+	QCommandLineOption tileSetOption("tile-set", "tile set image", "file", "tile-set.png");
+	QCommandLineOption tileInfoOption("tile-info", "tile information file", "file", "tile-info.json");
+	QCommandLineOption tileSizeOption("tile-size", "tile size, as WIDTHxHEIGHT, or a single number for square tiles", "pixels", "8");
+	QCommandLineOption solidTerrainOption("solid-terrain", "the terrain that blocks the game entities", "name");
+	QCommandLineOption outputOption("output", "directory to write the packs to", "directory", "packs");
+	QCommandLineOption jobsOption("jobs", "maps exported at the same time", "count", QString::number(QThread::idealThreadCount()));
+	QCommandLineOption forceOption("force", "build all packs, even the ones that are up to date");
+	parser.addOptions({ tileSetOption, tileInfoOption, tileSizeOption, solidTerrainOption, outputOption, jobsOption, forceOption, });
+	parser.process(a);
+
+	QElapsedTimer timer;
+	timer.start();
+	Inputs inputs;
+	inputs.force = parser.isSet(forceOption);
+	auto tileSize = parser.value(tileSizeOption).split('x');
+	inputs.settings.tileWidth = tileSize.value(0).toInt();
+	inputs.settings.tileHeight = tileSize.size() > 1 ? tileSize.value(1).toInt() : inputs.settings.tileWidth;
+	if (inputs.settings.tileWidth <= 0 || inputs.settings.tileHeight <= 0)
+	{
+		fprintf(stderr, "invalid tile size %s\n", qPrintable(parser.value(tileSizeOption)));
+		return 1;
+	}
+
+	bool ok;
+	auto tileSetData = readFile(parser.value(tileSetOption), & ok);
+	inputs.tileSet = QImage::fromData(tileSetData);
+	if (!ok || inputs.tileSet.isNull())
+	{
+		fprintf(stderr, "cannot read the tile set %s\n", qPrintable(parser.value(tileSetOption)));
+		return 1;
+	}
+	/* as in the editor, tiles without information get the defaults */
+	auto tileInfoData = readFile(parser.value(tileInfoOption));
+	auto tileInfoJson = QJsonDocument::fromJson(tileInfoData).object();
+	TileInfo::terrainNames() = TileInfo::readTerrainNames(tileInfoJson);
+	if (tileInfoJson.isEmpty() || !inputs.tileInfo.readJson(tileInfoJson))
+		inputs.tileInfo.resize(inputs.tileSet.width() / inputs.settings.tileWidth, inputs.tileSet.height() / inputs.settings.tileHeight);
+	if (parser.isSet(solidTerrainOption))
+	{
+		auto i = TileInfo::terrainNames().indexOf(parser.value(solidTerrainOption));
+		if (i == -1)
+		{
+			fprintf(stderr, "unknown terrain %s\n", qPrintable(parser.value(solidTerrainOption)));
+			return 1;
+		}
+		inputs.settings.solidTerrain = qint32(quint32(1) << i);
+	}
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(QByteArray::number(int(MapPack::PACK_FILE_VERSION)) + " " + QByteArray::number(inputs.settings.tileWidth) + " "
+			+ QByteArray::number(inputs.settings.tileHeight) + " " + QByteArray::number(inputs.settings.solidTerrain));
+	hash.addData(QCryptographicHash::hash(tileSetData, QCryptographicHash::Sha1));
+	hash.addData(QCryptographicHash::hash(tileInfoData, QCryptographicHash::Sha1));
+	inputs.hash = hash.result();
+	tileSetData.clear();
+
+	QDir output(parser.value(outputOption));
+	if (!output.mkpath("."))
+	{
+		fprintf(stderr, "cannot create %s\n", qPrintable(output.path()));
+		return 1;
+	}
+	QVector<Job> jobs;
+	QHash<QString, QString> packs;
+	for (const auto & fileName : parser.positionalArguments())
+	{
+		Job job;
+		job.mapFileName = fileName;
+		job.packFileName = output.filePath(QFileInfo(fileName).completeBaseName() + ".tpak");
+		/* maps of the same name in different directories would overwrite each other's pack */
+		if (packs.contains(job.packFileName))
+		{
+			fprintf(stderr, "%s and %s would both be exported to %s\n", qPrintable(packs.value(job.packFileName)), qPrintable(fileName), qPrintable(job.packFileName));
+			return 1;
+		}
+		packs.insert(job.packFileName, fileName);
+		jobs << job;
+	}
+
+	QThreadPool::globalInstance()->setMaxThreadCount(std::max(parser.value(jobsOption).toInt(), 1));
+	QtConcurrent::blockingMap(jobs, [&] (Job & job) { exportMap(job, inputs); });
+
+	int counts[3] = { 0, 0, 0, };
+	for (const auto & job : jobs)
+	{
+		counts[job.result] ++;
+		if (job.result == Job::BUILT)
+			fprintf(stderr, "built    %s -> %s\n", qPrintable(job.mapFileName), qPrintable(job.packFileName));
+		else if (job.result == Job::FAILED)
+			fprintf(stderr, "failed   %s: %s\n", qPrintable(job.mapFileName), qPrintable(job.error));
+	}
+	fprintf(stderr, "%d built, %d up to date, %d failed, in %.3f s\n", counts[Job::BUILT], counts[Job::SKIPPED], counts[Job::FAILED], timer.nsecsElapsed() / 1e9);
+	return counts[Job::FAILED] ? 1 : 0;
+}
@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# headless batch export of maps to runtime packs,
+# built from the model code alone, without the editor
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent
+QT       -= widgets
+
+TARGET = MapExport
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES += exporter.cxx
+
+include(../model.pri)
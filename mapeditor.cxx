@@ -5,13 +5,15 @@
 #include <QJsonArray>
 #include <QGradient>
 #include <QScrollBar>
+#include <QShortcut>
+#include <QDockWidget>
+#include <QSaveFile>
 #include <QDebug>
+#include <QtConcurrent>
 
 #include "mapeditor.hxx"
 #include "ui_mapeditor.h"
 
-QStringList TileInfo::terrainTypeNames;
-
 MapEditor::MapEditor(QWidget *parent) :
 	QMainWindow(parent),
 	ui(new Ui::MapEditor)
@@ -31,7 +33,7 @@ MapEditor::MapEditor(QWidget *parent) :
 	if (tileset_image.isNull())
 		tileset_image= QImage(QSize(2000, 2000), QImage::Format_RGB32);
 	tileSet.setImage(tileset_image);
-	tileSheet.setImage(QImage(last_map_image_filename = s.value("last-map-image").toString()));
+	tileSheet.open(last_map_image_filename = s.value("last-map-image").toString());
 	
 	connect(ui->spinBoxZoomLevel, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), [this] (int s) -> void { auto x = QTransform(); ui->graphicsViewTileSet->setTransform(x.scale(s, s)); });
 	connect(ui->pushButtonClearMap, & QPushButton::clicked, [=]{clearMap();});
@@ -47,6 +49,8 @@ MapEditor::MapEditor(QWidget *parent) :
 	
 	connect(& tileSet, SIGNAL(tileSelected(int,int)), this, SLOT(tileSelected(int,int)));
 	connect(& tileSet, SIGNAL(tileShiftSelected(int,int)), this, SLOT(tileShiftSelected(int,int)));
+	connect(& tileSet, & TileSet::tileChanged, [=] (int x, int y)
+		{ tilePalette->update(); filteredTilePalette->update(); tileMapItem->tileChanged(TileMap::tileIndex(x, y)); });
 
 	ui->spinBoxTileWidth->setValue(s.value("tile-width", MINIMUM_TILE_SIZE).toInt());
 	ui->spinBoxTileHeight->setValue(s.value("tile-height", MINIMUM_TILE_SIZE).toInt());
@@ -56,7 +60,8 @@ MapEditor::MapEditor(QWidget *parent) :
 	ui->spinBoxMapHeight->setValue(s.value("map-height", 2).toInt());
 
 	connect(ui->spinBoxGlobalZoom, static_cast<void(QSpinBox::*)(int)>(& QSpinBox::valueChanged), this,
-		[=] (int s){auto x = QTransform(); ui->graphicsViewTileSet->setTransform(x.scale(s, s)); ui->graphicsViewTileMap->setTransform(x); });
+		[=] (int s){auto x = QTransform(); ui->graphicsViewTileSet->setTransform(x.scale(s, s)); updateMapTransform(); });
+	connect(ui->spinBoxMapZoomOut, static_cast<void(QSpinBox::*)(int)>(& QSpinBox::valueChanged), [=] { updateMapTransform(); });
 	ui->dockWidgetTileSet->setHidden(MINIMALISTIC_INTERFACE);
 	ui->groupBoxMapControls->setHidden(MINIMALISTIC_INTERFACE);
 	ui->groupBoxTileSetControls->setHidden(MINIMALISTIC_INTERFACE);
@@ -76,59 +81,115 @@ MapEditor::MapEditor(QWidget *parent) :
 		resetTileData(tileSet.tileCountX(), tileSet.tileCountY());
 	else
 	{
-		int x, y, i = 0;
-		resetTileData(x = jdoc.object()["tiles-x"].toInt(), y = jdoc.object()["tiles-y"].toInt());
-		auto terrains = jdoc.object()["terrains"].toArray();
-		for (auto t : terrains)
+		for (const auto & name : TileInfo::readTerrainNames(jdoc.object()))
 		{
-			TileInfo::terrainNames() << t.toObject()["name"].toString();
+			TileInfo::terrainNames() << name;
 			terrain_checkboxes << new QCheckBox(TileInfo::terrainNames().last(), this);
 			ui->groupBoxTerrain->layout()->addWidget(terrain_checkboxes.last());
 		}
 
-		auto tiles = jdoc.object()["tiles"].toArray();
-		for (auto t : tiles)
-			tileInfo[i / x][i % x].read(t.toObject()), ++ i;
-	}
-	auto tx = tileSet.tileCountX(), ty = tileSet.tileCountY(), w = tileSet.tileWidth(), h = tileSet.tileHeight();
-	for (auto y = 0; y < ty; y ++)
-		for (auto x = 0; x < tx; x ++)
-		{
-			Tile * tile = new Tile(tileSet.getTilePixmap(x, y));
-			graphicsSceneTiles << tile;
-			tile->setXY(x, y);
-			tile->setTileInfoPointer(& tileInfo[y][x]);
-			connect(tile, SIGNAL(tileSelected(Tile*)), this, SLOT(tileSelected(Tile*)));
-			connect(tile, SIGNAL(tileShiftSelected(Tile*)), this, SLOT(tileShiftSelected(Tile*)));
-			tileSetGraphicsScene.addItem(tile);
-			tile->setPos(x * w, y * h);
-		}
-	auto pen = QPen(Qt::green);
-	for (auto y = 0; y < ty; y ++)
-	{
-		auto l = new QGraphicsLineItem(0, y * h, tx * w - 1, y * h);
-		l->setPen(pen);
-		tileSetGraphicsScene.addItem(l);
+		/* the terrain names are needed to read the tiles */
+		if (!tileInfo.readJson(jdoc.object()))
+			tileInfo.resize(tileSet.tileCountX(), tileSet.tileCountY());
+		terrainIndex.rebuild(tileInfo);
+		history.clear();
 	}
-	for (auto x = 0; x < tx; x ++)
+	/* both palettes draw straight from the tile set, the second one only shows the tiles found by a terrain query */
+	tileSetGraphicsScene.addItem(tilePalette = new TilePaletteItem(& tileSet));
+	filteredTilesGraphicsScene.addItem(filteredTilePalette = new TilePaletteItem(& tileSet));
+	filteredTilePalette->setFilter(QVector<TileIndex>());
+	filteredTilePalette->setGridColour(Qt::cyan);
+	for (auto palette : { tilePalette, filteredTilePalette, })
 	{
-		auto l = new QGraphicsLineItem(x * w, 0, x * w, ty * h - 1);
-		l->setPen(pen);
-		tileSetGraphicsScene.addItem(l);
+		connect(palette, & TilePaletteItem::tileSelected, this, & MapEditor::paletteTileSelected);
+		connect(palette, & TilePaletteItem::tileShiftSelected, this, static_cast<void(MapEditor::*)(int,int)>(& MapEditor::tileShiftSelected));
+		connect(palette, & TilePaletteItem::selectionChanged, [=] { paletteSelectionChanged(palette); });
+		connect(ui->spinBoxTileWidth, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), palette, & TilePaletteItem::tileSetChanged);
+		connect(ui->spinBoxTileHeight, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), palette, & TilePaletteItem::tileSetChanged);
 	}
-	
+	tileSetGraphicsScene.setItemIndexMethod(QGraphicsScene::NoIndex);
+	filteredTilesGraphicsScene.setItemIndexMethod(QGraphicsScene::NoIndex);
+
 	ui->graphicsViewTileSet->setScene(& tileSetGraphicsScene);
 	ui->graphicsViewFilteredTiles->setScene(& filteredTilesGraphicsScene);
 
-	if (!loadMap("map.json"))
-		clearMap();
+	/* the map is a single item, and the rest are a few moving entities, so there is nothing for an index to speed up */
+	tileMapGraphicsScene.setItemIndexMethod(QGraphicsScene::NoIndex);
+	tileMapItem = new TileMapItem(& tileMap, & tileSet);
+	tileMapItem->setZValue(-1);
+	tileMapGraphicsScene.addItem(tileMapItem);
+	connect(tileMapItem, SIGNAL(cellSelected(int,int)), this, SLOT(mapTileSelected(int,int)));
+	connect(tileMapItem, & TileMapItem::cellDragged, this, & MapEditor::mapCellDragged);
+	connect(tileMapItem, & TileMapItem::paintingFinished, this, & MapEditor::brushStrokeFinished);
+	brushUpdateTimer.setSingleShot(true);
+	brushUpdateTimer.setInterval(BRUSH_UPDATE_INTERVAL_MS);
+	connect(& brushUpdateTimer, & QTimer::timeout, [=] { flushBrushUpdate(); });
+	connect(ui->spinBoxBrushX, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), [=] { updateBrush(); });
+	connect(ui->spinBoxBrushY, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), [=] { updateBrush(); });
+	updateBrush();
+	connect(tileMapItem, & TileMapItem::cellControlSelected, [=] (int x, int y)
+	{
+		brushStrokeFinished();
+		history.beginCommand();
+		for (auto i = 1; i < MAP_LAYERS; i ++)
+			history.setTile(i, x, y, TileMap::NO_TILE);
+		retileAround(QRect(x, y, 1, 1));
+		history.endCommand();
+	});
+	connect(tileMapItem, & TileMapItem::cellAltSelected, this, & MapEditor::paintTerrain);
+	connect(tileMapItem, & TileMapItem::cellsShiftSelected, this, & MapEditor::mapCellsFilled);
+	/* every other edit ends a brush stroke that is still going on, so that it does not end up in the stroke's command */
+	connect(new QShortcut(QKeySequence::Undo, this), & QShortcut::activated, [=] { brushStrokeFinished(); applyHistoryChanges(history.undo()); });
+	connect(new QShortcut(QKeySequence::Redo, this), & QShortcut::activated, [=] { brushStrokeFinished(); applyHistoryChanges(history.redo()); });
+	connect(ui->spinBoxTileWidth, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), [=] { tileMapItem->mapChanged(); });
+	connect(ui->spinBoxTileHeight, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), [=] { tileMapItem->mapChanged(); });
+	connect(ui->spinBoxTileWidth, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), [=] { collisionMap.setTileSize(tileSet.tileWidth(), tileSet.tileHeight()); });
+	connect(ui->spinBoxTileHeight, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), [=] { collisionMap.setTileSize(tileSet.tileWidth(), tileSet.tileHeight()); });
+	collisionMap.setTileSize(tileSet.tileWidth(), tileSet.tileHeight());
+	tileMapGraphicsScene.setCollisionMap(& collisionMap);
+	solidTerrainName = s.value("solid-terrain", "solid").toString();
+	updateSolidTerrain();
+	map_file_name = s.value("map-file", "map.json").toString();
+	/* the map file name only changes once a map has been loaded from the new file, a failed load keeps the old one */
+	connect(& mapLoader, & MapLoader::mapLoaded, this, [=] (const QString & fileName, const TileMap & map)
+		{ brushStrokeFinished(); map_file_name = fileName; tileMap = map; history.clear(); tileMapItem->mapChanged(); tileMapItem->beginStreaming(); });
+	connect(& mapLoader, & MapLoader::chunkLoaded, tileMapItem, & TileMapItem::setChunkImage);
+	connect(& mapLoader, & MapLoader::finished, this, [=] (const QString & error)
+		{ tileMapItem->endStreaming(); ui->statusBar->showMessage(error.isEmpty() ? tr("map loaded") : error); });
+	connect(new QShortcut(QKeySequence::Open, this), & QShortcut::activated, [=] {
+		auto fileName = QFileDialog::getOpenFileName(this, tr("select map to open"), QString(), tr("maps (*.json *.tmap)"));
+		if (!fileName.isEmpty())
+			loadMap(fileName);
+	});
+	/* the window is usable with an empty map, until the map file is loaded */
+	clearMap();
+	history.clear();
 	ui->graphicsViewTileMap->setScene(& tileMapGraphicsScene);
-	connect(ui->spinBoxRotateMap, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), [=](int angle){auto r = QTransform(); ui->graphicsViewTileMap->setTransform(r.rotate(-angle));});
+	loadMap(map_file_name);
+	connect(ui->spinBoxRotateMap, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), [=] { updateMapTransform(); });
+	miniMap = new MiniMap(tileMapItem, ui->graphicsViewTileMap);
+	auto miniMapDock = new QDockWidget(tr("minimap"), this);
+	/* the window state was restored before this dock existed */
+	miniMapDock->setObjectName("dockWidgetMiniMap");
+	miniMapDock->setWidget(miniMap);
+	addDockWidget(Qt::RightDockWidgetArea, miniMapDock);
+	restoreDockWidget(miniMapDock);
+	miniMapDock->setHidden(MINIMALISTIC_INTERFACE);
+	profilerOverlay = new ProfilerOverlay(& tileMapGraphicsScene, tileMapItem, ui->graphicsViewTileMap->viewport());
+	profilerOverlay->hide();
+	connect(new QShortcut(QKeySequence(Qt::Key_F3), this), & QShortcut::activated, [=] { profilerOverlay->setVisible(profilerOverlay->isHidden()); });
+	connect(new QShortcut(QKeySequence(Qt::Key_F4), this), & QShortcut::activated, [=] {
+		auto fileName = QFileDialog::getSaveFileName(this, tr("export trace"), "trace.json", tr("chrome traces (*.json)"));
+		if (fileName.isEmpty())
+			return;
+		Profiler::sampleCounters();
+		QSaveFile f(fileName);
+		ui->statusBar->showMessage(f.open(QIODevice::WriteOnly) && Profiler::writeChromeTrace(f) && f.commit()
+				? tr("trace exported to %1").arg(fileName) : tr("Error exporting trace to %1!").arg(fileName));
+	});
 
 	ui->graphicsViewTileSet->setInteractive(true);
-	ui->graphicsViewTileSet->setDragMode(QGraphicsView::RubberBandDrag);
 
-	connect(& tileSetGraphicsScene, & QGraphicsScene::selectionChanged, [=] { qDebug() << "tiles selected:" << tileSetGraphicsScene.selectedItems().size(); });
 
 	tileMapGraphicsScene.setPlayer(player = new Player());
 	player->setPos(100, 100);
@@ -138,11 +199,18 @@ MapEditor::MapEditor(QWidget *parent) :
 	connect(ui->graphicsViewTileMap->horizontalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(gameSceneViewportMoved()));
 	connect(ui->graphicsViewTileMap->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(gameSceneViewportMoved()));
 
-	Animation * a;
-	tileMapGraphicsScene.addItem(a = new Animation(0, "red-gemstone.png", 12, 30, true, true));
-	connect(a, & Animation::animationFinished, [=](Animation * a){ tileMapGraphicsScene.removeItem(a); delete a; });
+	Animation * a = new Animation(0, "red-gemstone.png", 12, 30, true, true);
 	a->setPos(240, 280);
-	a->start();
+	tileMapGraphicsScene.startAnimation(a);
+
+	connect(& projectSaver, & ProjectSaver::progress, this, [=] (int step, int steps, const QString & fileName)
+		{ ui->statusBar->showMessage(step < steps ? tr("saving %1...").arg(fileName) : tr("project saved")); });
+	connect(& projectSaver, & ProjectSaver::finished, this, [=] (const QString & error) { if (!error.isEmpty()) ui->statusBar->showMessage(error); });
+	/* autosaving is disabled when the interval is zero */
+	autosaveTimer.setInterval(s.value("autosave-interval", 0).toInt() * 1000);
+	connect(& autosaveTimer, & QTimer::timeout, [=] { if (!projectSaver.isSaving()) projectSaver.save(projectSnapshot()); });
+	if (autosaveTimer.interval())
+		autosaveTimer.start();
 
 	upArrowOverlayButton = new QGraphicsPixmapItem(QPixmap("up-arrow.png"));
 	upArrowOverlayButton->setOpacity(.2);
@@ -157,14 +225,12 @@ MapEditor::~MapEditor()
 void MapEditor::on_pushButtonOpenImage_clicked()
 {
 	auto s = QFileDialog::getOpenFileName(0, tr("select image to open"));
-	QImage image(s);
-	if (image.isNull())
+	if (!tileSheet.open(s))
 	{
 		QMessageBox::warning(0, tr("error opening image"), tr("Error opening image!"));
 		return;
 	}
 	last_map_image_filename = s;
-	tileSheet.setImage(image);
 }
 
 void MapEditor::closeEvent(QCloseEvent *event)
@@ -174,6 +240,7 @@ void MapEditor::closeEvent(QCloseEvent *event)
 	s.setValue("window-state", saveState());
 	s.setValue("tile-width", ui->spinBoxTileWidth->value());
 	s.setValue("tile-height", ui->spinBoxTileHeight->value());
+	s.setValue("solid-terrain", solidTerrainName);
 	s.setValue("map-width", ui->spinBoxMapWidth->value());
 	s.setValue("map-height", ui->spinBoxMapHeight->value());
 	s.setValue("horizontal-offset", ui->spinBoxHorizontalOffset->value());
@@ -181,113 +248,204 @@ void MapEditor::closeEvent(QCloseEvent *event)
 	s.setValue("last-map-image", last_map_image_filename);
 	s.setValue("splitter-tile-data", ui->splitterTileData->saveState());
 	s.setValue("splitter-main", ui->splitterMain->saveState());
-	tileSet.getImage().save("tile-set.png");
-	QJsonArray tiles;
-	int x, y;
-	y = 0;
-	for (auto row : tileInfo)
-	{
-		x = 0;
-		for (auto tile : row)
-		{
-			QJsonObject t;
-			tile.write(t);
-			++ x;
-			tiles.append(t);
-		}
-		y ++;
-	}
-	QJsonArray terrains;
-	for (auto t : TileInfo::terrainNames())
-	{
-		QJsonObject x;
-		x["name"] = t;
-		terrains.append(x);
-	}
-	QJsonObject t;
-	t["tiles-x"] = x;
-	t["tiles-y"] = y;
-	t["terrains"] = terrains;
-	t["tiles"] = tiles;
-	QFile f("tile-info.json");
-	f.open(QFile::WriteOnly);
-	QJsonDocument jdoc(t);
-	f.write(jdoc.toJson());
+	s.setValue("map-file", map_file_name);
+	s.setValue("autosave-interval", autosaveTimer.interval() / 1000);
+	/* the files are written on a worker thread, the destructor waits for that to complete */
+	autosaveTimer.stop();
+	projectSaver.save(projectSnapshot());
+}
 
-	saveMap("map.json");
+ProjectSaver::Snapshot MapEditor::projectSnapshot()
+{
+	ProjectSaver::Snapshot snapshot;
+	snapshot.tileSetImage = tileSet.getImage();
+	snapshot.tileInfo = tileInfo;
+	snapshot.terrainNames = TileInfo::terrainNames();
+	snapshot.tileMap = tileMap;
+	/* a map that has not been loaded completely is not written over the map file */
+	snapshot.mapFileName = mapLoader.isLoading() ? QString() : map_file_name;
+	return snapshot;
 }
 
 void MapEditor::on_pushButtonResetTileData_clicked()
 {
 	if (QMessageBox::question(0, "confirm reset of tile map data", "Please, confirm that you want to destroy the current tile data, and start from scratch!",
 				  QMessageBox::Yes, QMessageBox::Cancel) == QMessageBox::Yes)
+	{
+		brushStrokeFinished();
 		resetTileData(tileSet.tileCountX(), tileSet.tileCountY());
+		updateBrush();
+	}
 }
 
 void MapEditor::tileSelected(int tileX, int tileY)
 {
-	last_tile_selected = & tileInfo[tileY][tileX];
+	lastTileSelected = QPoint(tileX, tileY);
 	ui->labelTileX->setText(QString("%1").arg(tileX));
 	ui->labelTileY->setText(QString("%1").arg(tileY));
-	ui->lineEditTileName->setText(last_tile_selected->name());
-	ui->spinBoxTerrainLayer->setValue(tileInfo[tileY][tileX].getLayer());
+	ui->lineEditTileName->setText(tileInfo.name(tileX, tileY));
+	ui->spinBoxTerrainLayer->setValue(tileInfo.layer(tileX, tileY));
 	if (!ui->checkBoxLockTerrain->isChecked())
 	{
-	auto t = last_tile_selected->terrain(), i = 1;
+	auto t = tileInfo.terrain(tileX, tileY), i = 1;
 		for (auto c : terrain_checkboxes)
 			c->setChecked(t & i), i <<= 1;
 	}
 }
 
-void MapEditor::mapTileSelected(Tile *tile)
+QVector<TileIndex> MapEditor::paletteSelection(void) const
 {
-	auto tiles = tileSetGraphicsScene.selectedItems();
-	qDebug() << tiles.size();
-	std::sort(tiles.begin(), tiles.end(), [](QGraphicsItem * & a, QGraphicsItem * & b)->bool { Tile * a1 = dynamic_cast<Tile*>(a), * b1 = dynamic_cast<Tile*>(b); return (a1->getY() << 16) + a1->getX() < (b1->getY() << 16) + b1->getX();});
-	if (tiles.isEmpty() && lastTileFromMapSelected)
-	{
-		tile = tileMap[lastTileFromMapSelected->getTileInfo()->getLayer()][tile->getY()][tile->getX()];
-		tile->setPixmap(lastTileFromMapSelected->pixmap());
-		tile->setTileInfoPointer(lastTileFromMapSelected->getTileInfo());
-	}
-	else if (!tiles.isEmpty())
+	/* only one of the palettes has a selection at a time, and both select by tile set position */
+	auto tiles = tilePalette->selectedTiles();
+	return tiles.isEmpty() ? filteredTilePalette->selectedTiles() : tiles;
+}
+
+void MapEditor::paletteSelectionChanged(TilePaletteItem * palette)
+{
+	if (!palette->selectedTiles().isEmpty())
+		(palette == tilePalette ? filteredTilePalette : tilePalette)->clearSelection();
+	updateBrush();
+}
+
+void MapEditor::updateBrush(void)
+{
+	auto tiles = paletteSelection();
+	if (tiles.isEmpty() && tileInfo.contains(lastPaletteTile.x(), lastPaletteTile.y()))
+		tiles << TileMap::tileIndex(lastPaletteTile.x(), lastPaletteTile.y());
+	brush.setTiles(tiles, tileInfo);
+	brush.setRepeat(ui->spinBoxBrushX->value(), ui->spinBoxBrushY->value());
+}
+
+void MapEditor::mapTileSelected(int x, int y)
+{
+	/* in case the release of the last stroke never arrived */
+	brushStrokeFinished();
+	Profiler::Scope scope("stamp-tiles");
+	/* the whole stroke is undone at once */
+	history.beginCommand();
+	isBrushStroke = true;
+	brushOrigin = brushCell = QPoint(x, y);
+	brushCellsChanged(brush.paint(history, tileMap, brushCell, brushOrigin));
+}
+
+void MapEditor::mapCellDragged(int x, int y)
+{
+	if (!isBrushStroke)
+		return;
+	Profiler::Scope scope("stamp-tiles");
+	brushCellsChanged(brush.paintLine(history, tileMap, brushCell, QPoint(x, y), brushOrigin));
+	brushCell = QPoint(x, y);
+}
+
+void MapEditor::brushStrokeFinished(void)
+{
+	if (!isBrushStroke)
+		return;
+	isBrushStroke = false;
+	flushBrushUpdate();
+	history.endCommand();
+}
+
+void MapEditor::brushCellsChanged(const QRect & cells)
+{
+	if (cells.isEmpty())
+		return;
+	brushDirtyCells |= cells;
+	if (!brushUpdateTimer.isActive())
+		brushUpdateTimer.start();
+}
+
+void MapEditor::flushBrushUpdate(void)
+{
+	brushUpdateTimer.stop();
+	if (!brushDirtyCells.isEmpty())
+		tileMapItem->cellsChanged(brushDirtyCells);
+	brushDirtyCells = QRect();
+}
+
+void MapEditor::mapCellsFilled(const QRect & cells)
+{
+	auto tiles = paletteSelection();
+	auto tile = tiles.isEmpty() ? TileMap::tileIndex(lastPaletteTile.x(), lastPaletteTile.y()) : tiles.first();
+	if (!tileInfo.contains(TileMap::tileSetX(tile), TileMap::tileSetY(tile)))
+		return;
+	brushStrokeFinished();
+	Profiler::Scope scope("fill-cells");
+	auto layer = tileInfo.layer(TileMap::tileSetX(tile), TileMap::tileSetY(tile));
+	/* a shift-click floods the connected area of the clicked tile, a shift-drag fills the dragged rectangle */
+	if (cells.width() == 1 && cells.height() == 1)
+		tileMapItem->cellsChanged(history.floodFill(layer, cells.x(), cells.y(), tile));
+	else
+		tileMapItem->cellsChanged(history.setTiles(layer, cells, tile));
+}
+
+void MapEditor::retileAround(const QRect & cells)
+{
+	updateAutotiler();
+	/* only the cells next to the changed ones can have a different neighbourhood */
+	auto r = cells.adjusted(-1, -1, 1, 1);
+	for (auto layer : autotiler.layers())
+		for (const auto & c : autotiler.retile(tileMap, layer, r))
+			history.setTile(layer, c.x, c.y, c.tile);
+	tileMapItem->cellsChanged(r);
+}
+
+void MapEditor::paintTerrain(int x, int y)
+{
+	updateAutotiler();
+	auto terrain = quint32(terrainBitmap()) ? int(qCountTrailingZeroBits(quint32(terrainBitmap()))) : -1;
+	if (!autotiler.hasTerrain(terrain))
 	{
-		int row = dynamic_cast<Tile*>(tiles.at(0))->getY(), mapy = tile->getY(), mapx = tile->getX(), map_start_x = mapx;
-		for (auto g : tiles)
-		{
-			Tile * t = dynamic_cast<Tile *>(g);
-			if (t->getY() != row)
-				row = t->getY(), mapy ++, mapx = map_start_x;
-			if (mapy >= tileMap[0].size() || mapx >= tileMap[0][mapy].size())
-				continue;
-			auto map_tile = tileMap[t->getTileInfo()->getLayer()][mapy][mapx ++];
-			map_tile->setPixmap(t->pixmap());
-			map_tile->setTileInfoPointer(t->getTileInfo());
-		}
+		ui->statusBar->showMessage(tr("no tiles are tagged with only the checked terrain"));
+		return;
 	}
+	brushStrokeFinished();
+	history.beginCommand();
+	/* the tile is replaced with the right one for its neighbourhood next */
+	history.setTile(autotiler.layer(terrain), x, y, autotiler.tile(terrain, 0));
+	retileAround(QRect(x, y, 1, 1));
+	history.endCommand();
 }
 
-void MapEditor::tileSelected(Tile *tile)
+void MapEditor::on_pushButtonAutotileMap_clicked()
 {
-	lastTileFromMapSelected = tile;
-	QApplication::clipboard()->setImage(tile->pixmap().toImage());
-	tileSelected(tile->getTileInfo()->getX(), tile->getTileInfo()->getY());
+	QElapsedTimer timer;
+	timer.start();
+	brushStrokeFinished();
+	updateAutotiler();
+	auto map = tileMap;
+	for (auto layer : autotiler.layers())
+		autotiler.retileLayer(map, layer);
+	if (!confirmMapEdit(map))
+		return;
+	history.setMap(map);
+	tileMapItem->mapChanged();
+	ui->statusBar->showMessage(tr("map autotiled in %1 ms").arg(timer.elapsed()));
 }
 
-void MapEditor::tileShiftSelected(int tileX, int tileY)
+void MapEditor::paletteTileSelected(int tileX, int tileY)
 {
-	tileInfo[tileY][tileX].setTerrain(terrainBitmap());
-	tileInfo[tileY][tileX].setLayer(ui->spinBoxTerrainLayer->value());
+	/* a tile picked from either palette replaces any selection in the other one */
+	(sender() == tilePalette ? filteredTilePalette : tilePalette)->clearSelection();
+	lastPaletteTile = QPoint(tileX, tileY);
+	QApplication::clipboard()->setImage(tileSet.getTilePixmap(tileX, tileY).toImage());
+	updateBrush();
+	tileSelected(tileX, tileY);
 }
 
-void MapEditor::tileShiftSelected(Tile *tile)
+void MapEditor::tileShiftSelected(int tileX, int tileY)
 {
-	tileShiftSelected(tile->getX(), tile->getY());
+	brushStrokeFinished();
+	auto terrain = terrainBitmap();
+	terrainIndex.setTerrain(tileX, tileY, tileInfo.terrain(tileX, tileY), terrain);
+	history.setTerrain(tileX, tileY, terrain, ui->spinBoxTerrainLayer->value());
+	autotilerDirty = true;
+	/* the brush keeps the layers of its tiles */
+	updateBrush();
 }
 
 void MapEditor::gameSceneViewportMoved()
 {
-	qDebug() << "game viewport movement" << ui->graphicsViewTileMap->viewport()->rect() << ui->graphicsViewTileMap->mapToScene(0, 0);
 	upArrowOverlayButton->setPos(ui->graphicsViewTileMap->mapToScene(0, 0));
 }
 
@@ -299,6 +457,8 @@ auto & t = TileInfo::terrainNames();
 		t << ui->lineEditNewTerrain->text();
 		terrain_checkboxes << new QCheckBox(t.last(), this);
 		ui->groupBoxTerrain->layout()->addWidget(terrain_checkboxes.last());
+		updateSolidTerrain();
+		autotilerDirty = true;
 	}
 	ui->lineEditNewTerrain->clear();
 }
@@ -317,244 +477,191 @@ auto i = t.indexOf(ui->lineEditNewTerrain->text());
 		QMessageBox::information(0, "terrain not found", "terrain not found");
 		return;
 	}
+	brushStrokeFinished();
 	t.removeAt(i);
 	delete terrain_checkboxes.at(i);
 	terrain_checkboxes.removeAt(i);
-	for (auto & tiles : tileInfo)
-		for (auto & tile : tiles)
-			tile.removeTerrain(i);
+	/* only the tiles that have this terrain, or one after it, change */
+	for (auto tile : terrainIndex.tiles(terrainIndex.tilesWithTerrainsFrom(i)))
+		tileInfo.removeTerrain(TileMap::tileSetX(tile), TileMap::tileSetY(tile), i);
+	terrainIndex.removeTerrain(i);
+	autotilerDirty = true;
+	/* the terrain bits recorded in the history do not match anymore */
+	history.clear();
+	updateSolidTerrain();
 }
 
 void MapEditor::on_pushButtonUpdateTile_clicked()
 {
-	if (!last_tile_selected)
+	int x = lastTileSelected.x(), y = lastTileSelected.y();
+	if (!tileInfo.contains(x, y))
 		return;
-	last_tile_selected->setName(ui->lineEditTileName->text());
-	last_tile_selected->setTerrain(terrainBitmap());
+	brushStrokeFinished();
+	auto terrain = terrainBitmap();
+	tileInfo.setName(x, y, ui->lineEditTileName->text());
+	terrainIndex.setTerrain(x, y, tileInfo.terrain(x, y), terrain);
+	/* the terrain and the layer are undone together, like a shift-click in the palette; names are not in the history */
+	history.beginCommand();
+	history.setTerrain(x, y, terrain, ui->spinBoxTerrainLayer->value());
+	history.endCommand();
+	autotilerDirty = true;
+	updateBrush();
 }
 
 void MapEditor::on_pushButtonAnimate_clicked()
 {
-	animation = tileSet.reapTiles([=] (int x, int y) -> bool { return tileInfo[y][x].terrain() == terrainBitmap(); });
+	QVector<TileIndex> tiles;
+	for (auto t : terrainIndex.tiles(terrainIndex.query(terrainBitmap(), true)))
+		if (TileMap::tileSetX(t) < tileSet.tileCountX() && TileMap::tileSetY(t) < tileSet.tileCountY())
+			tiles << t;
+	animation = TileSlicer::slice(tileSet.getImage(), tileSet.tileWidth(), tileSet.tileHeight(), tiles);
 	animation_index = 0;
 }
 
 void MapEditor::displayFilteredTiles(bool exactTerrainMatch)
 {
-	auto terrain = terrainBitmap();
-	auto last_row = -1;
-	QVector<QVector<Tile *>> tiles;
-	for (auto tile : graphicsSceneTiles)
+	filteredTilePalette->setFilter(terrainIndex.tiles(terrainIndex.query(terrainBitmap(), exactTerrainMatch)));
+	/* the tiles selected before may no longer be shown */
+	if (!filteredTilePalette->selectedTiles().isEmpty())
 	{
-		TileInfo * t = tile->getTileInfo();
-		if (!t)
-			continue;
-		if ((exactTerrainMatch && t->terrain() == terrain)
-				|| (!exactTerrainMatch && t->terrain() & terrain))
-		{
-			if (t->getY() != last_row)
-				last_row = t->getY(), tiles << QVector<Tile *>();
-			tiles.last() << tile;
-		}
+		filteredTilePalette->clearSelection();
+		updateBrush();
 	}
-	filteredTilesGraphicsScene.clear();
-	int x = 0, y = 0, maxx = 0, maxy;
-	for (auto tileRow : tiles)
-	{
-		x = 0;
-		for (auto tile : tileRow)
-		{
-			auto t = new Tile(* tile);
-			filteredTilesGraphicsScene.addItem(t);
-			t->setPos(x ++ * tileSet.tileWidth(), y * tileSet.tileHeight());
-			connect(t, SIGNAL(tileSelected(Tile*)), this, SLOT(tileSelected(Tile*)));
-		}
-		maxx = std::max(maxx, x);
-		y ++;
-	}
-	maxy = y;
-	for (x = 0; x < maxx; x++)
-		filteredTilesGraphicsScene.addLine(x * tileSet.tileWidth(), 0, x * tileSet.tileWidth(), maxy * tileSet.tileHeight(), QPen(Qt::cyan));
-	for (y = 0; y < maxy; y++)
-		filteredTilesGraphicsScene.addLine(0, y * tileSet.tileHeight(), maxx * tileSet.tileWidth(), y * tileSet.tileHeight(), QPen(Qt::cyan));
 }
 
 void MapEditor::on_pushButtonMarkTerrain_clicked()
 {
-auto t = terrainBitmap();
-
-	for (auto m : tileMarks)
-		tileSetGraphicsScene.removeItem(m);
-	tileMarks.clear();
-	for (auto tile : graphicsSceneTiles)
-	{
-		if (tileInfo.at(tile->getY()).at(tile->getX()).terrain() & t)
-		{
-			auto mark = new QGraphicsEllipseItem(tileSet.tileRect());
-			mark->setPos(tile->pos());
-			mark->setPen(QPen(Qt::cyan));
-			tileMarks << mark;
-			tileSetGraphicsScene.addItem(mark);
-		}
-	}
+	tilePalette->setMarkedTiles(terrainIndex.tiles(terrainIndex.query(terrainBitmap(), false)));
 }
 
-void MapEditor::saveMap(const QString &fileName)
+void MapEditor::loadMap(const QString &fileName)
 {
-	QJsonArray map_layers;
-	for (auto layer : tileMap)
+	MapLoader::Request request;
+	request.fileName = fileName;
+	request.atlas = tileSet.atlas();
+	request.tileWidth = tileSet.tileWidth();
+	request.tileHeight = tileSet.tileHeight();
+	if (request.tileWidth > 0 && request.tileHeight > 0)
 	{
-		int x, y;
-		QJsonArray layer_tiles;
-		y = 0;
-		for (auto row : layer)
-		{
-			x = 0;
-			for (auto tile : row)
-			{
-				QJsonObject t;
-				t["x"] = x;
-				t["y"] = y;
-				if (tile->getTileInfo())
-				{
-					t["tile-set-x"] = tile->getTileInfo()->getX();
-					t["tile-set-y"] = tile->getTileInfo()->getY();
-				}
-				else
-				{
-					t["tile-set-x"] = -1;
-					t["tile-set-y"] = -1;
-				}
-				++ x;
-				layer_tiles.append(t);
-			}
-			y ++;
-		}
-		map_layers.append(layer_tiles);
+		auto r = ui->graphicsViewTileMap->mapToScene(ui->graphicsViewTileMap->viewport()->rect()).boundingRect().toAlignedRect();
+		request.viewport = QRect(r.x() / request.tileWidth, r.y() / request.tileHeight, r.width() / request.tileWidth + 1, r.height() / request.tileHeight + 1);
 	}
-
-	QJsonObject t;
-	t["map-size-x"] = tileMap[0].at(0).size();
-	t["map-size-y"] = tileMap[0].size();
-	t["layers"] = map_layers;
-	QFile f(fileName);
-	f.open(QFile::WriteOnly);
-	QJsonDocument jdoc(t);
-	f.write(jdoc.toJson());
+	/* the rest of the cache is left for the chunks composed while scrolling */
+	request.maxChunks = tileMapItem->cacheableChunks() / 2;
+	mapLoader.load(request);
+	ui->statusBar->showMessage(tr("loading %1...").arg(fileName));
 }
 
-bool MapEditor::loadMap(const QString &fileName)
+void MapEditor::updateMapTransform(void)
 {
-	QFile f(fileName);
-	if (!f.open(QFile::ReadOnly))
-		return false;
+	qreal scale = qreal(ui->spinBoxGlobalZoom->value()) / ui->spinBoxMapZoomOut->value();
+	auto x = QTransform();
+	ui->graphicsViewTileMap->setTransform(x.scale(scale, scale).rotate(- ui->spinBoxRotateMap->value()));
+}
 
-	QJsonDocument jdoc = QJsonDocument::fromJson(f.readAll());
-	if (jdoc.isNull())
-		return false;
-	else
-	{
-		QLinearGradient gradient(QPointF(0, 0), QPointF(tileSet.tileWidth(), tileSet.tileHeight()));
-		gradient.setColorAt(0, Qt::black);
-		gradient.setColorAt(1, Qt::white);
-
-		tileMapGraphicsScene.clear();
-		auto obj = jdoc.object();
-		int columns = obj["map-size-x"].toInt(-1), rows = obj["map-size-y"].toInt(-1), x, y;
-		QJsonArray map_layers = obj["layers"].toArray();
-		for (int layer = 0; layer < MAP_LAYERS; layer ++)
-		{
-			tileMap[layer].clear();
-			auto map_layer = map_layers.at(layer).toArray();
-			for (y = 0; y < rows; y ++)
-			{
-				tileMap[layer] << QVector<Tile *>();
-				for (x = 0; x < columns; x ++)
-				{
-					int tx = map_layer.at(y * columns + x).toObject()["tile-set-x"].toInt(-1), ty = map_layer.at(y * columns + x).toObject()["tile-set-y"].toInt(-1);
-					QPixmap px(tileSet.tileRect().size());
-					QPainter p(&px);
-					p.setPen(Qt::magenta);
-					p.drawLine(0, 0, 28, 24);
-
-					if ((tx == -1 || ty == -1) && layer)
-					{
-						p.end();
-						px = QPixmap();
-					}
-					else
-						p.fillRect(px.rect(), QBrush(gradient));
-					if (tx != -1 && ty != -1)
-						p.drawPixmap(0, 0, tileSet.getTilePixmap(tx, ty));
-					Tile * t = new Tile(px);
-
-					t->setXY(x, y);
-					t->setPos(x * tileSet.tileWidth(), y * tileSet.tileHeight());
-					t->setZValue(layer);
-					if (tx != -1 && ty != -1)
-						t->setTileInfoPointer(& tileInfo[ty][tx]);
-					tileMapGraphicsScene.addItem(t);
-					connect(t, SIGNAL(tileSelected(Tile*)), this, SLOT(mapTileSelected(Tile*)));
-					connect(t, & Tile::tileControlSelected, [=] (Tile * tile) { for (auto i = 1; i < MAP_LAYERS; i ++) tileMap[i][tile->getY()][tile->getX()]->setPixmap(QPixmap()); });
-					tileMap[layer].last() << t;
-				}
-			}
-		}
-	}
-	return true;
+bool MapEditor::confirmMapEdit(const TileMap & map)
+{
+	return !history.dropsOlderCommands(map) || QMessageBox::question(0, tr("confirm map edit"),
+			tr("This edit changes so much of the map that the edits before it can no longer be undone. Do you want to go on?"),
+			QMessageBox::Yes, QMessageBox::Cancel) == QMessageBox::Yes;
 }
 
 void MapEditor::clearMap()
 {
-	/* create map layers */
-	auto rows = ui->spinBoxMapHeight->value(), columns = ui->spinBoxMapWidth->value();
-
-	QLinearGradient gradient(QPointF(0, 0), QPointF(tileSet.tileWidth(), tileSet.tileHeight()));
-	gradient.setColorAt(0, Qt::black);
-	gradient.setColorAt(1, Qt::white);
+	brushStrokeFinished();
+	TileMap map(ui->spinBoxMapWidth->value(), ui->spinBoxMapHeight->value());
+	if (!confirmMapEdit(map))
+		return;
+	history.setMap(map);
+	tileMapItem->mapChanged();
+}
 
-	tileMapGraphicsScene.clear();
+void MapEditor::on_pushButtonFillMap_clicked()
+{
+	brushStrokeFinished();
+	TileMap map(ui->spinBoxMapWidth->value(), ui->spinBoxMapHeight->value());
+	if (tileInfo.contains(lastTileSelected.x(), lastTileSelected.y()))
+		map.fillLayer(0, TileMap::tileIndex(lastTileSelected.x(), lastTileSelected.y()));
+	if (!confirmMapEdit(map))
+		return;
+	history.setMap(map);
+	tileMapItem->mapChanged();
+}
 
-	for (int layer = 0; layer < MAP_LAYERS; layer ++)
-	{
-		tileMap[layer].clear();
-		for (auto y = 0; y < rows; y++)
+void MapEditor::on_pushButtonMergeDuplicateTiles_clicked()
+{
+	brushStrokeFinished();
+	auto & index = tileSet.uniqueTiles();
+	/* identical tiles are only merged if they also have the same terrain and layer, otherwise the map would
+	 * change where it collides, and how it is autotiled; the copies that differ are merged among themselves */
+	QHash<QPair<int, QPair<qint32, int>>, TileIndex> firstCopies;
+	QHash<TileIndex, TileIndex> remap;
+	int conflicts = 0;
+	for (int y = 0; y < index.rows; y ++)
+		for (int x = 0; x < index.columns; x ++)
 		{
-			QVector<Tile *> v;
-			for (auto x = 0; x < columns; x++)
+			auto key = qMakePair(index.uniqueTileId(x, y), qMakePair(tileInfo.terrain(x, y), tileInfo.layer(x, y)));
+			auto first = firstCopies.value(key, TileMap::NO_TILE);
+			if (first != TileMap::NO_TILE)
+				remap.insert(TileMap::tileIndex(x, y), first);
+			else
 			{
-				QPixmap px;
-				if (!layer)
-				{
-					px = QPixmap(tileSet.tileRect().size());
-					QPainter p(&px);
-					p.fillRect(px.rect(), QBrush(gradient));
-				}
-				Tile * t = new Tile(px);
-
-				t->setXY(x, y);
-				t->setPos(x * tileSet.tileWidth(), y * tileSet.tileHeight());
-				tileMapGraphicsScene.addItem(t);
-				connect(t, SIGNAL(tileSelected(Tile*)), this, SLOT(mapTileSelected(Tile*)));
-				connect(t, & Tile::tileControlSelected, [=] (Tile * tile) { for (auto i = 1; i < MAP_LAYERS; i ++) tileMap[i][tile->getY()][tile->getX()]->setPixmap(QPixmap()); });
-				v << t;
+				firstCopies.insert(key, TileMap::tileIndex(x, y));
+				if (index.canonicalTile(x, y) != TileMap::tileIndex(x, y))
+					conflicts ++;
 			}
-			tileMap[layer] << v;
 		}
-	}
+	auto map = tileMap;
+	map.remapTiles(remap);
+	if (!confirmMapEdit(map))
+		return;
+	history.setMap(map);
+	tileMapItem->mapChanged();
+	ui->statusBar->showMessage(tr("%1 unique tiles out of %2, map tiles now refer only to the first copy of each; "
+			"%3 copies were kept, as their terrain or layer differs from an earlier copy")
+		.arg(index.uniqueTiles.size()).arg(index.tileIds.size()).arg(conflicts));
 }
 
-void MapEditor::on_pushButtonFillMap_clicked()
+void MapEditor::applyHistoryChanges(const EditHistory::Changes & changes)
 {
-	clearMap();
-	if (last_tile_selected)
+	if (changes.mapReplaced)
+		tileMapItem->mapChanged();
+	else if (!changes.cells.isEmpty())
+		tileMapItem->cellsChanged(changes.cells);
+	for (const auto & t : changes.terrains)
+		terrainIndex.setTerrain(t.first.x(), t.first.y(), t.second, tileInfo.terrain(t.first.x(), t.first.y()));
+	if (!changes.terrains.isEmpty())
 	{
-		auto px = tileSet.getTilePixmap(last_tile_selected->getX(), last_tile_selected->getY());
-		for (auto row : tileMap[0])
-			for (auto tile : row)
-			{
-				tile->setTileInfoPointer(last_tile_selected);
-				tile->setPixmap(px);
-			}
+		autotilerDirty = true;
+		updateBrush();
 	}
 }
+
+void TileSet::buildMipChain(void)
+{
+	auto atlas = this->atlas();
+	int w = tile_width, h = tile_height, build = ++ mipChainBuild;
+	if (atlas.isNull() || w <= 0 || h <= 0)
+		return;
+	isBuildingMipChain = true;
+	pastedTiles.clear();
+	/* the watcher only reports on the last future it was given */
+	mipChainWatcher.disconnect(this);
+	connect(& mipChainWatcher, & QFutureWatcher<TileSetMipChain>::finished, this, [=] { installMipChain(build); });
+	/* the worker scales its own copy of the atlas, tiles pasted meanwhile are painted over the atlas of the tile set only */
+	mipChainWatcher.setFuture(QtConcurrent::run([=] { TileSetMipChain chain; chain.build(atlas, w, h); return chain; }));
+}
+
+void TileSet::installMipChain(int build)
+{
+	if (build != mipChainBuild || !isBuildingMipChain)
+		return;
+	isBuildingMipChain = false;
+	mipChainLevels = mipChainWatcher.result();
+	/* the watcher lets go of its copy of the chain, so that pasted tiles are scaled into the levels in place */
+	mipChainWatcher.setFuture(QFuture<TileSetMipChain>());
+	for (auto & tile : pastedTiles)
+		mipChainLevels.updateTile(atlas().copy(tileRect(tile.x(), tile.y())), tile.x(), tile.y());
+	pastedTiles.clear();
+	emit mipChainReady();
+}
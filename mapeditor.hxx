@@ -10,13 +10,36 @@
 #include <QJsonObject>
 #include <QCheckBox>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QCache>
 #include <QGraphicsScene>
 #include <QGraphicsItem>
 #include <QGraphicsSceneMouseEvent>
+#include <QFutureWatcher>
 #include <QDebug>
 
 #include <functional>
 
+#include "tilemap.hxx"
+#include "tileinfo.hxx"
+#include "projectsaver.hxx"
+#include "tilemapitem.hxx"
+#include "tileslicer.hxx"
+#include "terrainindex.hxx"
+#include "collision.hxx"
+#include "spritesheet.hxx"
+#include "edithistory.hxx"
+#include "autotiler.hxx"
+#include "maploader.hxx"
+#include "profiler.hxx"
+#include "profileroverlay.hxx"
+#include "tilepalette.hxx"
+#include "sheetimage.hxx"
+#include "brush.hxx"
+#include "mipchain.hxx"
+#include "minimap.hxx"
+
 class Util
 {
 public:
@@ -33,50 +56,6 @@ public:
 	}
 };
 
-enum
-{
-	MAP_LAYERS = 4,
-};
-
-class TileInfo
-{
-private:
-	static QStringList terrainTypeNames;
-	/* this is a bitmap with elements in the 'terrainTypeNames' list above */
-	qint32 terrainBitmap = 0;
-	QString _name = "unassigned";
-	int layer = 0;
-	int x = -1, y = -1;
-public:
-	static QStringList & terrainNames(void) { return terrainTypeNames; }
-	void read(const QJsonObject & json)
-	{
-		terrainBitmap = json["terrain"].toInt(-1) & ((1 << terrainTypeNames.size()) - 1);
-		_name = json["name"].toString("unassigned");
-		x = json["x"].toInt(-1);
-		y = json["y"].toInt(-1);
-		layer = json["layer"].toInt(0);
-	}
-	void write(QJsonObject & json) const
-	{
-		json["terrain"] = terrainBitmap;
-		json["name"] = _name;
-		json["x"] = x;
-		json["y"] = y;
-		json["layer"] = layer;
-	}
-	void setXY(int x, int y) { this->x = x, this->y = y; }
-	int getLayer(void) { return layer; }
-	void setLayer(int layer) { this->layer = layer; }
-	int getX(void) { return x; }
-	int getY(void) { return y; }
-	void setName(const QString & name) { _name = name; }
-	const QString & name(void) { return _name; }
-	void setTerrain(int terrain) { terrainBitmap = terrain; }
-	void removeTerrain(int index) { qint64 x = (1 << index) - 1; terrainBitmap = (terrainBitmap & x) | ((terrainBitmap >> 1) & ~ x); }
-	qint32 terrain(void) const { return terrainBitmap; }
-};
-
 class Player : public QGraphicsPixmapItem
 {
 private:
@@ -84,126 +63,131 @@ private:
 public:
 	Player(QGraphicsItem * parent = 0) : QGraphicsPixmapItem(parent)
 	{
-		setPixmap(QPixmap("stalker-ship.png"));
+		setPixmap(SpriteSheet::get("stalker-ship.png")->pixmap());
 		setTransformOriginPoint(boundingRect().center());
 	}
 	void setRotation(int angle) { rotation_angle = angle % 360; QGraphicsPixmapItem::setRotation(- rotation_angle); }
 	int getRotationAngle(void) { return rotation_angle; }
 };
 
-class Projectile : public QObject, public QGraphicsPixmapItem
+class Projectile : public QGraphicsPixmapItem
 {
-	Q_OBJECT
-	enum
-	{
-		MAX_PROJECTILE_RANGE	= 200,
-	};
-	QVector2D velocity;
-	QPointF launchPoint;
-	QTimer timer;
 public:
-	Projectile(QGraphicsItem * parent, QString pixmapFileName, const QVector2D & velocity, const QPointF & launchPoint) : QGraphicsPixmapItem(parent)
+	Projectile(QGraphicsItem * parent = 0) : QGraphicsPixmapItem(parent) {}
+	void launch(const QPixmap & pixmap, const QVector2D & velocity, const QPointF & launchPoint)
 	{
-		this->velocity = velocity;
-		setPixmap(QPixmap(pixmapFileName));
+		setPixmap(pixmap);
 		setTransformOriginPoint(.0, boundingRect().height() * .5);
-		setPos(this->launchPoint = launchPoint - QPointF(0, .5 * pixmap().height()));
 		setRotation(Util::degrees(Util::angleForVector(velocity)));
-		timer.setInterval(30);
-		connect(&timer, SIGNAL(timeout()), this, SLOT(timeout()));
-	}
-	void start(void) { timer.start(); }
-private slots:
-	void timeout(void)
-	{
-		setPos(pos() + velocity.toPointF());
-		if (QVector2D(launchPoint - pos()).length() > MAX_PROJECTILE_RANGE)
-		{
-			setPixmap(QPixmap());
-			timer.stop();
-			emit projectileDeactivated(this);
-		}
+		setPos(launchPoint);
 	}
-signals:
-	void projectileDeactivated(Projectile * p);
 };
 
-class Animation : public QObject, public QGraphicsPixmapItem
+/* a sprite sheet animation - the game scene advances the frames; a frame is drawn straight from the shared sheet */
+class Animation : public QGraphicsItem
 {
-	Q_OBJECT
-	QPixmap pixmap;
-	QTimer timer;
-	int frameWidth, frameIndex = 0;
-	bool loop, playForwardAndBackward, isPlayingForward = true;
+	friend class GameScene;
+	const SpriteSheet * sheet = 0;
+	int frame = 0, framePeriod = 0;
+	bool loop = false, playForwardAndBackward = false;
+	/* the position of this animation in the game scene update arrays, -1 when it is not running */
+	int slot = -1;
 public:
 	enum { Type = UserType + __COUNTER__ + 1, };
 	int type(void) const {return Type;}
-	Animation(QGraphicsItem * parent, QString pixmapFileName, int frameWidth, int framePeriod, bool loop = false, bool playForwardAndBackward = false) : QGraphicsPixmapItem(QPixmap(), parent)
+	Animation(QGraphicsItem * parent = 0) : QGraphicsItem(parent) {}
+	Animation(QGraphicsItem * parent, QString pixmapFileName, int frameWidth, int framePeriod, bool loop = false, bool playForwardAndBackward = false) : QGraphicsItem(parent)
+	{ setSheet(SpriteSheet::get(pixmapFileName, frameWidth), framePeriod, loop, playForwardAndBackward); }
+	void setSheet(const SpriteSheet * sheet, int framePeriod, bool loop = false, bool playForwardAndBackward = false)
 	{
-		pixmap = QPixmap(pixmapFileName);
+		if (sheet != this->sheet)
+			prepareGeometryChange();
+		this->sheet = sheet;
+		this->framePeriod = framePeriod;
 		this->loop = loop;
 		this->playForwardAndBackward = playForwardAndBackward;
-		this->frameWidth = frameWidth;
+		showFrame(0);
 		setTransformOriginPoint(boundingRect().center());
-		connect(& timer, SIGNAL(timeout()), this, SLOT(timerElapsed()));
-		setPixmap(pixmap.copy(0, 0, frameWidth, pixmap.height()));
-		timer.setInterval(framePeriod);
 	}
-	void start(void)
+	int frameCount(void) const { return sheet ? sheet->frameCount() : 0; }
+	void showFrame(int index) { if (index != frame) frame = index, update(); }
+	QRectF boundingRect(void) const override { return sheet ? QRectF(QPointF(), sheet->frameSize()) : QRectF(); }
+	void paint(QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * widget) override
 	{
-		if (pixmap.isNull())
-		{
-			emit animationFinished(this);
-			return;
-		}
-		timer.start();
+		Q_UNUSED(option) Q_UNUSED(widget)
+		if (frame < frameCount())
+			painter->drawPixmap(QPointF(), sheet->pixmap(), sheet->frame(frame));
 	}
-private slots:
-	void timerElapsed(void)
-	{
-		frameIndex += isPlayingForward ? 1 : -1;
-		QRect r((frameIndex) * frameWidth, 0, frameWidth, pixmap.height());
-		if (r.left() >= pixmap.width() || r.left() < 0)
-		{
-			if (loop)
-			{
-				if (!playForwardAndBackward)
-					frameIndex = 0;
-				else
-				{
-					if (isPlayingForward)
-						frameIndex = pixmap.width() / frameWidth - 1;
-					else
-						frameIndex = 1;
-					isPlayingForward = ! isPlayingForward;
-				}
-			}
-			else
-			{
-				timer.stop();
-				emit animationFinished(this);
-			}
-			return;
-		}
-		setPixmap(pixmap.copy(r));
-	}
-
-signals:
-	void animationFinished(Animation * a);
 };
 
+/* the game runs a fixed timestep simulation - the frame timer only accumulates the elapsed time, and runs as
+ * many simulation steps as fit in it; moving items are then drawn interpolated between the last two steps.
+ * Projectiles and animations are not objects with timers of their own, their state is kept in arrays that
+ * are updated in one pass per step, and their items are recycled through pools once they expire.
+ * Collisions never go through the scene item index - the map is checked by looking up the cells under
+ * an entity, and the other entities are found through a spatial hash: animations are added to it when
+ * they start, and removed when they finish, projectiles are moved in it every step. The player picks up
+ * the animations it touches, and a projectile ends the first animation it hits, and is used up */
 class GameScene : public QGraphicsScene
 {
 	Q_OBJECT
 private:
 	enum
 	{
-		TIMER_POLL_INTERVAL_MS		=	100,
+		SIMULATION_STEP_MS		=	10,
+		FRAME_INTERVAL_MS		=	16,
+		/* after a stall, the time that would take more steps than this to catch up with is dropped */
+		MAX_STEPS_PER_FRAME		=	25,
+		/* player controls are sampled at this period */
+		CONTROL_STEP_MS			=	100,
+		/* projectile velocities are in units per this period */
+		PROJECTILE_VELOCITY_PERIOD_MS	=	30,
+		MAX_PROJECTILE_RANGE		=	200,
 		MAX_ROTATION_SPEED_DEGREES	=	20,
 	};
+	struct ProjectileState
+	{
+		Projectile * item;
+		QPointF position, previousPosition, launchPoint;
+		/* in units per simulation step */
+		QPointF velocity;
+		/* the box the projectile is in the spatial hash with */
+		QRectF box;
+		qint64 launchStep;
+	};
+	struct AnimationState
+	{
+		Animation * item;
+		/* animations do not move, this is the box they are in the spatial hash with */
+		QRectF box;
+		/* projectiles only hit the animations that were running when they were launched */
+		qint64 startStep;
+		int framePeriod, elapsed, frameIndex, frameCount;
+		bool loop, playForwardAndBackward, isPlayingForward;
+	};
+	QVector<ProjectileState> projectiles;
+	QVector<AnimationState> animations;
+	QVector<Projectile *> projectilePool;
+	QVector<Animation *> animationPool;
+	QPixmap projectilePixmap;
+	const SpriteSheet * explosionSheet;
+	const CollisionMap * collisionMap = 0;
+	/* tiles with any of these terrain bits block the player and projectiles */
+	qint32 solidTerrain = 0;
+	/* animations are in this with their slots as ids, and projectiles with the complement of theirs */
+	SpatialHash entityHash;
+	static int projectileId(int slot) { return ~ slot; }
+	qint64 stepCount = 0;
+
 	Player * player = 0;
+	QPointF playerPosition, previousPlayerPosition, renderedPlayerPosition, previousRenderedPlayerPosition;
 	int rotationSpeed = 0;
-	QTimer timer;
+	QTimer frameTimer;
+	QElapsedTimer clock;
+	qint64 lastFrameTime = 0;
+	/* the profiler time at which the views started drawing the scene */
+	qint64 renderStart = 0;
+	int accumulatedTime = 0, controlTime = 0;
 	double speed = 0;
 	const double MAX_SPEED_UNITS = 5.;
 	const double acceleration = .2;
@@ -234,7 +218,153 @@ private:
 		};
 	}
 	keypresses;
+	void launchProjectile(const QVector2D & velocity, const QPointF & launchPoint)
+	{
+		auto p = projectilePool.isEmpty() ? new Projectile() : projectilePool.takeLast();
+		p->launch(projectilePixmap, velocity, launchPoint - QPointF(0, .5 * projectilePixmap.height()));
+		addItem(p);
+		ProjectileState state;
+		state.item = p;
+		state.position = state.previousPosition = state.launchPoint = p->pos();
+		state.velocity = velocity.toPointF() * (double(SIMULATION_STEP_MS) / PROJECTILE_VELOCITY_PERIOD_MS);
+		state.box = QRectF(state.position, p->boundingRect().size());
+		state.launchStep = stepCount;
+		entityHash.insert(projectileId(projectiles.size()), state.box);
+		projectiles << state;
+	}
+	void removeProjectile(int i)
+	{
+		/* the last projectile takes the slot of the removed one */
+		entityHash.remove(projectileId(i), projectiles.at(i).box);
+		if (i != projectiles.size() - 1)
+		{
+			entityHash.remove(projectileId(projectiles.size() - 1), projectiles.last().box);
+			entityHash.insert(projectileId(i), projectiles.last().box);
+		}
+		removeItem(projectiles.at(i).item);
+		projectilePool << projectiles.at(i).item;
+		projectiles[i] = projectiles.last();
+		projectiles.removeLast();
+	}
+	void finishAnimation(int i)
+	{
+		auto a = animations.at(i).item;
+		/* the last animation takes the slot of the finished one */
+		entityHash.remove(i, animations.at(i).box);
+		if (i != animations.size() - 1)
+		{
+			entityHash.remove(animations.size() - 1, animations.last().box);
+			entityHash.insert(i, animations.last().box);
+		}
+		animations[i] = animations.last();
+		animations[i].item->slot = i;
+		animations.removeLast();
+		removeItem(a);
+		a->slot = -1;
+		animationPool << a;
+	}
+	void updateProjectiles(void)
+	{
+		for (int i = 0; i < projectiles.size();)
+		{
+			auto & p = projectiles[i];
+			p.previousPosition = p.position;
+			p.position += p.velocity;
+			auto d = p.position - p.launchPoint;
+			auto box = QRectF(p.position, p.box.size());
+			if (d.x() * d.x() + d.y() * d.y() > MAX_PROJECTILE_RANGE * MAX_PROJECTILE_RANGE
+					|| isSolid(box) || hitAnimation(p, box))
+				removeProjectile(i);
+			else
+			{
+				entityHash.remove(projectileId(i), p.box);
+				entityHash.insert(projectileId(i), p.box = box);
+				i ++;
+			}
+		}
+	}
+	/* ends the first animation under the box of a projectile */
+	bool hitAnimation(const ProjectileState & p, const QRectF & box)
+	{
+		for (auto i : entityHash.query(box))
+			if (i >= 0 && animations.at(i).startStep < p.launchStep && animations.at(i).box.intersects(box))
+			{
+				finishAnimation(i);
+				return true;
+			}
+		return false;
+	}
+	void updateAnimations(void)
+	{
+		for (int i = 0; i < animations.size(); i ++)
+		{
+			auto & a = animations[i];
+			if ((a.elapsed += SIMULATION_STEP_MS) < a.framePeriod)
+				continue;
+			a.elapsed -= a.framePeriod;
+			a.frameIndex += a.isPlayingForward ? 1 : -1;
+			if (a.frameIndex < a.frameCount && a.frameIndex >= 0)
+				a.item->showFrame(a.frameIndex);
+			else if (!a.loop)
+				finishAnimation(i --);
+			else if (!a.playForwardAndBackward)
+				a.frameIndex = 0;
+			else
+			{
+				a.frameIndex = a.isPlayingForward ? a.frameCount - 1 : 1;
+				a.isPlayingForward = ! a.isPlayingForward;
+			}
+		}
+	}
+	bool isSolid(const QRectF & box) const { return collisionMap && collisionMap->collides(box, solidTerrain); }
+	/* the player bounding box, moved to the simulated player position */
+	QRectF playerBox(void) const { return player->sceneBoundingRect().translated(playerPosition - player->pos()); }
+	/* the player picks up (ends) the animations it touches */
+	void collectAnimations(void)
+	{
+		Profiler::Scope scope("collect-animations");
+		auto box = playerBox();
+		QVector<Animation *> touched;
+		for (auto i : entityHash.query(box))
+			if (i >= 0 && animations.at(i).box.intersects(box))
+				touched << animations.at(i).item;
+		/* finishing an animation moves others in the array, so they are looked up through their slots */
+		for (auto a : touched)
+			finishAnimation(a->slot);
+	}
+	void step(void)
+	{
+		Profiler::Scope scope("simulation-step");
+		stepCount ++;
+		if (player)
+		{
+			if ((controlTime += SIMULATION_STEP_MS) >= CONTROL_STEP_MS)
+				controlTime -= CONTROL_STEP_MS, pollKeyboard();
+			previousPlayerPosition = playerPosition;
+			playerPosition += speed * (double(SIMULATION_STEP_MS) / CONTROL_STEP_MS) * playerForwardVector().toPointF();
+			if (isSolid(playerBox()))
+				playerPosition = previousPlayerPosition, speed = 0;
+		}
+		updateProjectiles();
+		updateAnimations();
+		if (player)
+			collectAnimations();
+	}
+	/* 'alpha' is the fraction of a simulation step that has elapsed since the last one */
+	void interpolate(double alpha)
+	{
+		for (const auto & p : projectiles)
+			p.item->setPos(p.previousPosition + (p.position - p.previousPosition) * alpha);
+		if (!player)
+			return;
+		player->setPos(renderedPlayerPosition = previousPlayerPosition + (playerPosition - previousPlayerPosition) * alpha);
+	}
 protected:
+	/* these are called first and last when the scene is drawn, so the time between them is the frame time */
+	void drawBackground(QPainter * painter, const QRectF & rect) override
+	{ renderStart = Profiler::now(); QGraphicsScene::drawBackground(painter, rect); }
+	void drawForeground(QPainter * painter, const QRectF & rect) override
+	{ QGraphicsScene::drawForeground(painter, rect); Profiler::record("render-frame", renderStart, Profiler::now() - renderStart); }
 	void keyReleaseEvent(QKeyEvent *keyEvent) override
 	{
 		if (keyEvent->isAutoRepeat() || !player)
@@ -263,26 +393,40 @@ protected:
 		case Qt::Key_Right: keypresses.isRightPressed = 1; break;
 		case Qt::Key_Up: keypresses.isForwardPressed = 1; break;
 		case Qt::Key_Down: keypresses.isBackwardPressed = 1; break;
-		case Qt::Key_Space: {auto a = new Animation(0, "explosion-1.png", 24, 30, false);
-			connect(a, & Animation::animationFinished, [=](Animation * a){ removeItem(a); delete a; });
+		case Qt::Key_Space: {auto a = animationPool.isEmpty() ? new Animation() : animationPool.takeLast();
+			a->setSheet(explosionSheet, 30, false);
 			a->setPos(pos + 2 * 28 * playerForwardVector().toPointF());
-			addItem(a);
-			a->start();
-			Projectile * p = new Projectile(0, "projectile.png", playerForwardVector() * 2,
+			startAnimation(a);
+			launchProjectile(playerForwardVector() * 2,
 				player->pos()
 					+ player->boundingRect().center()
 					+ .5 * playerForwardVector().toPointF() * player->boundingRect().height());
-			connect(p, & Projectile::projectileDeactivated, [=](Projectile * a){ removeItem(a); delete a; });
-			addItem(p);
-			p->start();
 		}
 		default: QGraphicsScene::keyPressEvent(keyEvent); return;
 		}
 		player->setPos(pos);
 	}
 private slots:
+	void advanceFrame(void)
+	{
+		auto now = clock.elapsed();
+		accumulatedTime = std::min(accumulatedTime + int(now - lastFrameTime), int(MAX_STEPS_PER_FRAME * SIMULATION_STEP_MS));
+		lastFrameTime = now;
+		/* the player has been moved from outside of the simulation */
+		if (player && player->pos() != renderedPlayerPosition)
+			playerPosition = previousPlayerPosition = player->pos();
+		for (; accumulatedTime >= SIMULATION_STEP_MS; accumulatedTime -= SIMULATION_STEP_MS)
+			step();
+		interpolate(double(accumulatedTime) / SIMULATION_STEP_MS);
+		if (player && player->pos() != previousRenderedPlayerPosition)
+			emit playerObjectPositionChanged();
+		if (player)
+			previousRenderedPlayerPosition = player->pos();
+	}
+private:
 	void pollKeyboard(void)
 	{
+		Profiler::Scope scope("poll-keyboard");
 		if (keypresses.isLeftPressed)
 			rotationSpeed += (rotationSpeed < 0) ? +3 : +1;
 		if (keypresses.isRightPressed)
@@ -300,15 +444,6 @@ private slots:
 		else if (!keypresses.movementKeys && fabs(speed) < acceleration)
 			speed = .0;
 		speed = Util::bound(- MAX_SPEED_UNITS, speed, MAX_SPEED_UNITS);
-		auto oldPosition = player->pos();
-		player->setPos(player->pos() + speed * playerForwardVector().toPointF());
-		if (oldPosition != player->pos())
-			emit playerObjectPositionChanged();
-		for (auto item : player->collidingItems())
-		{
-			if (auto p = qgraphicsitem_cast<Animation *>(item))
-				emit p->animationFinished(p);
-		}
 	}
 signals:
 	void playerObjectPositionChanged(void);
@@ -316,47 +451,54 @@ public:
 	GameScene(QObject * parent = 0) : QGraphicsScene(parent)
 	{
 		memset(& keypresses, 0, sizeof keypresses);
-		timer.setInterval(TIMER_POLL_INTERVAL_MS);
-		connect(& timer, SIGNAL(timeout()), this, SLOT(pollKeyboard()));
+		projectilePixmap = SpriteSheet::get("projectile.png")->pixmap();
+		explosionSheet = SpriteSheet::get("explosion-1.png", 24);
+		frameTimer.setTimerType(Qt::PreciseTimer);
+		frameTimer.setInterval(FRAME_INTERVAL_MS);
+		connect(& frameTimer, SIGNAL(timeout()), this, SLOT(advanceFrame()));
+		clock.start();
+		frameTimer.start();
+	}
+	~GameScene()
+	{
+		/* the items that are in the scene are deleted by the scene itself */
+		qDeleteAll(projectilePool);
+		qDeleteAll(animationPool);
 	}
 
-	void setPlayer(Player * player) { this->player = player; timer.start(); }
-};
-
-Q_DECLARE_METATYPE(TileInfo *)
-
-class Tile : public QObject, public QGraphicsPixmapItem
-{
-	Q_OBJECT
-	int x = -1, y = -1;
-	TileInfo * tileInfo = 0;
-	bool isCollisionEnabled = true;
-public:
-	enum { Type = UserType + __COUNTER__ + 1, };
-	int type(void) const {return Type;}
-	Tile(const QPixmap &pixmap, QGraphicsItem *parent = Q_NULLPTR) : QGraphicsPixmapItem(pixmap, parent) { setFlag(QGraphicsItem::ItemIsSelectable); }
-	Tile(QGraphicsItem *parent = Q_NULLPTR) : QObject(0), QGraphicsPixmapItem(parent) { setFlag(QGraphicsItem::ItemIsSelectable); }
-	Tile(const Tile & tile) : QObject(0), QGraphicsPixmapItem(0)
-	{
-		setPixmap(tile.pixmap());
-		setTileInfoPointer(tile.getTileInfo());
-		setFlag(QGraphicsItem::ItemIsSelectable);
-	}
-	TileInfo * getTileInfo(void) const { return tileInfo; }
-	void setTileInfoPointer(TileInfo * tileInfo) { this->tileInfo = tileInfo; }
-	void setXY(int x, int y) { this->x = x, this->y = y; }
-	int getX(void) { return x; }
-	int getY(void) { return y; }
-	void setCollisionEnabled(bool f) { isCollisionEnabled = f; }
-	QPainterPath shape(void) const override { QPainterPath p; if (isCollisionEnabled) p = QGraphicsPixmapItem::shape(); return p; }
-signals:
-	void tileSelected(Tile * tile);
-	void tileShiftSelected(Tile * tile);
-	void tileControlSelected(Tile * tile);
-protected:
-	void mousePressEvent(QGraphicsSceneMouseEvent * event)
-	{ if (event->modifiers() & Qt::ShiftModifier) emit tileShiftSelected(this); else if (event->modifiers() & Qt::ControlModifier) emit tileControlSelected(this);
-		else emit tileSelected(this); event->ignore(); }
+	void setPlayer(Player * player) { this->player = player; }
+	int projectileCount(void) const { return projectiles.size(); }
+	int animationCount(void) const { return animations.size(); }
+	void setCollisionMap(const CollisionMap * collisionMap) { this->collisionMap = collisionMap; }
+	void setSolidTerrain(qint32 terrainMask) { solidTerrain = terrainMask; }
+	/* adds an animation to the scene, and runs it - when a non-looping animation ends, it is removed from the scene, and reused */
+	void startAnimation(Animation * a)
+	{
+		if (a->slot != -1)
+			return;
+		if (!a->frameCount())
+		{
+			if (a->scene())
+				removeItem(a);
+			animationPool << a;
+			return;
+		}
+		if (a->scene() != this)
+			addItem(a);
+		AnimationState state;
+		state.item = a;
+		state.box = a->sceneBoundingRect();
+		state.startStep = stepCount;
+		state.framePeriod = std::max(a->framePeriod, 1);
+		state.elapsed = state.frameIndex = 0;
+		state.frameCount = a->frameCount();
+		state.loop = a->loop;
+		state.playForwardAndBackward = a->playForwardAndBackward;
+		state.isPlayingForward = true;
+		a->slot = animations.size();
+		entityHash.insert(a->slot, state.box);
+		animations << state;
+	}
 };
 
 enum
@@ -369,63 +511,138 @@ class TileSheet : public QWidget
 {
 	Q_OBJECT
 protected:
-	QImage image;
+	SheetImage sheet;
 	int tile_width = MINIMUM_TILE_SIZE, tile_height = MINIMUM_TILE_SIZE;
 	int zoom_factor = 1;
 	QRect tileRect(int x, int y) { return QRect(x * tile_width, y * tile_height, tile_width, tile_height); }
+	/* called whenever the image, or the way it is split in tiles, changes */
+	virtual void tileGeometryChanged(void) {}
+	/* called whenever the image, or the zoom factor, changes */
+	void sheetChanged(void)
+	{
+		scaledBlocks.clear();
+		auto size = sheet.size() * zoom_factor;
+		setMinimumSize(size);
+		resize(size);
+		update();
+	}
+	/* called when only a rectangle of the image changed, in image pixels */
+	void sheetRectChanged(const QRect & rect)
+	{
+		for (int y = rect.top() >> SheetImage::BLOCK_SIZE_LOG2; y <= rect.bottom() >> SheetImage::BLOCK_SIZE_LOG2; y ++)
+			for (int x = rect.left() >> SheetImage::BLOCK_SIZE_LOG2; x <= rect.right() >> SheetImage::BLOCK_SIZE_LOG2; x ++)
+				scaledBlocks.remove((y << 16) | x);
+		update(QRect(rect.topLeft() * zoom_factor, rect.size() * zoom_factor));
+	}
 private:
+	enum
+	{
+		/* in kilobytes */
+		SCALED_BLOCK_CACHE_SIZE	=	96 << 10,
+	};
 	bool isBottomUpGrid = true;
 	int horizontalOffset = 0;
+	/* the most recently drawn sheet blocks, at the current zoom factor - unscaled blocks are drawn straight from the sheet */
+	QCache<quint32, QPixmap> scaledBlocks { SCALED_BLOCK_CACHE_SIZE };
+	QPixmap scaledBlock(int blockX, int blockY)
+	{
+		quint32 key = (blockY << 16) | blockX;
+		if (auto block = scaledBlocks.object(key))
+			return * block;
+		auto image = sheet.block(blockX, blockY);
+		auto block = QPixmap::fromImage(image.scaled(image.size() * zoom_factor));
+		scaledBlocks.insert(key, new QPixmap(block), std::max(1, block.width() * block.height() * 4 / 1024));
+		return block;
+	}
 protected:
 	virtual void paintEvent(QPaintEvent * event)
 	{
-		int i, w, h;
-		if (image.isNull())
+		int i, w, h, tw, th, first, last, blockSize;
+		if (sheet.isNull())
+			return;
+		w = sheet.width() * zoom_factor;
+		h = sheet.height() * zoom_factor;
+		auto r = event->rect() & QRect(0, 0, w, h);
+		if (r.isEmpty())
 			return;
-		w = image.width() * zoom_factor;
-		h = image.height() * zoom_factor;
-		/*! \todo	kludge... redo this, maybe */
-		if (w != width() || h != height())
-		{
-			resize(w, h);
-			setMinimumSize(w, h);
-		}
 		QPainter p(this);
-		auto r = event->rect(), zr = QRect(r.x() / zoom_factor, r.y() / zoom_factor, r.width() / zoom_factor, r.height() / zoom_factor);
-		p.drawImage(r, image, zr);
+		blockSize = SheetImage::BLOCK_SIZE * zoom_factor;
+		for (int y = r.top() / blockSize; y <= r.bottom() / blockSize; y ++)
+			for (int x = r.left() / blockSize; x <= r.right() / blockSize; x ++)
+				if (zoom_factor == 1)
+					sheet.drawBlock(p, QPoint(x * blockSize, y * blockSize), x, y);
+				else
+					p.drawPixmap(x * blockSize, y * blockSize, scaledBlock(x, y));
+		/* only the grid lines crossing the exposed rectangle are drawn */
+		auto firstLine = [] (int first, int step, int from) -> int { return from <= first ? first : first + (from - first + step - 1) / step * step; };
+		tw = tile_width * zoom_factor;
+		th = tile_height * zoom_factor;
 		p.setPen(Qt::green);
-		for (i = horizontalOffset * zoom_factor; i < w; p.drawLine(i, 0, i, h), i += tile_width * zoom_factor);
-		if (isBottomUpGrid)
-			for (i = (image.height() - tile_height) * zoom_factor; i >= 0; p.drawLine(0, i, w, i), i -= tile_height * zoom_factor);
-		else
-			for (i = tile_height * zoom_factor; i < image.height() * zoom_factor; p.drawLine(0, i, w, i), i += tile_height * zoom_factor);
+		for (i = firstLine(horizontalOffset * zoom_factor, tw, r.left()); i <= r.right(); p.drawLine(i, r.top(), i, r.bottom()), i += tw);
+		first = isBottomUpGrid ? sheet.height() % tile_height * zoom_factor : th;
+		last = std::min(isBottomUpGrid ? (sheet.height() - tile_height) * zoom_factor : h - 1, r.bottom());
+		for (i = firstLine(first, th, r.top()); i <= last; p.drawLine(r.left(), i, r.right(), i), i += th);
 	}
 	void setGridVerticalOrientation(bool isBottomUp) { isBottomUpGrid = isBottomUp; update(); }
 	virtual void mousePressEvent(QMouseEvent *event)
 	{
 		int x, y;
-		if (image.isNull())
+		if (sheet.isNull())
 			return;
-		if ((x = event->x()) <= image.width() * zoom_factor && (y = event->y()) < image.height() * zoom_factor)
-			QApplication::clipboard()->setImage(image.copy((x / (tile_width * zoom_factor)) * tile_width + horizontalOffset, (y / (tile_height * zoom_factor)) * tile_height, tile_width, tile_height));
+		if ((x = event->x()) <= sheet.width() * zoom_factor && (y = event->y()) < sheet.height() * zoom_factor)
+			QApplication::clipboard()->setImage(sheet.copy(QRect((x / (tile_width * zoom_factor)) * tile_width + horizontalOffset, (y / (tile_height * zoom_factor)) * tile_height, tile_width, tile_height)));
 	}
 public:
 	TileSheet(void) { setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding); }
 	QRect tileRect(void) { return QRect(0, 0, tile_width, tile_height); }
-	void setImage(const QImage & image) { this->image = image; update(); }
+	void setImage(const QImage & image) { sheet.setImage(image); tileGeometryChanged(); sheetChanged(); }
+	/* large images are decoded in blocks, as they are drawn, if the image format allows it */
+	bool open(const QString & fileName)
+	{
+		if (!sheet.open(fileName))
+			return false;
+		tileGeometryChanged();
+		sheetChanged();
+		return true;
+	}
 	int tileWidth(void) { return tile_width; }
 	int tileHeight(void) { return tile_height; }
 public slots:
-	void setTileWidth(int width) { tile_width = width; update(); }
-	void setTileHeight(int height) { tile_height = height; update(); }
-	void setZoomFactor(int zoom_factor) { this->zoom_factor = zoom_factor; update(); }
-	void setHorizontalOffset(int offset) { horizontalOffset = offset; update(); }
+	void setTileWidth(int width) { tile_width = width; tileGeometryChanged(); update(); }
+	void setTileHeight(int height) { tile_height = height; tileGeometryChanged(); update(); }
+	void setZoomFactor(int zoom_factor) { this->zoom_factor = zoom_factor; sheetChanged(); }
+	void setHorizontalOffset(int offset) { horizontalOffset = offset; tileGeometryChanged(); update(); }
 };
 
 class TileSet : public TileSheet
 {
 	Q_OBJECT
+	/* tile pixmaps are converted from the image once, and then shared by everyone that draws the same tile */
+	QHash<TileIndex, QPixmap> tileCache;
+	QImage atlasImage;
+	/* the mip chain is built on a worker, every build gets a number, and only the last one is kept */
+	TileSetMipChain mipChainLevels;
+	QFutureWatcher<TileSetMipChain> mipChainWatcher;
+	int mipChainBuild = 0;
+	bool isBuildingMipChain = false;
+	/* tiles pasted while the mip chain is built, they are scaled again once it is ready */
+	QVector<QPoint> pastedTiles;
+	void buildMipChain(void);
+	void installMipChain(int build);
+	TileSlicer::Index uniqueTileIndex;
+	/* the tile set is drawn on the map, so unlike a sheet, it is always kept whole in memory */
+	QImage image;
 protected:
+	void tileGeometryChanged(void) override
+	{
+		tileCache.clear();
+		atlasImage = QImage();
+		mipChainLevels = TileSetMipChain();
+		/* a build that is still running is for the old tiles */
+		mipChainBuild ++;
+		isBuildingMipChain = false;
+		uniqueTileIndex = TileSlicer::Index();
+	}
 	virtual void mousePressEvent(QMouseEvent *event) override
 	{
 		int x = event->x(), y = event->y(), tx = (x / (tile_width * zoom_factor)), ty = (y / (tile_height * zoom_factor));
@@ -442,9 +659,8 @@ protected:
 			{
 				if ((x = event->x()) <= image.width() * zoom_factor && (y = event->y()) < image.height() * zoom_factor)
 				{
-					QPainter p(& image);
-					p.drawImage(tx * tile_width, ty * tile_height, clipboardImage);
-					update();
+					pasteTile(tx, ty, clipboardImage);
+					emit tileChanged(tx, ty);
 				}
 			}
 		}
@@ -452,21 +668,80 @@ protected:
 signals:
 	void tileSelected(int x, int y);
 	void tileShiftSelected(int x, int y);
+	void tileChanged(int x, int y);
+	/* the mip chain asked for by 'mipChain()' was built */
+	void mipChainReady(void);
 public:
 	int tileCountX(void) { return image.width() / tile_width; }
 	int tileCountY(void) { return image.height() / tile_height; }
 	TileSet(void) { setGridVerticalOrientation(false); setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding); }
+	void setImage(const QImage & image) { this->image = image; TileSheet::setImage(image); }
 	const QImage getImage(void) { return image; }
-	QPixmap getTilePixmap(int x, int y) { return QPixmap::fromImage(image.copy(tileRect(x, y))); }
+	QPixmap getTilePixmap(int x, int y)
+	{
+		auto key = TileMap::tileIndex(x, y);
+		auto i = tileCache.constFind(key);
+		if (i != tileCache.constEnd())
+			return * i;
+		return tileCache[key] = QPixmap::fromImage(image.copy(tileRect(x, y)));
+	}
+	/* the whole tile set image, in the format that is fastest to draw from, for drawing tiles as subrectangles
+	 * of it - this is an image rather than a pixmap, so that map chunks can be composed on any thread */
+	const QImage & atlas(void)
+	{ if (atlasImage.isNull() && !image.isNull()) atlasImage = image.convertToFormat(QImage::Format_ARGB32_Premultiplied); return atlasImage; }
+	/* the atlas at ever smaller tile sizes, for drawing the map zoomed out - the chain is built in the background,
+	 * it is empty until 'mipChainReady()' is emitted */
+	const TileSetMipChain & mipChain(void)
+	{ if (mipChainLevels.isEmpty() && !isBuildingMipChain) buildMipChain(); return mipChainLevels; }
+	bool isMipChainBuilding(void) const { return isBuildingMipChain; }
+	/* builds the mip chain if needed, and blocks until it is ready, for callers without an event loop */
+	void waitForMipChain(void) { mipChain(); mipChainWatcher.waitForFinished(); installMipChain(mipChainBuild); }
+	/* paints a tile over the one at a tile set position, and updates only what is derived from that tile */
+	void pasteTile(int x, int y, const QImage & tile)
+	{
+		auto r = tileRect(x, y);
+		/* the atlas is the image itself when the image is in the atlas format */
+		bool atlasIsImage = !atlasImage.isNull() && atlasImage.cacheKey() == image.cacheKey();
+		/* the sheet is left with the only reference to the image, so that it is painted in place */
+		image = QImage();
+		if (atlasIsImage)
+			atlasImage = QImage();
+		sheet.drawImage(r.topLeft(), tile);
+		image = sheet.memoryImage();
+		auto pixels = image.copy(r).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+		if (atlasIsImage)
+			atlasImage = image;
+		else if (!atlasImage.isNull())
+		{
+			/* a worker that is composing chunks from the atlas keeps its own copy, painting detaches the atlas from it */
+			QPainter p(& atlasImage);
+			p.setCompositionMode(QPainter::CompositionMode_Source);
+			p.drawImage(r.topLeft(), pixels);
+		}
+		tileCache.remove(TileMap::tileIndex(x, y));
+		if (!uniqueTileIndex.isEmpty())
+			TileSlicer::updateTile(uniqueTileIndex, image, tile_width, tile_height, x, y);
+		mipChainLevels.updateTile(pixels, x, y);
+		if (isBuildingMipChain)
+			pastedTiles << QPoint(x, y);
+		sheetRectChanged(r);
+	}
 	QVector<QImage> reapTiles(std::function<bool(int, int)> predicate)
 	{
-		QVector<QImage> tiles;
+		QVector<TileIndex> tiles;
 		int rows = image.height() / tile_height, columns = image.width() / tile_width, x, y;
 		for (y = 0; y < rows; y ++)
 			for (x = 0; x < columns; x ++)
 				if (predicate(x, y))
-					tiles << image.copy(tileRect(x, y));
-		return tiles;
+					tiles << TileMap::tileIndex(x, y);
+		return TileSlicer::slice(image, tile_width, tile_height, tiles);
+	}
+	/* the tiles of the sheet with duplicates found, recomputed when the sheet changes */
+	const TileSlicer::Index & uniqueTiles(void)
+	{
+		if (uniqueTileIndex.isEmpty())
+			uniqueTileIndex = TileSlicer::index(image, tile_width, tile_height);
+		return uniqueTileIndex;
 	}
 };
 
@@ -486,10 +761,14 @@ private slots:
 	void on_pushButtonOpenImage_clicked();
 	void on_pushButtonResetTileData_clicked();
 	void tileSelected(int tileX, int tileY);
-	void mapTileSelected(Tile * tile);
-	void tileSelected(Tile * tile);
+	void mapTileSelected(int x, int y);
+	void mapCellDragged(int x, int y);
+	void brushStrokeFinished(void);
+	void mapCellsFilled(const QRect & cells);
+	void paintTerrain(int x, int y);
+	void on_pushButtonAutotileMap_clicked();
+	void paletteTileSelected(int tileX, int tileY);
 	void tileShiftSelected(int tileX, int tileY);
-	void tileShiftSelected(Tile * tile);
 	void gameSceneViewportMoved(void);
 	void on_pushButtonAddTerrain_clicked();
 
@@ -509,29 +788,80 @@ private slots:
 
 	void on_pushButtonFillMap_clicked();
 
+	void on_pushButtonMergeDuplicateTiles_clicked();
+
 private:
-	void saveMap(const QString & fileName);
-	bool loadMap(const QString & fileName);
+	ProjectSaver projectSaver;
+	QTimer autosaveTimer;
+	ProjectSaver::Snapshot projectSnapshot(void);
+	MapLoader mapLoader;
+	/* the map is replaced once it has been loaded in the background */
+	void loadMap(const QString & fileName);
 	void clearMap(void);
+	/* asks before replacing the map with 'map' if the older edits could no longer be undone after that */
+	bool confirmMapEdit(const TileMap & map);
 	QVector<QCheckBox*> terrain_checkboxes;
-	TileInfo	* last_tile_selected = 0;
-	Tile		* lastTileFromMapSelected = 0;
+	/* the tile set position of the tile last selected, (-1, -1) when there is none */
+	QPoint lastTileSelected { -1, -1 };
+	/* the tile last clicked in one of the palettes, stamped when no tiles are selected */
+	QPoint lastPaletteTile { -1, -1 };
+	enum
+	{
+		/* the map view is updated at most this often while painting */
+		BRUSH_UPDATE_INTERVAL_MS	=	16,
+	};
+	/* the stamp is built from the palette selection when that changes, rather than on every stroke */
+	Brush brush;
+	void updateBrush(void);
+	/* the tiles selected in whichever palette has a selection */
+	QVector<TileIndex> paletteSelection(void) const;
+	void paletteSelectionChanged(TilePaletteItem * palette);
+	/* a stroke lasts from a press on the map to the release of the button, and is a single history command;
+	 * 'brushOrigin' is the cell the stroke started at, 'brushCell' the one the brush was painted at last */
+	bool isBrushStroke = false;
+	QPoint brushOrigin, brushCell;
+	/* the cells painted since the map view was last updated */
+	QRect brushDirtyCells;
+	QTimer brushUpdateTimer;
+	void brushCellsChanged(const QRect & cells);
+	void flushBrushUpdate(void);
 	Ui::MapEditor *ui;
 	TileSheet tileSheet;
 	TileSet tileSet;
 	QString last_map_image_filename;
-	QVector<QVector<class TileInfo>> tileInfo;
+	/* maps are stored in the binary format when this has a ".tmap" suffix, and as json otherwise */
+	QString map_file_name;
+	TileInfo tileInfo;
 	void resetTileData(int tileCountX, int tileCountY)
-	{ int row; for (row = 0; row < tileCountY; row ++) { tileInfo << QVector<class TileInfo>(tileCountX); int column = 0; for (auto & t : tileInfo.last()) t.setXY(column ++, row); } }
+	{ tileInfo.resize(tileCountX, tileCountY); terrainIndex.rebuild(tileInfo); history.clear(); autotilerDirty = true; }
+	TerrainIndex terrainIndex;
 	qint64 terrainBitmap(void) { qint64 t = 0, i = 0; for (auto c : terrain_checkboxes) t |= (c->isChecked() ? (1 << i) : 0), ++ i; return t; }
 	QVector<QImage> animation;
 	int animation_index = 0;
 	QGraphicsScene tileSetGraphicsScene, filteredTilesGraphicsScene;
 	GameScene tileMapGraphicsScene;
-	QVector<Tile *> graphicsSceneTiles;
+	TilePaletteItem * tilePalette, * filteredTilePalette;
 	void displayFilteredTiles(bool exactTerrainMatch);
-	QVector<QVector<Tile *>> tileMap[MAP_LAYERS];
-	QVector<QGraphicsEllipseItem *> tileMarks;
+	TileMap tileMap;
+	TileMapItem * tileMapItem;
+	MiniMap * miniMap;
+	ProfilerOverlay * profilerOverlay;
+	/* applies the zoom and the rotation controls to the map view */
+	void updateMapTransform(void);
+	CollisionMap collisionMap { & tileMap, & tileInfo };
+	/* map and terrain edits go through this, so that they can be undone */
+	EditHistory history { & tileMap, & tileInfo };
+	void applyHistoryChanges(const EditHistory::Changes & changes);
+	/* rebuilt from the tile information before it is used, if the terrains of the tiles changed since */
+	Autotiler autotiler;
+	bool autotilerDirty = true;
+	void updateAutotiler(void) { if (autotilerDirty) autotiler.rebuild(tileInfo), autotilerDirty = false; }
+	/* retiles the autotiled layers around the given cells, as part of the current history command */
+	void retileAround(const QRect & cells);
+	/* tiles with the terrain of this name block the game entities */
+	QString solidTerrainName;
+	void updateSolidTerrain(void)
+	{ auto i = TileInfo::terrainNames().indexOf(solidTerrainName); tileMapGraphicsScene.setSolidTerrain(i == -1 ? 0 : qint32(quint32(1) << i)); }
 	Player * player;
 	QGraphicsPixmapItem	* upArrowOverlayButton;
 protected:
@@ -0,0 +1,62 @@
+#include <QtConcurrent>
+
+#include "maploader.hxx"
+#include "tilemapitem.hxx"
+#include "profiler.hxx"
+
+MapLoader::MapLoader(QObject * parent) : QObject(parent)
+{
+	qRegisterMetaType<TileMap>("TileMap");
+	/* the worker signals reach these on the thread of the loader, in the order they were emitted */
+	connect(this, & MapLoader::workerMapLoaded, this, [=] (int load, const QString & fileName, const TileMap & tileMap)
+		{ if (!isCancelled(load)) emit mapLoaded(fileName, tileMap); }, Qt::QueuedConnection);
+	connect(this, & MapLoader::workerChunkLoaded, this, [=] (int load, int chunkX, int chunkY, const QImage & chunk)
+		{ if (!isCancelled(load)) emit chunkLoaded(chunkX, chunkY, chunk); }, Qt::QueuedConnection);
+}
+
+void MapLoader::load(const Request & request)
+{
+	int load = lastLoad.fetchAndAddOrdered(1) + 1;
+	/* the watcher only reports on the last future it was given, a cancelled load runs on until it notices */
+	watcher.disconnect(this);
+	connect(& watcher, & QFutureWatcher<QString>::finished, this, [=] { if (!isCancelled(load)) emit finished(watcher.result()); });
+	futures.erase(std::remove_if(futures.begin(), futures.end(), [] (const QFuture<QString> & future) { return future.isFinished(); }), futures.end());
+	futures << QtConcurrent::run([=] { return run(load, request); });
+	watcher.setFuture(futures.last());
+}
+
+QString MapLoader::run(int load, const Request & request)
+{
+	TileMap tileMap;
+	{
+		Profiler::Scope scope("load-map");
+		if (!tileMap.load(request.fileName))
+			return tr("Error loading map from %1!").arg(request.fileName);
+	}
+	if (isCancelled(load))
+		return QString();
+	emit workerMapLoaded(load, request.fileName, tileMap);
+	if (request.atlas.isNull() || request.tileWidth <= 0 || request.tileHeight <= 0)
+		return QString();
+
+	/* chunks are composed in the order of their distance from the center of the viewport */
+	auto center = request.viewport.center() / TileMap::CHUNK_SIZE;
+	QVector<QPoint> chunks;
+	for (int y = 0; y < tileMap.chunkCountY(); y ++)
+		for (int x = 0; x < tileMap.chunkCountX(); x ++)
+			chunks << QPoint(x, y);
+	std::sort(chunks.begin(), chunks.end(), [=] (const QPoint & a, const QPoint & b)
+		{ return (a - center).manhattanLength() < (b - center).manhattanLength(); });
+	chunks.resize(std::min(chunks.size(), std::max(request.maxChunks, 0)));
+
+	auto background = TileMapItem::backgroundTile(request.tileWidth, request.tileHeight);
+	auto atlas = request.atlas.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+	/* the chunks are split in batches, so that the nearest ones are handed over before the rest are started */
+	enum { BATCH_SIZE = 64, };
+	for (int i = 0; i < chunks.size() && !isCancelled(load); i += BATCH_SIZE)
+		QtConcurrent::blockingMap(chunks.begin() + i, chunks.begin() + std::min(i + int(BATCH_SIZE), chunks.size()), [&] (const QPoint & c) {
+			if (!isCancelled(load))
+				emit workerChunkLoaded(load, c.x(), c.y(), TileMapItem::composeChunk(tileMap, atlas, background, c.x(), c.y(), request.tileWidth, request.tileHeight));
+		});
+	return QString();
+}
@@ -0,0 +1,58 @@
+#ifndef MAPLOADER_HXX
+#define MAPLOADER_HXX
+
+#include <QObject>
+#include <QImage>
+#include <QRect>
+#include <QAtomicInt>
+#include <QFutureWatcher>
+
+#include "tilemap.hxx"
+
+Q_DECLARE_METATYPE(TileMap)
+
+/* loads a map on worker threads - the file is read and decoded first, and the map is handed over as soon as
+ * it is built, then the chunk images around the initial viewport are composed in parallel, nearest ones first,
+ * and handed over one by one as they are ready. Starting another load cancels the one that is running */
+class MapLoader : public QObject
+{
+	Q_OBJECT
+public:
+	struct Request
+	{
+		QString fileName;
+		/* the tile set image, and the size of its tiles */
+		QImage atlas;
+		int tileWidth = 0, tileHeight = 0;
+		/* the map cells that are shown first */
+		QRect viewport;
+		/* no more chunks than this are composed */
+		int maxChunks = 0;
+	};
+private:
+	QFutureWatcher<QString> watcher;
+	/* cancelled loads still run until they notice, and use the loader until they end - these are waited for too */
+	QList<QFuture<QString>> futures;
+	/* every load gets a number, a load stops once it is not the last one anymore */
+	QAtomicInt lastLoad;
+	bool isCancelled(int load) const { return lastLoad.load() != load; }
+	/* runs on the worker thread, returns an error message, or an empty string on success */
+	QString run(int load, const Request & request);
+public:
+	MapLoader(QObject * parent = 0);
+	~MapLoader() { cancel(); for (auto & future : futures) future.waitForFinished(); }
+	void load(const Request & request);
+	void cancel(void) { lastLoad.ref(); }
+	bool isLoading(void) const { return watcher.isRunning(); }
+signals:
+	/* 'fileName' is the file the map was loaded from */
+	void mapLoaded(const QString & fileName, const TileMap & tileMap);
+	void chunkLoaded(int chunkX, int chunkY, const QImage & chunk);
+	/* not emitted for cancelled loads */
+	void finished(const QString & error);
+	/* these are emitted on the worker threads, and are only forwarded to the signals above for the last load */
+	void workerMapLoaded(int load, const QString & fileName, const TileMap & tileMap);
+	void workerChunkLoaded(int load, int chunkX, int chunkY, const QImage & chunk);
+};
+
+#endif // MAPLOADER_HXX
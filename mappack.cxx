@@ -0,0 +1,122 @@
+#include <QBuffer>
+#include <QFile>
+#include <QSaveFile>
+#include <QPainter>
+#include <QtEndian>
+
+#include <cmath>
+
+#include "mappack.hxx"
+
+QVector<TileIndex> MapPack::usedTiles(const TileMap & map, int tileSetColumns, int tileSetRows)
+{
+	QVector<bool> used(tileSetColumns * tileSetRows, false);
+	for (int layer = 0; layer < MAP_LAYERS; layer ++)
+		for (int y = 0; y < map.chunkCountY(); y ++)
+			for (int x = 0; x < map.chunkCountX(); x ++)
+			{
+				/* the cells of a chunk outside the map are always empty */
+				auto cells = map.chunkCells(layer, x, y);
+				if (!cells)
+					continue;
+				for (int i = 0; i < TileMap::CHUNK_CELLS; i ++)
+				{
+					auto tile = cells[i];
+					int tx = TileMap::tileSetX(tile), ty = TileMap::tileSetY(tile);
+					if (tile != TileMap::NO_TILE && tx < tileSetColumns && ty < tileSetRows)
+						used[ty * tileSetColumns + tx] = true;
+				}
+			}
+	QVector<TileIndex> tiles;
+	for (int i = 0; i < used.size(); i ++)
+		if (used.at(i))
+			tiles << TileMap::tileIndex(i % tileSetColumns, i / tileSetColumns);
+	return tiles;
+}
+
+bool MapPack::write(QIODevice & device, const TileMap & map, const QImage & tileSet, const TileInfo & tileInfo,
+		const Settings & settings, const QByteArray & inputHash)
+{
+	int w = settings.tileWidth, h = settings.tileHeight;
+	if (w <= 0 || h <= 0 || inputHash.size() != INPUT_HASH_WORDS * int(sizeof(quint32)))
+		return false;
+	auto tiles = usedTiles(map, tileSet.width() / w, tileSet.height() / h);
+
+	/* every used tile is replaced by its number in the pack, and the rest by NO_TILE */
+	QHash<TileIndex, TileIndex> remap;
+	for (int i = 0; i < tiles.size(); i ++)
+		remap.insert(tiles.at(i), i);
+	TileMap packedMap = map;
+	for (int layer = 0; layer < MAP_LAYERS; layer ++)
+		for (int y = 0; y < map.chunkCountY(); y ++)
+			for (int x = 0; x < map.chunkCountX(); x ++)
+				if (auto cells = map.chunkCells(layer, x, y))
+					for (int i = 0; i < TileMap::CHUNK_CELLS; i ++)
+						if (cells[i] != TileMap::NO_TILE && !remap.contains(cells[i]))
+							remap.insert(cells[i], TileMap::NO_TILE);
+	packedMap.remapTiles(remap);
+	QBuffer mapData;
+	mapData.open(QIODevice::WriteOnly);
+	if (!packedMap.writeBinary(mapData))
+		return false;
+
+	int columns = std::max(int(std::ceil(std::sqrt(double(tiles.size())))), 1), rows = (tiles.size() + columns - 1) / columns;
+	QByteArray atlasData;
+	if (!tiles.isEmpty())
+	{
+		QImage atlas(columns * w, rows * h, QImage::Format_ARGB32);
+		atlas.fill(Qt::transparent);
+		QPainter p(& atlas);
+		p.setCompositionMode(QPainter::CompositionMode_Source);
+		for (int i = 0; i < tiles.size(); i ++)
+			p.drawImage(QRect(i % columns * w, i / columns * h, w, h), tileSet,
+					QRect(TileMap::tileSetX(tiles.at(i)) * w, TileMap::tileSetY(tiles.at(i)) * h, w, h));
+		p.end();
+		QBuffer buffer(& atlasData);
+		buffer.open(QIODevice::WriteOnly);
+		if (!atlas.save(& buffer, "png"))
+			return false;
+	}
+
+	QVector<quint32> words;
+	words << qToLittleEndian<quint32>(PACK_FILE_MAGIC) << qToLittleEndian<quint32>(PACK_FILE_VERSION);
+	for (int i = 0; i < INPUT_HASH_WORDS; i ++)
+		words << qFromUnaligned<quint32>(inputHash.constData() + i * sizeof(quint32));
+	words << qToLittleEndian<quint32>(w) << qToLittleEndian<quint32>(h) << qToLittleEndian<quint32>(tiles.size())
+		<< qToLittleEndian<quint32>(columns) << qToLittleEndian<quint32>(settings.solidTerrain)
+		<< qToLittleEndian<quint32>(mapData.size()) << qToLittleEndian<quint32>(atlasData.size());
+	for (auto tile : tiles)
+		words << qToLittleEndian<quint32>(tileInfo.terrain(TileMap::tileSetX(tile), TileMap::tileSetY(tile)));
+	/* the map data is made of whole words already */
+	atlasData.append((4 - atlasData.size() % 4) % 4, '\0');
+	auto header = QByteArray::fromRawData(reinterpret_cast<const char *>(words.constData()), words.size() * sizeof(quint32));
+	return device.write(header) == header.size() && device.write(mapData.data()) == mapData.size()
+			&& device.write(atlasData) == atlasData.size();
+}
+
+bool MapPack::save(const QString & fileName, const TileMap & map, const QImage & tileSet, const TileInfo & tileInfo,
+		const Settings & settings, const QByteArray & inputHash)
+{
+	QSaveFile f(fileName);
+	if (!f.open(QIODevice::WriteOnly))
+		return false;
+	if (!write(f, map, tileSet, tileInfo, settings, inputHash))
+	{
+		f.cancelWriting();
+		return false;
+	}
+	return f.commit();
+}
+
+QByteArray MapPack::inputHash(const QString & fileName)
+{
+	QFile f(fileName);
+	if (!f.open(QIODevice::ReadOnly))
+		return QByteArray();
+	auto header = f.read(HEADER_WORDS * sizeof(quint32));
+	if (header.size() != HEADER_WORDS * int(sizeof(quint32))
+			|| qFromLittleEndian<quint32>(header.constData()) != PACK_FILE_MAGIC
+			|| qFromLittleEndian<quint32>(header.constData() + sizeof(quint32)) != PACK_FILE_VERSION)
+		return QByteArray();
+	return header.mid(2 * sizeof(quint32), INPUT_HASH_WORDS * sizeof(quint32));
+}
@@ -0,0 +1,50 @@
+#ifndef MAPPACK_HXX
+#define MAPPACK_HXX
+
+#include <QImage>
+#include <QVector>
+#include <QByteArray>
+#include <QIODevice>
+
+#include "tilemap.hxx"
+#include "tileinfo.hxx"
+
+/* a map baked for the game - only the tiles that the map uses are kept, in a trimmed atlas, and the map cells
+ * refer to them by their number in the atlas; every packed tile also has its terrain bits, which are its
+ * collision mask. A pack records a hash of everything it was built from, so that a pack that is still up to
+ * date need not be built again.
+ * pack file layout, all values are little endian 32 bit words:
+ *	header:		magic ("TPAK"), version, input hash (five words), tile width, tile height, packed tile count,
+ *			atlas columns, solid terrain mask, map size in bytes, atlas size in bytes
+ *	terrains:	the terrain bitmap of every packed tile
+ *	map:		a binary map file (see TileMap), with the cells holding packed tile numbers, and NO_TILE
+ *	atlas:		a png image of the packed tiles, in row major order, padded to a whole word */
+class MapPack
+{
+public:
+	enum
+	{
+		PACK_FILE_MAGIC		=	0x4b415054,
+		PACK_FILE_VERSION	=	1,
+		/* a sha-1 hash */
+		INPUT_HASH_WORDS	=	5,
+		HEADER_WORDS		=	2 + INPUT_HASH_WORDS + 7,
+	};
+	struct Settings
+	{
+		int tileWidth = 0, tileHeight = 0;
+		qint32 solidTerrain = 0;
+	};
+	/* the tiles of the tile set that a map uses, in tile set order - tiles outside the tile set are left out */
+	static QVector<TileIndex> usedTiles(const TileMap & map, int tileSetColumns, int tileSetRows);
+	/* 'tileSet' is the whole tile set image, and 'inputHash' a sha-1 hash of everything the pack is built from */
+	static bool write(QIODevice & device, const TileMap & map, const QImage & tileSet, const TileInfo & tileInfo,
+			const Settings & settings, const QByteArray & inputHash);
+	/* replaces the pack file only once the new one is completely written */
+	static bool save(const QString & fileName, const TileMap & map, const QImage & tileSet, const TileInfo & tileInfo,
+			const Settings & settings, const QByteArray & inputHash);
+	/* the input hash recorded in a pack file, an empty array if the file is missing, or is not a pack of this version */
+	static QByteArray inputHash(const QString & fileName);
+};
+
+#endif // MAPPACK_HXX
@@ -0,0 +1,64 @@
+#include <QPainter>
+#include <QMouseEvent>
+#include <QScrollBar>
+
+#include "minimap.hxx"
+
+MiniMap::MiniMap(TileMapItem * tileMapItem, QGraphicsView * view, QWidget * parent) : QWidget(parent)
+{
+	this->tileMapItem = tileMapItem;
+	this->view = view;
+	setMinimumSize(64, 64);
+	connect(tileMapItem, & TileMapItem::overviewChanged, this, [=] { update(); });
+	connect(view->horizontalScrollBar(), & QScrollBar::valueChanged, this, [=] { update(); });
+	connect(view->verticalScrollBar(), & QScrollBar::valueChanged, this, [=] { update(); });
+	connect(view->horizontalScrollBar(), & QScrollBar::rangeChanged, this, [=] { update(); });
+	connect(view->verticalScrollBar(), & QScrollBar::rangeChanged, this, [=] { update(); });
+}
+
+QRectF MiniMap::overviewRect(void)
+{
+	auto size = QSizeF(tileMapItem->overview().image().size()).scaled(QSizeF(this->size()), Qt::KeepAspectRatio);
+	return QRectF(QPointF((width() - size.width()) / 2, (height() - size.height()) / 2), size);
+}
+
+void MiniMap::paintEvent(QPaintEvent * event)
+{
+	Q_UNUSED(event);
+	QPainter p(this);
+	p.fillRect(rect(), palette().window());
+	auto & image = tileMapItem->overview().image();
+	if (image.isNull())
+		return;
+	auto target = overviewRect();
+	p.drawImage(target, image);
+	/* scene units to widget coordinates */
+	auto pixel = tileMapItem->overviewPixelSize();
+	auto scale = QSizeF(target.width() / (image.width() * pixel.width()), target.height() / (image.height() * pixel.height()));
+	auto visible = view->mapToScene(view->viewport()->rect()).boundingRect();
+	p.setPen(Qt::red);
+	p.drawRect(QRectF(target.x() + visible.x() * scale.width(), target.y() + visible.y() * scale.height(),
+			visible.width() * scale.width(), visible.height() * scale.height()));
+}
+
+void MiniMap::centerView(const QPointF & pos)
+{
+	auto & image = tileMapItem->overview().image();
+	auto target = overviewRect();
+	if (image.isNull() || target.isEmpty())
+		return;
+	auto pixel = tileMapItem->overviewPixelSize();
+	view->centerOn((pos.x() - target.x()) / target.width() * image.width() * pixel.width(),
+			(pos.y() - target.y()) / target.height() * image.height() * pixel.height());
+}
+
+void MiniMap::mousePressEvent(QMouseEvent * event)
+{
+	centerView(event->pos());
+}
+
+void MiniMap::mouseMoveEvent(QMouseEvent * event)
+{
+	if (event->buttons() & Qt::LeftButton)
+		centerView(event->pos());
+}
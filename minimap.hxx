@@ -0,0 +1,29 @@
+#ifndef MINIMAP_HXX
+#define MINIMAP_HXX
+
+#include <QWidget>
+#include <QGraphicsView>
+
+#include "tilemapitem.hxx"
+
+/* shows the whole map, from the map overview, with the part of it that a view shows outlined - clicking
+ * or dragging in it centers the view there; the overview is updated cell by cell as the map is edited,
+ * so showing it costs the same for any map size */
+class MiniMap : public QWidget
+{
+	Q_OBJECT
+	TileMapItem * tileMapItem;
+	QGraphicsView * view;
+	/* the widget rectangle that the overview is drawn to */
+	QRectF overviewRect(void);
+	void centerView(const QPointF & pos);
+public:
+	MiniMap(TileMapItem * tileMapItem, QGraphicsView * view, QWidget * parent = 0);
+	QSize sizeHint(void) const override { return QSize(256, 256); }
+protected:
+	void paintEvent(QPaintEvent * event) override;
+	void mousePressEvent(QMouseEvent * event) override;
+	void mouseMoveEvent(QMouseEvent * event) override;
+};
+
+#endif // MINIMAP_HXX
@@ -0,0 +1,150 @@
+#include <QtConcurrent>
+
+#include <numeric>
+#include <cstring>
+
+#include "mipchain.hxx"
+
+/* scales a tile down, and writes it to its place in the tile grid of a level */
+static void writeTile(const QImage & tile, const QSize & to, uchar * bits, int bytesPerLine, int x, int y)
+{
+	auto scaled = tile.scaled(to, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	for (int row = 0; row < to.height(); row ++)
+		memcpy(bits + (y * to.height() + row) * bytesPerLine + x * to.width() * 4, scaled.constScanLine(row), to.width() * 4);
+}
+
+void TileSetMipChain::build(const QImage & atlas, int tileWidth, int tileHeight)
+{
+	levels.clear();
+	tileSizes.clear();
+	if (atlas.isNull() || tileWidth <= 0 || tileHeight <= 0)
+		return;
+	int columns = atlas.width() / tileWidth, rows = atlas.height() / tileHeight;
+	levels << atlas.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+	tileSizes << QSize(tileWidth, tileHeight);
+	while (tileSizes.last() != QSize(1, 1))
+	{
+		auto & source = levels.last();
+		auto from = tileSizes.last(), to = QSize(std::max(from.width() / 2, 1), std::max(from.height() / 2, 1));
+		QImage level(columns * to.width(), rows * to.height(), QImage::Format_ARGB32_Premultiplied);
+		QVector<int> tileRows(rows);
+		std::iota(tileRows.begin(), tileRows.end(), 0);
+		/* the level is detached here, once, rather than by every thread that writes to it */
+		auto bits = level.bits();
+		auto bytesPerLine = level.bytesPerLine();
+		/* every row of tiles is scaled by a single thread, and each one writes only to its own part of the level */
+		QtConcurrent::blockingMap(tileRows, [&] (int y) {
+			for (int x = 0; x < columns; x ++)
+				writeTile(source.copy(x * from.width(), y * from.height(), from.width(), from.height()), to, bits, bytesPerLine, x, y);
+		});
+		levels << level;
+		tileSizes << to;
+	}
+	if (levels.size() > 1)
+		levels[0] = QImage();
+}
+
+void TileSetMipChain::updateTile(const QImage & tile, int x, int y)
+{
+	if (levels.size() < 2 || x < 0 || y < 0 || x >= levels.at(1).width() / tileSizes.at(1).width() || y >= levels.at(1).height() / tileSizes.at(1).height())
+		return;
+	/* every level is scaled from the one before it, as when the chain is built */
+	auto source = tile.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+	for (int i = 1; i < levels.size(); i ++)
+	{
+		auto to = tileSizes.at(i);
+		writeTile(source, to, levels[i].bits(), levels.at(i).bytesPerLine(), x, y);
+		source = levels.at(i).copy(x * to.width(), y * to.height(), to.width(), to.height());
+	}
+}
+
+static quint32 blend(quint32 over, quint32 under)
+{
+	/* premultiplied 'over' operator, on all four channels at once, two at a time */
+	quint32 inverse = 255 - qAlpha(over);
+	quint32 rb = (under & 0x00ff00ff) * inverse, ag = ((under >> 8) & 0x00ff00ff) * inverse;
+	rb = ((rb + ((rb >> 8) & 0x00ff00ff) + 0x00800080) >> 8) & 0x00ff00ff;
+	ag = (ag + ((ag >> 8) & 0x00ff00ff) + 0x00800080) & 0xff00ff00;
+	return over + (rb | ag);
+}
+
+quint32 MapOverview::tileColour(TileIndex tile) const
+{
+	int x = TileMap::tileSetX(tile), y = TileMap::tileSetY(tile);
+	if (tile == TileMap::NO_TILE || x >= tileColours.width() || y >= tileColours.height())
+		return 0;
+	return reinterpret_cast<const quint32 *>(tileColours.constScanLine(y))[x];
+}
+
+void MapOverview::updatePixels(const QRect & pixels)
+{
+	int block = blockSize(), width = tileMap->width(), bytesPerLine = overview.bytesPerLine();
+	/* the overview is detached here, once, rather than by every thread that writes to it */
+	auto bits = overview.bits();
+	auto updateRow = [&] (int py) {
+		QVector<TileIndex> cells(MAP_LAYERS * width);
+		QVector<quint32> sums(4 * pixels.width(), 0), counts(pixels.width(), 0);
+		for (int y = py * block; y < std::min((py + 1) * block, tileMap->height()); y ++)
+		{
+			for (int layer = 0; layer < MAP_LAYERS; layer ++)
+				tileMap->readRow(layer, y, cells.data() + layer * width);
+			for (int x = pixels.left() * block; x < std::min((pixels.right() + 1) * block, width); x ++)
+			{
+				auto colour = backgroundColour;
+				for (int layer = 0; layer < MAP_LAYERS; layer ++)
+					if (auto c = tileColour(cells.at(layer * width + x)))
+						colour = blend(c, colour);
+				int i = (x >> blockSizeLog2) - pixels.left();
+				sums[4 * i] += qAlpha(colour), sums[4 * i + 1] += qRed(colour), sums[4 * i + 2] += qGreen(colour), sums[4 * i + 3] += qBlue(colour);
+				counts[i] ++;
+			}
+		}
+		auto line = reinterpret_cast<quint32 *>(bits + py * bytesPerLine) + pixels.left();
+		for (int i = 0; i < pixels.width(); i ++)
+			line[i] = counts.at(i) ? qRgba(sums.at(4 * i + 1) / counts.at(i), sums.at(4 * i + 2) / counts.at(i),
+					sums.at(4 * i + 3) / counts.at(i), sums.at(4 * i) / counts.at(i)) : 0;
+	};
+	if (pixels.width() * pixels.height() <= SERIAL_UPDATE_PIXELS)
+	{
+		/* single edits are not worth handing over to the thread pool */
+		for (int py = pixels.top(); py <= pixels.bottom(); py ++)
+			updateRow(py);
+		return;
+	}
+	QVector<int> rows(pixels.height());
+	std::iota(rows.begin(), rows.end(), pixels.top());
+	/* every row of pixels is computed by a single thread, and each one writes only to its own row */
+	QtConcurrent::blockingMap(rows, updateRow);
+}
+
+int MapOverview::blockSizeLog2For(const TileMap & tileMap)
+{
+	int log2;
+	for (log2 = 0; (std::max(tileMap.width(), tileMap.height()) >> log2) > MAX_SIDE; log2 ++)
+		;
+	return log2;
+}
+
+void MapOverview::reset(const TileMap * tileMap, const QImage & tileColours, quint32 backgroundColour)
+{
+	this->tileMap = tileMap;
+	this->tileColours = tileColours.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+	this->backgroundColour = backgroundColour;
+	blockSizeLog2 = blockSizeLog2For(* tileMap);
+	int block = blockSize();
+	overview = QImage((tileMap->width() + block - 1) / block, (tileMap->height() + block - 1) / block, QImage::Format_ARGB32_Premultiplied);
+	if (!overview.isNull())
+		updatePixels(overview.rect());
+}
+
+QRect MapOverview::update(const QRect & cells)
+{
+	if (!tileMap || overview.isNull())
+		return QRect();
+	auto r = cells & QRect(0, 0, tileMap->width(), tileMap->height());
+	if (r.isEmpty())
+		return QRect();
+	QRect pixels(QPoint(r.left() >> blockSizeLog2, r.top() >> blockSizeLog2), QPoint(r.right() >> blockSizeLog2, r.bottom() >> blockSizeLog2));
+	updatePixels(pixels);
+	return pixels;
+}
@@ -0,0 +1,66 @@
+#ifndef MIPCHAIN_HXX
+#define MIPCHAIN_HXX
+
+#include <QImage>
+#include <QVector>
+#include <QRect>
+
+#include "tilemap.hxx"
+
+/* scaled down copies of a tile set image - every level halves the tile size of the one before it, down to a
+ * single pixel per tile, which is then the average colour of the tile; tiles are scaled one by one, so their
+ * colours never bleed into each other, whatever the tile size is */
+class TileSetMipChain
+{
+	/* level 0 is not kept once the others are built from it, so that the atlas can be painted over without being copied */
+	QVector<QImage> levels;
+	QVector<QSize> tileSizes;
+public:
+	void build(const QImage & atlas, int tileWidth, int tileHeight);
+	/* scales a tile of the atlas that changed down again, in every level; 'tile' is its new level 0 image */
+	void updateTile(const QImage & tile, int x, int y);
+	bool isEmpty(void) const { return levels.isEmpty(); }
+	int levelCount(void) const { return levels.size(); }
+	/* null for level 0, unless it is also the last level */
+	const QImage & level(int index) const { return levels.at(index); }
+	QSize tileSize(int level) const { return tileSizes.at(level); }
+	/* the tile set at one pixel per tile */
+	const QImage & tileColours(void) const { return levels.last(); }
+};
+
+/* the whole map at one pixel per square block of cells, the blocks are as small as possible with the image
+ * sides kept within a limit; pixels are the averages of the cells in them, with all layers blended over the
+ * average colour of the map background. The image is kept up to date by updating the changed cells only */
+class MapOverview
+{
+	const TileMap * tileMap = 0;
+	QImage tileColours;
+	quint32 backgroundColour = 0;
+	QImage overview;
+	int blockSizeLog2 = 0;
+	/* premultiplied, zero for no tile */
+	quint32 tileColour(TileIndex tile) const;
+	void updatePixels(const QRect & pixels);
+public:
+	enum
+	{
+		MAX_SIDE		=	1024,
+		SERIAL_UPDATE_PIXELS	=	256,
+	};
+	/* rebuilds the whole overview */
+	void reset(const TileMap * tileMap, const QImage & tileColours, quint32 backgroundColour);
+	/* for an overview built from a copy of the map, the cells of the map that changed since are only updated by 'update()' */
+	void setTileMap(const TileMap * tileMap) { this->tileMap = tileMap; }
+	/* for a tile set that changed, the pixels are only updated by 'update()' */
+	void setTileColours(const QImage & tileColours) { this->tileColours = tileColours.convertToFormat(QImage::Format_ARGB32_Premultiplied); }
+	/* updates the pixels covering the given cells, and returns them */
+	QRect update(const QRect & cells);
+	const QImage & image(void) const { return overview; }
+	/* in cells, along each side of a pixel */
+	int blockSize(void) const { return 1 << blockSizeLog2; }
+	/* the block size of the overview of a map, before it is built */
+	static int blockSizeLog2For(const TileMap & tileMap);
+	static int blockSizeFor(const TileMap & tileMap) { return 1 << blockSizeLog2For(tileMap); }
+};
+
+#endif // MIPCHAIN_HXX
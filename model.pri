@@ -0,0 +1,31 @@
+# the map and tile set model, which does not depend on the editor user interface
+
+INCLUDEPATH += $$PWD
+
+SOURCES += $$PWD/tilemap.cxx \
+        $$PWD/tileinfo.cxx \
+        $$PWD/projectsaver.cxx \
+        $$PWD/tileslicer.cxx \
+        $$PWD/terrainindex.cxx \
+        $$PWD/collision.cxx \
+        $$PWD/edithistory.cxx \
+        $$PWD/autotiler.cxx \
+        $$PWD/mipchain.cxx \
+        $$PWD/profiler.cxx \
+        $$PWD/sheetimage.cxx \
+        $$PWD/brush.cxx \
+        $$PWD/mappack.cxx
+
+HEADERS += $$PWD/tilemap.hxx \
+        $$PWD/tileinfo.hxx \
+        $$PWD/projectsaver.hxx \
+        $$PWD/tileslicer.hxx \
+        $$PWD/terrainindex.hxx \
+        $$PWD/collision.hxx \
+        $$PWD/edithistory.hxx \
+        $$PWD/autotiler.hxx \
+        $$PWD/mipchain.hxx \
+        $$PWD/profiler.hxx \
+        $$PWD/sheetimage.hxx \
+        $$PWD/brush.hxx \
+        $$PWD/mappack.hxx
@@ -0,0 +1,160 @@
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QVector>
+#include <QThread>
+#include <QCoreApplication>
+
+#include <atomic>
+
+#include "profiler.hxx"
+
+QAtomicInteger<qint64> Profiler::counters[Profiler::COUNTER_COUNT];
+
+namespace
+{
+enum
+{
+	/* per thread, the oldest events are overwritten */
+	BUFFER_EVENTS	=	1 << 15,
+};
+
+struct Event
+{
+	const char * name;
+	qint64 start;
+	/* the counter value for counter samples */
+	qint64 duration;
+	bool isCounterSample;
+};
+
+struct ThreadBuffer
+{
+	int id;
+	QByteArray name;
+	QAtomicInteger<quint64> written { 0 };
+	Event events[BUFFER_EVENTS];
+};
+
+/* buffers are only ever added, and live until the application exits */
+QMutex buffersLock;
+QVector<ThreadBuffer *> buffers;
+thread_local ThreadBuffer * threadBuffer = 0;
+
+void append(const Event & event)
+{
+	if (!threadBuffer)
+	{
+		auto buffer = new ThreadBuffer;
+		auto app = QCoreApplication::instance();
+		QMutexLocker locker(& buffersLock);
+		buffer->id = buffers.size();
+		buffer->name = app && QThread::currentThread() == app->thread() ? QByteArray("main") : "worker " + QByteArray::number(buffer->id);
+		buffers << buffer;
+		threadBuffer = buffer;
+	}
+	auto n = threadBuffer->written.load();
+	/* the count of the last event is published before this one overwrites the slot of an older event,
+	 * and the event is written before its own count is published */
+	std::atomic_thread_fence(std::memory_order_release);
+	threadBuffer->events[n % BUFFER_EVENTS] = event;
+	threadBuffer->written.storeRelease(n + 1);
+}
+
+QVector<ThreadBuffer *> allBuffers(void)
+{
+	QMutexLocker locker(& buffersLock);
+	return buffers;
+}
+
+QVector<Event> readEvents(const ThreadBuffer * buffer)
+{
+	quint64 end = buffer->written.loadAcquire(), begin = end > BUFFER_EVENTS ? end - BUFFER_EVENTS : 0;
+	QVector<Event> events;
+	events.reserve(end - begin);
+	for (auto i = begin; i < end; i ++)
+		events << buffer->events[i % BUFFER_EVENTS];
+	/* the owner thread may have overwritten the oldest events while they were copied, and may be writing
+	 * event 'after' right now, over event 'after' - BUFFER_EVENTS; the copies are made before the count is read again */
+	std::atomic_thread_fence(std::memory_order_acquire);
+	quint64 after = buffer->written.loadAcquire();
+	if (after + 1 > BUFFER_EVENTS && after + 1 - BUFFER_EVENTS > begin)
+		events.remove(0, std::min(int(after + 1 - BUFFER_EVENTS - begin), events.size()));
+	return events;
+}
+}
+
+qint64 Profiler::now(void)
+{
+	static QElapsedTimer clock = [] { QElapsedTimer c; c.start(); return c; }();
+	return clock.nsecsElapsed();
+}
+
+void Profiler::record(const char * name, qint64 start, qint64 duration)
+{
+	append(Event { name, start, duration, false });
+}
+
+const char * Profiler::counterName(Counter counter)
+{
+	switch (counter)
+	{
+	case CHUNK_CACHE_HITS: return "chunk-cache-hits";
+	case CHUNK_CACHE_MISSES: return "chunk-cache-misses";
+	case COLLISION_QUERIES: return "collision-queries";
+	case TILES_STAMPED: return "tiles-stamped";
+	default: return "unknown";
+	}
+}
+
+QHash<QByteArray, Profiler::Stats> Profiler::summary(qint64 since)
+{
+	QHash<QByteArray, Stats> stats;
+	for (auto buffer : allBuffers())
+		for (const auto & e : readEvents(buffer))
+			if (!e.isCounterSample && e.start + e.duration > since)
+			{
+				auto & s = stats[QByteArray::fromRawData(e.name, qstrlen(e.name))];
+				s.count ++;
+				s.total += e.duration;
+				s.max = std::max(s.max, e.duration);
+			}
+	return stats;
+}
+
+void Profiler::sampleCounters(void)
+{
+	auto time = now();
+	for (int i = 0; i < COUNTER_COUNT; i ++)
+		append(Event { counterName(Counter(i)), time, counter(Counter(i)), true });
+}
+
+bool Profiler::writeChromeTrace(QIODevice & device)
+{
+	enum { FLUSH_SIZE = 1 << 16, };
+	QByteArray json = "{\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [";
+	const char * separator = "\n";
+	auto flush = [&] (void) -> bool { bool result = device.write(json) == json.size(); json.clear(); return result; };
+	/* timestamps are in microseconds */
+	auto microseconds = [] (qint64 ns) { return QByteArray::number(ns / 1000.0, 'f', 3); };
+	for (auto buffer : allBuffers())
+	{
+		auto thread = ", \"pid\": 1, \"tid\": " + QByteArray::number(buffer->id);
+		json += separator;
+		json += "{\"name\": \"thread_name\", \"ph\": \"M\"" + thread + ", \"args\": {\"name\": \"" + buffer->name + "\"}}";
+		separator = ",\n";
+		for (const auto & e : readEvents(buffer))
+		{
+			json += separator;
+			if (e.isCounterSample)
+				json += "{\"name\": \"" + QByteArray(e.name) + "\", \"ph\": \"C\", \"ts\": " + microseconds(e.start) + thread
+						+ ", \"args\": {\"value\": " + QByteArray::number(e.duration) + "}}";
+			else
+				json += "{\"name\": \"" + QByteArray(e.name) + "\", \"ph\": \"X\", \"ts\": " + microseconds(e.start)
+						+ ", \"dur\": " + microseconds(e.duration) + thread + "}";
+			if (json.size() >= FLUSH_SIZE && !flush())
+				return false;
+		}
+	}
+	json += "\n]\n}\n";
+	return flush();
+}
@@ -0,0 +1,55 @@
+#ifndef PROFILER_HXX
+#define PROFILER_HXX
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QHash>
+#include <QIODevice>
+
+/* a low overhead profiler for the hot paths - timed scopes are recorded to a ring buffer of the thread they
+ * run on, which only that thread writes to, so recording an event takes no locks; readers copy the buffers,
+ * and drop the events that were overwritten while they copied them. Counters are plain atomic totals. The
+ * recorded events can be summed for display, or written out as a Chrome trace (chrome://tracing, Perfetto).
+ * Event names must be string literals, only their pointers are recorded */
+class Profiler
+{
+public:
+	enum Counter
+	{
+		CHUNK_CACHE_HITS,
+		CHUNK_CACHE_MISSES,
+		COLLISION_QUERIES,
+		TILES_STAMPED,
+		COUNTER_COUNT,
+	};
+	struct Stats
+	{
+		int count = 0;
+		/* in nanoseconds */
+		qint64 total = 0, max = 0;
+	};
+	/* records the time from its construction to its destruction */
+	class Scope
+	{
+		const char * name;
+		qint64 start;
+	public:
+		explicit Scope(const char * name) : name(name), start(now()) {}
+		~Scope() { record(name, start, now() - start); }
+	};
+	/* in nanoseconds, since the profiler was first used */
+	static qint64 now(void);
+	static void record(const char * name, qint64 start, qint64 duration);
+	static void count(Counter counter, qint64 amount = 1) { counters[counter].fetchAndAddRelaxed(amount); }
+	static qint64 counter(Counter counter) { return counters[counter].load(); }
+	static const char * counterName(Counter counter);
+	/* the recorded events of all threads that ended after 'since', summed by name */
+	static QHash<QByteArray, Stats> summary(qint64 since);
+	/* records the current counter values, so that they show in the trace */
+	static void sampleCounters(void);
+	static bool writeChromeTrace(QIODevice & device);
+private:
+	static QAtomicInteger<qint64> counters[COUNTER_COUNT];
+};
+
+#endif // PROFILER_HXX
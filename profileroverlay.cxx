@@ -0,0 +1,60 @@
+#include "mapeditor.hxx"
+
+ProfilerOverlay::ProfilerOverlay(const GameScene * gameScene, const TileMapItem * tileMapItem, QWidget * parent) : QLabel(parent)
+{
+	this->gameScene = gameScene;
+	this->tileMapItem = tileMapItem;
+	setAttribute(Qt::WA_TransparentForMouseEvents);
+	setStyleSheet("background-color: rgba(0, 0, 0, 160); color: white; padding: 4px;");
+	setFont(QFont("monospace"));
+	sampleTimer.setInterval(SAMPLE_PERIOD_MS);
+	connect(& sampleTimer, & QTimer::timeout, this, & ProfilerOverlay::sample);
+	std::fill(lastCounters, lastCounters + Profiler::COUNTER_COUNT, 0);
+}
+
+void ProfilerOverlay::setVisible(bool visible)
+{
+	QLabel::setVisible(visible);
+	if (!visible)
+	{
+		sampleTimer.stop();
+		return;
+	}
+	lastSampleTime = Profiler::now();
+	for (int i = 0; i < Profiler::COUNTER_COUNT; i ++)
+		lastCounters[i] = Profiler::counter(Profiler::Counter(i));
+	sampleTimer.start();
+}
+
+void ProfilerOverlay::sample(void)
+{
+	auto now = Profiler::now();
+	auto seconds = (now - lastSampleTime) / 1e9;
+	auto stats = Profiler::summary(lastSampleTime);
+	qint64 counters[Profiler::COUNTER_COUNT];
+	for (int i = 0; i < Profiler::COUNTER_COUNT; i ++)
+	{
+		auto value = Profiler::counter(Profiler::Counter(i));
+		counters[i] = value - lastCounters[i];
+		lastCounters[i] = value;
+	}
+	lastSampleTime = now;
+	Profiler::sampleCounters();
+
+	auto average = [&] (const char * name) { auto s = stats.value(name); return s.count ? s.total / 1e6 / s.count : 0.; };
+	auto maximum = [&] (const char * name) { return stats.value(name).max / 1e6; };
+	auto frame = stats.value("render-frame");
+	auto lookups = counters[Profiler::CHUNK_CACHE_HITS] + counters[Profiler::CHUNK_CACHE_MISSES];
+	QStringList lines;
+	lines << QString("frame      %1 ms avg, %2 ms max, %3 fps").arg(average("render-frame"), 0, 'f', 2).arg(maximum("render-frame"), 0, 'f', 2)
+			.arg(frame.count / seconds, 0, 'f', 0);
+	lines << QString("map paint  %1 ms avg, %2 chunks composed").arg(average("paint-map"), 0, 'f', 2).arg(stats.value("compose-chunk").count);
+	lines << QString("simulation %1 ms per step, %2 steps/s").arg(average("simulation-step"), 0, 'f', 3).arg(stats.value("simulation-step").count / seconds, 0, 'f', 0);
+	lines << QString("entities   %1 projectiles, %2 animations").arg(gameScene->projectileCount()).arg(gameScene->animationCount());
+	lines << QString("chunks     %1% cache hits, %2 MB cached").arg(lookups ? 100. * counters[Profiler::CHUNK_CACHE_HITS] / lookups : 100., 0, 'f', 1)
+			.arg(tileMapItem->cachedChunkSize() / 1024);
+	lines << QString("collision  %1 queries/s").arg(counters[Profiler::COLLISION_QUERIES] / seconds, 0, 'f', 0);
+	lines << QString("stamping   %1 tiles/s").arg(counters[Profiler::TILES_STAMPED] / seconds, 0, 'f', 0);
+	setText(lines.join('\n'));
+	adjustSize();
+}
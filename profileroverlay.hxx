@@ -0,0 +1,32 @@
+#ifndef PROFILEROVERLAY_HXX
+#define PROFILEROVERLAY_HXX
+
+#include <QLabel>
+#include <QTimer>
+
+#include "profiler.hxx"
+
+class GameScene;
+class TileMapItem;
+
+/* shows the frame time, the entity counts and the cache hit rates over a view, from the profiler events and
+ * counters of the last sampling period; it only samples while it is shown */
+class ProfilerOverlay : public QLabel
+{
+	Q_OBJECT
+	enum
+	{
+		SAMPLE_PERIOD_MS	=	500,
+	};
+	const GameScene * gameScene;
+	const TileMapItem * tileMapItem;
+	QTimer sampleTimer;
+	qint64 lastSampleTime = 0;
+	qint64 lastCounters[Profiler::COUNTER_COUNT];
+	void sample(void);
+public:
+	ProfilerOverlay(const GameScene * gameScene, const TileMapItem * tileMapItem, QWidget * parent);
+	void setVisible(bool visible) override;
+};
+
+#endif // PROFILEROVERLAY_HXX
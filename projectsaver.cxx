@@ -0,0 +1,79 @@
+#include <QtConcurrent>
+#include <QSaveFile>
+#include <QDebug>
+
+#include "projectsaver.hxx"
+#include "profiler.hxx"
+
+ProjectSaver::ProjectSaver(QObject * parent) : QObject(parent)
+{
+	connect(& watcher, & QFutureWatcher<QString>::finished, [=] {
+		emit finished(watcher.result());
+		if (isSnapshotPending)
+		{
+			isSnapshotPending = false;
+			start(pendingSnapshot);
+			pendingSnapshot = Snapshot();
+		}
+	});
+}
+
+void ProjectSaver::start(const Snapshot & snapshot)
+{
+	watcher.setFuture(QtConcurrent::run([=] { return write(snapshot); }));
+}
+
+void ProjectSaver::save(const Snapshot & snapshot)
+{
+	if (watcher.isRunning())
+	{
+		pendingSnapshot = snapshot;
+		isSnapshotPending = true;
+		return;
+	}
+	start(snapshot);
+}
+
+void ProjectSaver::waitForFinished(void)
+{
+	watcher.waitForFinished();
+	if (isSnapshotPending)
+	{
+		isSnapshotPending = false;
+		auto error = write(pendingSnapshot);
+		pendingSnapshot = Snapshot();
+		if (!error.isEmpty())
+			qWarning() << error;
+	}
+}
+
+QString ProjectSaver::write(const Snapshot & snapshot)
+{
+	emit progress(0, SAVE_STEPS, snapshot.tileSetFileName);
+	if (!snapshot.tileSetImage.isNull())
+	{
+		Profiler::Scope scope("save-tile-set");
+		QSaveFile f(snapshot.tileSetFileName);
+		if (!f.open(QIODevice::WriteOnly) || !snapshot.tileSetImage.save(& f, "PNG") || !f.commit())
+			return tr("Error saving tile set image to %1!").arg(snapshot.tileSetFileName);
+	}
+
+	emit progress(1, SAVE_STEPS, snapshot.tileInfoFileName);
+	{
+		Profiler::Scope scope("save-tile-info");
+		QSaveFile f(snapshot.tileInfoFileName);
+		if (!f.open(QIODevice::WriteOnly) || !snapshot.tileInfo.writeJson(f, snapshot.terrainNames) || !f.commit())
+			return tr("Error saving tile information to %1!").arg(snapshot.tileInfoFileName);
+	}
+
+	emit progress(2, SAVE_STEPS, snapshot.mapFileName);
+	if (!snapshot.mapFileName.isEmpty())
+	{
+		Profiler::Scope scope("save-map");
+		if (!snapshot.tileMap.save(snapshot.mapFileName))
+			return tr("Error saving map to %1!").arg(snapshot.mapFileName);
+	}
+
+	emit progress(SAVE_STEPS, SAVE_STEPS, QString());
+	return QString();
+}
@@ -0,0 +1,50 @@
+#ifndef PROJECTSAVER_HXX
+#define PROJECTSAVER_HXX
+
+#include <QObject>
+#include <QImage>
+#include <QFutureWatcher>
+
+#include "tilemap.hxx"
+#include "tileinfo.hxx"
+
+/* writes a project to disk on a worker thread - the project is handed over as a snapshot, which is cheap
+ * to take because all of its parts are implicitly shared, and each file is replaced atomically */
+class ProjectSaver : public QObject
+{
+	Q_OBJECT
+public:
+	struct Snapshot
+	{
+		QImage tileSetImage;
+		TileInfo tileInfo;
+		QStringList terrainNames;
+		TileMap tileMap;
+		/* the map is not written when its file name is empty */
+		QString tileSetFileName = "tile-set.png", tileInfoFileName = "tile-info.json", mapFileName = "map.json";
+	};
+	enum
+	{
+		SAVE_STEPS	=	3,
+	};
+private:
+	QFutureWatcher<QString> watcher;
+	/* a snapshot taken while an older one is still being written is saved right after it */
+	Snapshot pendingSnapshot;
+	bool isSnapshotPending = false;
+	void start(const Snapshot & snapshot);
+	/* runs on the worker thread, returns an error message, or an empty string on success */
+	QString write(const Snapshot & snapshot);
+public:
+	ProjectSaver(QObject * parent = 0);
+	~ProjectSaver() { waitForFinished(); }
+	void save(const Snapshot & snapshot);
+	bool isSaving(void) const { return watcher.isRunning() || isSnapshotPending; }
+	/* blocks until all snapshots handed over are written */
+	void waitForFinished(void);
+signals:
+	void progress(int step, int steps, const QString & fileName);
+	void finished(const QString & error);
+};
+
+#endif // PROJECTSAVER_HXX
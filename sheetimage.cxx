@@ -0,0 +1,114 @@
+#include <QImageReader>
+
+#include "sheetimage.hxx"
+
+bool SheetImage::open(const QString & fileName)
+{
+	QImageReader reader(fileName);
+	auto size = reader.size();
+	if (!reader.canRead())
+		return false;
+	if (!reader.supportsOption(QImageIOHandler::ClipRect) || !size.isValid())
+	{
+		auto image = reader.read();
+		if (image.isNull())
+			return false;
+		/* the whole image is dropped once it is cut in blocks */
+		setImage(QImage());
+		imageSize = image.size();
+		for (int y = 0; y < blockCountY(); y ++)
+			for (int x = 0; x < blockCountX(); x ++)
+				decodedBlocks << image.copy(blockRect(x, y));
+		return true;
+	}
+	setImage(QImage());
+	this->fileName = fileName;
+	format = reader.format();
+	imageSize = size;
+	return true;
+}
+
+void SheetImage::setImage(const QImage & image)
+{
+	fileName.clear();
+	format.clear();
+	blocks.clear();
+	decodedBlocks.clear();
+	this->image = image;
+	imageSize = image.size();
+}
+
+QImage SheetImage::readRegion(const QRect & rect) const
+{
+	QImageReader reader(fileName, format);
+	reader.setClipRect(rect);
+	auto region = reader.read();
+	/* a block that fails to decode is drawn empty, rather than decoded again on every paint */
+	if (region.isNull())
+	{
+		region = QImage(rect.size(), QImage::Format_ARGB32_Premultiplied);
+		region.fill(Qt::transparent);
+	}
+	return region.format() == QImage::Format_RGB32 ? region : region.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+}
+
+QImage SheetImage::block(int blockX, int blockY) const
+{
+	if (blockX < 0 || blockY < 0 || blockX >= blockCountX() || blockY >= blockCountY())
+		return QImage();
+	if (!decodedBlocks.isEmpty())
+		return decodedBlocks.at(blockY * blockCountX() + blockX);
+	if (!isStreamed())
+		return image.copy(blockRect(blockX, blockY));
+	quint32 key = (blockY << 16) | blockX;
+	if (auto block = blocks.object(key))
+		return * block;
+	auto block = readRegion(blockRect(blockX, blockY));
+	blocks.insert(key, new QImage(block), std::max(1, block.width() * block.height() * 4 / 1024));
+	return block;
+}
+
+QImage SheetImage::copy(const QRect & rect) const
+{
+	if (!image.isNull())
+		return image.copy(rect);
+	QImage result(rect.size(), QImage::Format_ARGB32_Premultiplied);
+	result.fill(Qt::transparent);
+	auto r = rect & this->rect();
+	if (r.isEmpty())
+		return result;
+	QPainter painter(& result);
+	painter.setCompositionMode(QPainter::CompositionMode_Source);
+	for (int y = r.top() >> BLOCK_SIZE_LOG2; y <= r.bottom() >> BLOCK_SIZE_LOG2; y ++)
+		for (int x = r.left() >> BLOCK_SIZE_LOG2; x <= r.right() >> BLOCK_SIZE_LOG2; x ++)
+			painter.drawImage(blockRect(x, y).topLeft() - rect.topLeft(), block(x, y));
+	return result;
+}
+
+void SheetImage::drawBlock(QPainter & painter, const QPoint & position, int blockX, int blockY) const
+{
+	if (!image.isNull())
+		painter.drawImage(position, image, blockRect(blockX, blockY));
+	else
+		painter.drawImage(position, block(blockX, blockY));
+}
+
+void SheetImage::drawImage(const QPoint & position, const QImage & source)
+{
+	Q_ASSERT(!isStreamed());
+	auto r = QRect(position, source.size()) & rect();
+	if (r.isEmpty())
+		return;
+	if (!image.isNull())
+	{
+		QPainter painter(& image);
+		painter.drawImage(position, source);
+		return;
+	}
+	for (int y = r.top() >> BLOCK_SIZE_LOG2; y <= r.bottom() >> BLOCK_SIZE_LOG2; y ++)
+		for (int x = r.left() >> BLOCK_SIZE_LOG2; x <= r.right() >> BLOCK_SIZE_LOG2; x ++)
+		{
+			QPainter painter(& decodedBlocks[y * blockCountX() + x]);
+			painter.drawImage(position - blockRect(x, y).topLeft(), source);
+		}
+}
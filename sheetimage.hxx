@@ -0,0 +1,65 @@
+#ifndef SHEETIMAGE_HXX
+#define SHEETIMAGE_HXX
+
+#include <QImage>
+#include <QCache>
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QPainter>
+
+/* a source image that is decoded in square blocks, on demand - when the image file format can decode
+ * a region of the image, only the requested blocks are ever decoded, and the most recently used ones are
+ * kept, so that memory follows what is looked at rather than the size of the image; images in formats
+ * that can only be decoded whole (png among them) are decoded once, and cut in blocks that are all kept,
+ * so they take up the size of the image, once. Images that are already in memory are shared, not copied */
+class SheetImage
+{
+public:
+	enum
+	{
+		BLOCK_SIZE_LOG2	=	8,
+		BLOCK_SIZE	=	1 << BLOCK_SIZE_LOG2,
+		/* in kilobytes */
+		CACHE_SIZE	=	64 << 10,
+	};
+private:
+	QString fileName;
+	QByteArray format;
+	QSize imageSize;
+	/* the image given to 'setImage()' */
+	QImage image;
+	/* all blocks, in row major order, for image files that cannot be read in regions */
+	QVector<QImage> decodedBlocks;
+	mutable QCache<quint32, QImage> blocks { CACHE_SIZE };
+	QImage readRegion(const QRect & rect) const;
+public:
+	/* returns false if the file is not an image that can be read */
+	bool open(const QString & fileName);
+	void setImage(const QImage & image);
+	void clear(void) { setImage(QImage()); }
+	bool isNull(void) const { return imageSize.isEmpty(); }
+	/* true if blocks are decoded from the file as they are needed */
+	bool isStreamed(void) const { return !fileName.isEmpty(); }
+	int width(void) const { return imageSize.width(); }
+	int height(void) const { return imageSize.height(); }
+	QSize size(void) const { return imageSize; }
+	QRect rect(void) const { return QRect(QPoint(0, 0), imageSize); }
+	int blockCountX(void) const { return (width() + BLOCK_SIZE - 1) >> BLOCK_SIZE_LOG2; }
+	int blockCountY(void) const { return (height() + BLOCK_SIZE - 1) >> BLOCK_SIZE_LOG2; }
+	QRect blockRect(int blockX, int blockY) const
+	{ return QRect(blockX << BLOCK_SIZE_LOG2, blockY << BLOCK_SIZE_LOG2, BLOCK_SIZE, BLOCK_SIZE) & rect(); }
+	/* the blocks at the image edges are smaller than the rest; returns a null image for blocks outside the image */
+	QImage block(int blockX, int blockY) const;
+	/* a rectangle of the image, the parts of it outside the image are transparent */
+	QImage copy(const QRect & rect) const;
+	/* draws a block with its top left corner at 'position', without copying it out of an image in memory */
+	void drawBlock(QPainter & painter, const QPoint & position, int blockX, int blockY) const;
+	/* paints 'source' over the image, with its top left corner at 'position' - only the blocks under it change,
+	 * an image in memory is painted in place, unless it is shared; streamed images cannot be painted over */
+	void drawImage(const QPoint & position, const QImage & source);
+	/* the image given to 'setImage()', with what was painted over it since, null for images read from files */
+	const QImage & memoryImage(void) const { return image; }
+};
+
+#endif // SHEETIMAGE_HXX
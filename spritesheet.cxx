@@ -0,0 +1,25 @@
+#include <QHash>
+
+#include <algorithm>
+
+#include "spritesheet.hxx"
+
+SpriteSheet::SpriteSheet(const QString & fileName, int frameWidth) : sheet(fileName)
+{
+	if (sheet.isNull())
+		return;
+	if (frameWidth <= 0 || frameWidth > sheet.width())
+		frameWidth = sheet.width();
+	for (int x = 0; x + frameWidth <= sheet.width(); x += frameWidth)
+		frames << QRect(x, 0, frameWidth, sheet.height());
+}
+
+const SpriteSheet * SpriteSheet::get(const QString & fileName, int frameWidth)
+{
+	/* the sheets are never released - they hold pixmaps, which must not outlive the application object */
+	static auto sheets = new QHash<QPair<QString, int>, SpriteSheet *>();
+	auto & sheet = (* sheets)[qMakePair(fileName, std::max(frameWidth, 0))];
+	if (!sheet)
+		sheet = new SpriteSheet(fileName, frameWidth);
+	return sheet;
+}
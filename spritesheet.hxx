@@ -0,0 +1,27 @@
+#ifndef SPRITESHEET_HXX
+#define SPRITESHEET_HXX
+
+#include <QPixmap>
+#include <QVector>
+#include <QRect>
+#include <QString>
+
+/* a sprite sheet, with its frames laid out horizontally - every sheet file is loaded only once, and is
+ * then shared by all the items that show it; the frame rectangles are computed when the sheet is loaded,
+ * so that showing a frame is only a matter of drawing a part of the shared sheet pixmap */
+class SpriteSheet
+{
+	QPixmap sheet;
+	QVector<QRect> frames;
+	SpriteSheet(const QString & fileName, int frameWidth);
+public:
+	/* returns the sheet loaded from 'fileName', sliced in frames 'frameWidth' pixels wide - a frame width
+	 * of zero makes the whole sheet a single frame; sheets live until the application exits */
+	static const SpriteSheet * get(const QString & fileName, int frameWidth = 0);
+	const QPixmap & pixmap(void) const { return sheet; }
+	int frameCount(void) const { return frames.size(); }
+	const QRect & frame(int index) const { return frames.at(index); }
+	QSize frameSize(void) const { return frames.isEmpty() ? QSize() : frames.first().size(); }
+};
+
+#endif // SPRITESHEET_HXX
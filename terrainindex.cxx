@@ -0,0 +1,110 @@
+#include <QtAlgorithms>
+
+#include "terrainindex.hxx"
+
+void TerrainIndex::reset(int columns, int rows)
+{
+	this->columns = std::max(columns, 0);
+	this->rows = std::max(rows, 0);
+	words = (this->columns * this->rows + 63) / 64;
+	for (auto & t : terrains)
+		t.clear();
+}
+
+void TerrainIndex::rebuild(const TileInfo & tileInfo)
+{
+	reset(tileInfo.width(), tileInfo.height());
+	for (int y = 0; y < rows; y ++)
+		for (int x = 0; x < columns; x ++)
+			setTerrain(x, y, 0, tileInfo.terrain(x, y));
+}
+
+void TerrainIndex::setTerrain(int x, int y, qint32 oldTerrain, qint32 newTerrain)
+{
+	if (!contains(x, y))
+		return;
+	int tile = y * columns + x;
+	quint64 bit = quint64(1) << (tile & 63);
+	quint32 changed = oldTerrain ^ newTerrain;
+	for (int i = 0; changed; i ++, changed >>= 1)
+	{
+		if (!(changed & 1))
+			continue;
+		if (terrains[i].isEmpty())
+			terrains[i].fill(0, words);
+		if (quint32(newTerrain) & (quint32(1) << i))
+			terrains[i][tile >> 6] |= bit;
+		else
+			terrains[i][tile >> 6] &= ~ bit;
+	}
+}
+
+void TerrainIndex::removeTerrain(int index)
+{
+	if (index < 0 || index >= MAX_TERRAINS)
+		return;
+	for (int i = index; i < MAX_TERRAINS - 1; i ++)
+		terrains[i] = terrains[i + 1];
+	terrains[MAX_TERRAINS - 1].clear();
+}
+
+TerrainIndex::Bitset TerrainIndex::query(qint32 terrain, bool exactMatch) const
+{
+	Bitset result(words, exactMatch ? ~ quint64(0) : 0);
+	int i, w;
+	for (i = 0; i < MAX_TERRAINS; i ++)
+	{
+		bool wanted = quint32(terrain) & (quint32(1) << i);
+		auto & t = terrains[i];
+		if (exactMatch)
+		{
+			/* a wanted terrain that no tile has matches nothing, an unwanted one excludes nothing */
+			if (t.isEmpty())
+			{
+				if (wanted)
+					return Bitset(words, 0);
+				continue;
+			}
+			for (w = 0; w < words; w ++)
+				result[w] &= wanted ? t.at(w) : ~ t.at(w);
+		}
+		else if (wanted && !t.isEmpty())
+			for (w = 0; w < words; w ++)
+				result[w] |= t.at(w);
+	}
+	/* clear the bits past the last tile */
+	if (words && (columns * rows) & 63)
+		result[words - 1] &= (quint64(1) << ((columns * rows) & 63)) - 1;
+	return result;
+}
+
+TerrainIndex::Bitset TerrainIndex::tilesWithTerrainsFrom(int index) const
+{
+	Bitset result(words, 0);
+	for (int i = std::max(index, 0); i < MAX_TERRAINS; i ++)
+		if (!terrains[i].isEmpty())
+			for (int w = 0; w < words; w ++)
+				result[w] |= terrains[i].at(w);
+	return result;
+}
+
+QVector<TileIndex> TerrainIndex::tiles(const Bitset & bitset) const
+{
+	QVector<TileIndex> tiles;
+	tiles.reserve(tileCount(bitset));
+	for (int w = 0; w < bitset.size(); w ++)
+		for (quint64 bits = bitset.at(w); bits; bits &= bits - 1)
+		{
+			int tile = w * 64 + qCountTrailingZeroBits(bits);
+			tiles << TileMap::tileIndex(tile % columns, tile / columns);
+		}
+	return tiles;
+}
+
+int TerrainIndex::tileCount(const Bitset & bitset) const
+{
+	int count = 0;
+	for (auto w : bitset)
+		count += qPopulationCount(w);
+	return count;
+}
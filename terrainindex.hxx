@@ -0,0 +1,40 @@
+#ifndef TERRAININDEX_HXX
+#define TERRAININDEX_HXX
+
+#include <QVector>
+
+#include "tilemap.hxx"
+#include "tileinfo.hxx"
+
+/* for each terrain bit, a bitset of the tile set tiles that have it, so that terrain
+ * queries are a handful of word-wide bitwise operations instead of a scan of all tiles;
+ * tiles are numbered in row major order over the tile information grid */
+class TerrainIndex
+{
+public:
+	enum
+	{
+		MAX_TERRAINS	=	32,
+	};
+	typedef QVector<quint64> Bitset;
+private:
+	int columns = 0, rows = 0, words = 0;
+	/* bitsets of terrains that no tile has are left empty */
+	Bitset terrains[MAX_TERRAINS];
+	bool contains(int x, int y) const { return x >= 0 && y >= 0 && x < columns && y < rows; }
+public:
+	void reset(int columns, int rows);
+	void rebuild(const TileInfo & tileInfo);
+	void setTerrain(int x, int y, qint32 oldTerrain, qint32 newTerrain);
+	/* mirrors TileInfo::removeTerrain() - the terrain bits above 'index' move one position down */
+	void removeTerrain(int index);
+	/* with an exact match, tiles must have exactly the terrains in 'terrain', otherwise at least one of them */
+	Bitset query(qint32 terrain, bool exactMatch) const;
+	/* tiles that have any terrain from 'index' up */
+	Bitset tilesWithTerrainsFrom(int index) const;
+	/* the tile set positions of the tiles in a query result, in row major order */
+	QVector<TileIndex> tiles(const Bitset & bitset) const;
+	int tileCount(const Bitset & bitset) const;
+};
+
+#endif // TERRAININDEX_HXX
@@ -0,0 +1,7 @@
+# autotiling map layers from terrain tags
+
+TARGET = AutotilerTest
+
+SOURCES += autotilertest.cxx
+
+include(../tests.pri)
@@ -0,0 +1,167 @@
+#include <QtTest>
+
+#include "testmaps.hxx"
+#include "autotiler.hxx"
+
+/* the tiles picked for the masks of the neighbours of a cell, and retiling map layers */
+
+enum
+{
+	/* the mask bits, going clockwise from north */
+	N = 1, NE = 2, E = 4, SE = 8, S = 16, SW = 32, W = 64, NW = 128,
+	/* a 47 tile terrain in the first tile set row, a 16 tile one in the second, and a 3 tile one at the start of the third */
+	BLOB = 0, EDGES = 1, PLAIN = 2,
+	BLOB_LAYER = 1, EDGES_LAYER = 2,
+};
+
+static TileInfo terrainTiles(void)
+{
+	TileInfo tileInfo(Autotiler::EIGHT_NEIGHBOUR_TILES, 3);
+	for (int x = 0; x < Autotiler::EIGHT_NEIGHBOUR_TILES; x ++)
+		tileInfo.setTerrain(x, 0, 1 << BLOB), tileInfo.setLayer(x, 0, BLOB_LAYER);
+	for (int x = 0; x < Autotiler::FOUR_NEIGHBOUR_TILES; x ++)
+		tileInfo.setTerrain(x, 1, 1 << EDGES), tileInfo.setLayer(x, 1, EDGES_LAYER);
+	for (int x = 0; x < 3; x ++)
+		tileInfo.setTerrain(x, 2, 1 << PLAIN), tileInfo.setLayer(x, 2, BLOB_LAYER);
+	/* a tile with two terrains belongs to neither of them */
+	tileInfo.setTerrain(5, 2, (1 << BLOB) | (1 << EDGES));
+	return tileInfo;
+}
+
+class AutotilerTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void terrainSets(void);
+	void eightNeighbourMasks(void);
+	void fourNeighbourMasks(void);
+	void fewerTiles(void);
+	void retileCells(void);
+	void retileLayer(void);
+};
+
+void AutotilerTest::terrainSets(void)
+{
+	Autotiler autotiler;
+	autotiler.rebuild(terrainTiles());
+	QVERIFY(autotiler.hasTerrain(BLOB) && autotiler.hasTerrain(EDGES) && autotiler.hasTerrain(PLAIN));
+	QVERIFY(!autotiler.hasTerrain(3) && !autotiler.hasTerrain(-1) && !autotiler.hasTerrain(Autotiler::MAX_TERRAINS));
+	QCOMPARE(autotiler.layer(BLOB), int(BLOB_LAYER));
+	QCOMPARE(autotiler.layer(EDGES), int(EDGES_LAYER));
+	QCOMPARE(autotiler.terrainOf(TileMap::tileIndex(46, 0)), int(BLOB));
+	QCOMPARE(autotiler.terrainOf(TileMap::tileIndex(3, 1)), int(EDGES));
+	QCOMPARE(autotiler.terrainOf(TileMap::tileIndex(5, 2)), -1);
+	QCOMPARE(autotiler.terrainOf(TileMap::tileIndex(50, 0)), -1);
+	QCOMPARE(autotiler.terrainOf(TileMap::NO_TILE), -1);
+	QCOMPARE(autotiler.layers(), QVector<int>({ BLOB_LAYER, EDGES_LAYER, }));
+}
+
+void AutotilerTest::eightNeighbourMasks(void)
+{
+	Autotiler autotiler;
+	autotiler.rebuild(terrainTiles());
+	auto blob = [&] (int mask) { return TileMap::tileSetX(autotiler.tile(BLOB, mask)); };
+	/* the distinct masks in ascending order start with these */
+	QCOMPARE(blob(0), 0);
+	QCOMPARE(blob(N), 1);
+	QCOMPARE(blob(E), 2);
+	QCOMPARE(blob(N | E), 3);
+	QCOMPARE(blob(N | NE | E), 4);
+	QCOMPARE(blob(S), 5);
+	QCOMPARE(blob(0xff), Autotiler::EIGHT_NEIGHBOUR_TILES - 1);
+	/* a corner only counts when both edges next to it do */
+	QCOMPARE(blob(NE), blob(0));
+	QCOMPARE(blob(N | NE), blob(N));
+	QVERIFY(blob(N | E | S | W | NE) != blob(N | E | S | W));
+	QCOMPARE(blob(S | SE | SW | NW), blob(S));
+	/* every one of the 256 masks picks one of the 47 tiles, and all of them are picked */
+	QVector<bool> picked(Autotiler::EIGHT_NEIGHBOUR_TILES);
+	for (int mask = 0; mask < 256; mask ++)
+		picked[blob(mask)] = true;
+	QVERIFY(!picked.contains(false));
+}
+
+void AutotilerTest::fourNeighbourMasks(void)
+{
+	Autotiler autotiler;
+	autotiler.rebuild(terrainTiles());
+	auto edges = [&] (int mask) { return autotiler.tile(EDGES, mask); };
+	QCOMPARE(edges(0), TileMap::tileIndex(0, 1));
+	QCOMPARE(edges(N), TileMap::tileIndex(1, 1));
+	QCOMPARE(edges(E), TileMap::tileIndex(2, 1));
+	QCOMPARE(edges(S), TileMap::tileIndex(4, 1));
+	QCOMPARE(edges(W), TileMap::tileIndex(8, 1));
+	QCOMPARE(edges(N | E | S | W), TileMap::tileIndex(15, 1));
+	/* corners do not matter */
+	QCOMPARE(edges(NE | SE | SW | NW | E), edges(E));
+}
+
+void AutotilerTest::fewerTiles(void)
+{
+	Autotiler autotiler;
+	autotiler.rebuild(terrainTiles());
+	for (int mask = 0; mask < 256; mask ++)
+		QCOMPARE(autotiler.tile(PLAIN, mask), TileMap::tileIndex(0, 2));
+}
+
+void AutotilerTest::retileCells(void)
+{
+	Autotiler autotiler;
+	autotiler.rebuild(terrainTiles());
+	auto edges = [&] (int mask) { return autotiler.tile(EDGES, mask); };
+	/* a plus of the edge terrain, in its layer, on a 5 by 5 map - the cells outside the map count as the same terrain */
+	TileMap map(5, 5);
+	for (int i = 0; i < 5; i ++)
+	{
+		map.setTile(EDGES_LAYER, 2, i, autotiler.tile(EDGES, 0));
+		map.setTile(EDGES_LAYER, i, 2, autotiler.tile(EDGES, 0));
+	}
+	/* terrain tiles in another layer than the one of their terrain do not count */
+	map.setTile(0, 3, 1, autotiler.tile(EDGES, 0));
+	auto changes = autotiler.retile(map, EDGES_LAYER, QRect(-3, -3, 20, 20));
+	QCOMPARE(changes.size(), 9);
+	auto retiled = map;
+	for (const auto & c : changes)
+		retiled.setTile(EDGES_LAYER, c.x, c.y, c.tile);
+	QCOMPARE(retiled.tile(EDGES_LAYER, 2, 2), edges(N | E | S | W));
+	QCOMPARE(retiled.tile(EDGES_LAYER, 2, 0), edges(N | S));
+	QCOMPARE(retiled.tile(EDGES_LAYER, 2, 1), edges(N | S));
+	QCOMPARE(retiled.tile(EDGES_LAYER, 0, 2), edges(E | W));
+	QCOMPARE(retiled.tile(EDGES_LAYER, 4, 2), edges(E | W));
+	/* only the cells asked for are retiled, and cells that already have their tile are left out */
+	map.setTile(EDGES_LAYER, 2, 1, edges(N | S));
+	changes = autotiler.retile(map, EDGES_LAYER, QRect(2, 0, 1, 2));
+	QCOMPARE(changes.size(), 1);
+	QCOMPARE(changes.first().x, 2);
+	QCOMPARE(changes.first().y, 0);
+	QVERIFY(autotiler.retile(map, EDGES_LAYER, QRect(0, 0, 1, 1)).isEmpty());
+	QVERIFY(autotiler.retile(map, BLOB_LAYER, QRect(0, 0, 5, 5)).isEmpty());
+}
+
+void AutotilerTest::retileLayer(void)
+{
+	Autotiler autotiler;
+	autotiler.rebuild(terrainTiles());
+	/* blobs of terrain across chunk borders, and cells of the other terrains between them */
+	TileMap map(70, 50);
+	for (int y = 0; y < map.height(); y ++)
+		for (int x = 0; x < map.width(); x ++)
+			if ((x * 7 + y * 3) % 11 < 6 || (x > 20 && x < 45 && y > 10 && y < 40))
+				map.setTile(BLOB_LAYER, x, y, autotiler.tile(BLOB, 0));
+			else if ((x + y) % 5 == 0)
+				map.setTile(BLOB_LAYER, x, y, autotiler.tile(PLAIN, 0));
+	auto retiled = map;
+	autotiler.retileLayer(retiled, BLOB_LAYER);
+	/* the whole layer at once picks the same tiles as cell by cell */
+	auto expected = map;
+	for (const auto & c : autotiler.retile(map, BLOB_LAYER, QRect(0, 0, map.width(), map.height())))
+		expected.setTile(BLOB_LAYER, c.x, c.y, c.tile);
+	QVERIFY(sameMap(retiled, expected));
+	QCOMPARE(retiled.tile(BLOB_LAYER, 30, 20), autotiler.tile(BLOB, 0xff));
+	/* a retiled layer does not change when it is retiled again */
+	QVERIFY(autotiler.retile(retiled, BLOB_LAYER, QRect(0, 0, map.width(), map.height())).isEmpty());
+}
+
+QTEST_GUILESS_MAIN(AutotilerTest)
+
+#include "autotilertest.moc"
@@ -0,0 +1,7 @@
+# painting the map with a multi-tile brush
+
+TARGET = BrushTest
+
+SOURCES += brushtest.cxx
+
+include(../tests.pri)
@@ -0,0 +1,158 @@
+#include <QtTest>
+
+#include "testmaps.hxx"
+#include "brush.hxx"
+
+/* stamps built from palette selections, painted with and without repeats, and along lines */
+
+static const TileIndex A = TileMap::tileIndex(3, 0), B = TileMap::tileIndex(4, 0), C = TileMap::tileIndex(5, 0), D = TileMap::tileIndex(2, 1);
+
+/* a stamp of three tiles over one, packed to the left: A B C / D - - ; B is painted in layer 2 */
+static Brush stamp(TileInfo & tileInfo)
+{
+	tileInfo.resize(8, 4);
+	tileInfo.setLayer(4, 0, 2);
+	Brush brush;
+	brush.setTiles(QVector<TileIndex>({ A, B, C, D, }), tileInfo);
+	return brush;
+}
+
+class BrushTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void emptyBrush(void);
+	void paintStamp(void);
+	void paintRepeats(void);
+	void patternFollowsOrigin(void);
+	void paintLine(void);
+};
+
+void BrushTest::emptyBrush(void)
+{
+	TileInfo tileInfo(8, 4);
+	TileMap map(10, 10);
+	EditHistory history(& map, & tileInfo);
+	Brush brush;
+	brush.setTiles(QVector<TileIndex>(), tileInfo);
+	QVERIFY(brush.isEmpty());
+	QVERIFY(brush.paint(history, map, QPoint(1, 1), QPoint(1, 1)).isEmpty());
+	QCOMPARE(history.commandCount(), 0);
+}
+
+void BrushTest::paintStamp(void)
+{
+	TileInfo tileInfo;
+	auto brush = stamp(tileInfo);
+	QCOMPARE(brush.width(), 3);
+	QCOMPARE(brush.height(), 2);
+	TileMap map(20, 20);
+	EditHistory history(& map, & tileInfo);
+	QCOMPARE(brush.paint(history, map, QPoint(5, 5), QPoint(5, 5)), QRect(5, 5, 3, 2));
+	QCOMPARE(map.tile(0, 5, 5), A);
+	QCOMPARE(map.tile(2, 6, 5), B);
+	QCOMPARE(map.tile(0, 6, 5), TileMap::NO_TILE);
+	QCOMPARE(map.tile(0, 7, 5), C);
+	QCOMPARE(map.tile(0, 5, 6), D);
+	/* the empty stamp cells leave the map alone */
+	for (int layer = 0; layer < MAP_LAYERS; layer ++)
+		QCOMPARE(map.tile(layer, 6, 6), TileMap::NO_TILE);
+	/* painting over the same tiles changes nothing, and records nothing */
+	QVERIFY(brush.paint(history, map, QPoint(5, 5), QPoint(5, 5)).isEmpty());
+	QCOMPARE(history.commandCount(), 1);
+	/* the stamp is clipped at the map edges */
+	QCOMPARE(brush.paint(history, map, QPoint(18, 18), QPoint(18, 18)), QRect(18, 18, 2, 2));
+	QCOMPARE(map.tile(2, 19, 18), B);
+	QCOMPARE(map.tile(0, 18, 19), D);
+	history.undo();
+	history.undo();
+	QVERIFY(sameMap(map, TileMap(20, 20)));
+}
+
+void BrushTest::paintRepeats(void)
+{
+	TileInfo tileInfo;
+	auto brush = stamp(tileInfo);
+	brush.setRepeat(2, 3);
+	QCOMPARE(brush.width(), 6);
+	QCOMPARE(brush.height(), 6);
+	TileMap map(20, 20);
+	EditHistory history(& map, & tileInfo);
+	QCOMPARE(brush.paint(history, map, QPoint(0, 0), QPoint(0, 0)), QRect(0, 0, 6, 6));
+	for (int y = 0; y < 6; y += 2)
+		for (int x = 0; x < 6; x += 3)
+		{
+			QCOMPARE(map.tile(0, x, y), A);
+			QCOMPARE(map.tile(2, x + 1, y), B);
+			QCOMPARE(map.tile(0, x + 2, y), C);
+			QCOMPARE(map.tile(0, x, y + 1), D);
+			QCOMPARE(map.tile(0, x + 1, y + 1), TileMap::NO_TILE);
+		}
+	QCOMPARE(map.tile(0, 6, 0), TileMap::NO_TILE);
+	QCOMPARE(map.tile(0, 0, 6), TileMap::NO_TILE);
+	/* repeats below one are painted once */
+	brush.setRepeat(0, -2);
+	QCOMPARE(brush.width(), 3);
+	QCOMPARE(brush.height(), 2);
+}
+
+void BrushTest::patternFollowsOrigin(void)
+{
+	TileInfo tileInfo;
+	auto brush = stamp(tileInfo);
+	TileMap map(20, 20);
+	EditHistory history(& map, & tileInfo);
+	/* a stamp painted a cell to the right of the stroke origin continues the pattern, rather than starting it again */
+	brush.paint(history, map, QPoint(1, 0), QPoint(0, 0));
+	QCOMPARE(map.tile(2, 1, 0), B);
+	QCOMPARE(map.tile(0, 2, 0), C);
+	QCOMPARE(map.tile(0, 3, 0), A);
+	QCOMPARE(map.tile(0, 1, 1), TileMap::NO_TILE);
+	QCOMPARE(map.tile(0, 3, 1), D);
+	/* and so does a stamp above and to the left of it */
+	map.clear();
+	brush.paint(history, map, QPoint(0, 0), QPoint(5, 5));
+	QCOMPARE(map.tile(0, 0, 0), TileMap::NO_TILE);
+	QCOMPARE(map.tile(0, 1, 0), TileMap::NO_TILE);
+	QCOMPARE(map.tile(0, 2, 0), D);
+	QCOMPARE(map.tile(2, 0, 1), B);
+	QCOMPARE(map.tile(0, 1, 1), C);
+	QCOMPARE(map.tile(0, 2, 1), A);
+}
+
+void BrushTest::paintLine(void)
+{
+	TileInfo tileInfo(8, 4);
+	Brush brush;
+	brush.setTiles(QVector<TileIndex>({ A, }), tileInfo);
+	TileMap map(20, 20);
+	EditHistory history(& map, & tileInfo);
+	auto changed = brush.paintLine(history, map, QPoint(2, 9), QPoint(8, 6), QPoint(2, 9));
+	/* every cell of the line but the first, one per column, without gaps, and the whole line is a single command */
+	QCOMPARE(map.tile(0, 2, 9), TileMap::NO_TILE);
+	QCOMPARE(history.commandCount(), 1);
+	QRect painted;
+	int lastY = 9;
+	for (int x = 3; x <= 8; x ++)
+	{
+		int count = 0;
+		for (int y = 0; y < map.height(); y ++)
+			if (map.tile(0, x, y) == A)
+			{
+				QVERIFY(std::abs(y - lastY) <= 1);
+				lastY = y, count ++;
+				painted |= QRect(x, y, 1, 1);
+			}
+		QCOMPARE(count, 1);
+	}
+	QCOMPARE(changed, painted);
+	QCOMPARE(map.tile(0, 8, 6), A);
+	/* a line that does not move paints nothing */
+	QVERIFY(brush.paintLine(history, map, QPoint(8, 6), QPoint(8, 6), QPoint(2, 9)).isEmpty());
+	history.undo();
+	QVERIFY(sameMap(map, TileMap(20, 20)));
+}
+
+QTEST_GUILESS_MAIN(BrushTest)
+
+#include "brushtest.moc"
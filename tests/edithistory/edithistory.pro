@@ -0,0 +1,7 @@
+# undo and redo of map and terrain edits
+
+TARGET = EditHistoryTest
+
+SOURCES += edithistorytest.cxx
+
+include(../tests.pri)
@@ -0,0 +1,169 @@
+#include <QtTest>
+
+#include "testmaps.hxx"
+#include "edithistory.hxx"
+
+/* the edit history on its own: undo and redo of every kind of edit, and the oldest commands dropped at capacity */
+
+class EditHistoryTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void undoRedoRoundTrip(void);
+	void undoEvictsOldestCommands(void);
+	void undoEvictsMapSnapshots(void);
+	void oversizedCommandClearsHistory(void);
+	void oversizedMapEditCanBeUndone(void);
+};
+
+void EditHistoryTest::undoRedoRoundTrip(void)
+{
+	TileMap map(70, 50);
+	TileInfo tileInfo(4, 4);
+	EditHistory history(& map, & tileInfo);
+	QVector<TileMap> maps { map };
+	QVector<qint32> terrains { tileInfo.terrain(1, 2) };
+	auto done = [&] { maps << map; terrains << tileInfo.terrain(1, 2); };
+
+	history.beginCommand();
+	for (int i = 0; i < 6; i ++)
+		history.setTile(i % MAP_LAYERS, 10 + i, 5, TileMap::tileIndex(i, 0));
+	/* a cell changed twice in one command is undone to its first tile */
+	history.setTile(0, 10, 5, TileMap::tileIndex(2, 2));
+	history.endCommand();
+	done();
+	history.setTiles(1, QRect(-5, 20, 40, 10), TileMap::tileIndex(1, 1));
+	done();
+	history.setTiles(1, QRect(3, 18, 10, 10), TileMap::tileIndex(2, 1));
+	done();
+	history.floodFill(1, 0, 22, TileMap::tileIndex(3, 3));
+	done();
+	history.setTerrain(1, 2, 5, 1);
+	done();
+	history.setMap(sampleMap(40, 40));
+	done();
+	history.floodFill(0, 0, 0, TileMap::tileIndex(0, 1));
+	done();
+	QCOMPARE(history.commandCount(), maps.size() - 1);
+
+	for (int i = maps.size() - 1; i > 0; i --)
+	{
+		QVERIFY(history.canUndo());
+		history.undo();
+		QVERIFY(sameMap(map, maps.at(i - 1)));
+		QCOMPARE(tileInfo.terrain(1, 2), terrains.at(i - 1));
+	}
+	QVERIFY(!history.canUndo());
+	for (int i = 1; i < maps.size(); i ++)
+	{
+		QVERIFY(history.canRedo());
+		history.redo();
+		QVERIFY(sameMap(map, maps.at(i)));
+		QCOMPARE(tileInfo.terrain(1, 2), terrains.at(i));
+	}
+	QVERIFY(!history.canRedo());
+
+	/* a new edit drops the commands that could be redone */
+	history.undo();
+	history.undo();
+	history.setTile(2, 1, 1, TileMap::tileIndex(1, 1));
+	QVERIFY(!history.canRedo());
+	QCOMPARE(history.commandCount(), maps.size() - 2);
+}
+
+void EditHistoryTest::undoEvictsOldestCommands(void)
+{
+	enum { CAPACITY = 256, EDITS = 100, };
+	TileMap map(64, 64);
+	TileInfo tileInfo(4, 4);
+	EditHistory history(& map, & tileInfo, CAPACITY);
+	for (int i = 0; i < EDITS; i ++)
+		history.setTile(0, i % 64, i / 64, TileMap::tileIndex(1, 0));
+	/* a single cell command takes five words */
+	QVERIFY(history.commandCount() > 0);
+	QVERIFY(history.commandCount() <= CAPACITY / 5);
+	int undone = 0;
+	while (history.canUndo())
+		history.undo(), undone ++;
+	QCOMPARE(undone, history.commandCount());
+	for (int i = 0; i < EDITS; i ++)
+		QCOMPARE(map.tile(0, i % 64, i / 64), i < EDITS - undone ? TileMap::tileIndex(1, 0) : TileMap::NO_TILE);
+	while (history.canRedo())
+		history.redo();
+	for (int i = 0; i < EDITS; i ++)
+		QCOMPARE(map.tile(0, i % 64, i / 64), TileMap::tileIndex(1, 0));
+}
+
+void EditHistoryTest::undoEvictsMapSnapshots(void)
+{
+	/* each map has a single chunk, a replacement costs the chunks of both maps */
+	enum { CAPACITY = 5 * TileMap::CHUNK_CELLS / 2, EDITS = 10, };
+	TileMap map(TileMap::CHUNK_SIZE, TileMap::CHUNK_SIZE);
+	TileInfo tileInfo(4, 4);
+	EditHistory history(& map, & tileInfo, CAPACITY);
+	for (int i = 0; i < EDITS; i ++)
+	{
+		TileMap replacement(map.width(), map.height());
+		replacement.setTile(0, 0, 0, TileMap::tileIndex(i, 0));
+		history.setMap(replacement);
+	}
+	QVERIFY(history.commandCount() >= 1);
+	QVERIFY(history.commandCount() <= 2);
+	int undone = 0;
+	while (history.canUndo())
+		history.undo(), undone ++;
+	QCOMPARE(map.tile(0, 0, 0), TileMap::tileIndex(EDITS - 1 - undone, 0));
+}
+
+void EditHistoryTest::oversizedCommandClearsHistory(void)
+{
+	TileMap map(64, 64);
+	TileInfo tileInfo(4, 4);
+	EditHistory history(& map, & tileInfo, 256);
+	history.setTile(0, 1, 1, TileMap::tileIndex(1, 0));
+	for (int y = 0; y < 20; y ++)
+		for (int x = 0; x < 20; x ++)
+			map.setTile(1, x, y, TileMap::tileIndex((x + y) % 3, 0));
+	/* the old tiles of the fill do not fit, so none of the older commands can be undone either */
+	history.clear();
+	history.setTile(0, 2, 2, TileMap::tileIndex(1, 0));
+	history.setTiles(1, QRect(0, 0, 20, 20), TileMap::tileIndex(2, 2));
+	QCOMPARE(map.tile(1, 19, 19), TileMap::tileIndex(2, 2));
+	QVERIFY(!history.canUndo());
+	QCOMPARE(history.commandCount(), 0);
+	/* a uniform fill of the same size takes a single record */
+	history.setTiles(1, QRect(0, 0, 20, 20), TileMap::tileIndex(1, 1));
+	QCOMPARE(history.commandCount(), 1);
+	history.undo();
+	QCOMPARE(map.tile(1, 19, 19), TileMap::tileIndex(2, 2));
+}
+
+void EditHistoryTest::oversizedMapEditCanBeUndone(void)
+{
+	/* a replacement of a map of many chunks takes up more words than the whole history */
+	TileMap map(4 * TileMap::CHUNK_SIZE, 4 * TileMap::CHUNK_SIZE);
+	TileInfo tileInfo(4, 4);
+	EditHistory history(& map, & tileInfo, TileMap::CHUNK_CELLS);
+	history.setTile(0, 1, 1, TileMap::tileIndex(1, 0));
+	auto before = map;
+	auto filled = map;
+	filled.fillLayer(1, TileMap::tileIndex(2, 0));
+	QVERIFY(history.dropsOlderCommands(filled));
+	QVERIFY(!history.dropsOlderCommands(map));
+	/* it drops the older commands, but is kept itself */
+	history.setMap(filled);
+	QCOMPARE(history.commandCount(), 1);
+	QVERIFY(history.canUndo());
+	history.undo();
+	QVERIFY(sameMap(map, before));
+	QVERIFY(!history.canUndo());
+	history.redo();
+	QVERIFY(sameMap(map, filled));
+	/* with nothing left to undo, nothing is dropped */
+	EditHistory empty(& map, & tileInfo, TileMap::CHUNK_CELLS);
+	QVERIFY(!empty.dropsOlderCommands(before));
+}
+
+QTEST_GUILESS_MAIN(EditHistoryTest)
+
+#include "edithistorytest.moc"
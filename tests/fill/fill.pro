@@ -0,0 +1,7 @@
+# rectangle and flood fills of map layers
+
+TARGET = FillTest
+
+SOURCES += filltest.cxx
+
+include(../tests.pri)
@@ -0,0 +1,194 @@
+#include <QtTest>
+
+#include "testmaps.hxx"
+#include "edithistory.hxx"
+
+/* rectangle and flood fills of a map layer, on the map itself and through the edit history */
+
+static const TileIndex WALL = TileMap::tileIndex(0, 1), PAINT = TileMap::tileIndex(2, 0);
+
+/* a layer of walls with a comb carved out of it: every even row is open, and on the odd rows only
+ * the even columns are, so the open cells are connected, and most rows have many runs */
+static TileMap combMap(int width, int height)
+{
+	TileMap map(width, height);
+	map.fillLayer(0, WALL);
+	for (int y = 0; y < height; y ++)
+		for (int x = 0; x < width; x ++)
+			if (!(y & 1) || !(x & 1))
+				map.setTile(0, x, y, TileMap::NO_TILE);
+	return map;
+}
+
+class FillTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void fillRect(void);
+	void fillRectSharesFullChunks(void);
+	void fillReversedRect(void);
+	void floodFill(void);
+	void floodFillStopsAtOtherTiles(void);
+	void undoFillRect(void);
+	void undoFloodFill(void);
+};
+
+void FillTest::fillRect(void)
+{
+	TileMap map(50, 40);
+	/* the part outside the map is dropped */
+	QCOMPARE(map.fillRect(1, QRect(-5, 30, 20, 20), PAINT), QRect(0, 30, 15, 10));
+	for (int y = 0; y < map.height(); y ++)
+		for (int x = 0; x < map.width(); x ++)
+			QCOMPARE(map.tile(1, x, y), (x < 15 && y >= 30) ? PAINT : TileMap::NO_TILE);
+	QVERIFY(map.fillRect(1, QRect(60, 0, 5, 5), PAINT).isEmpty());
+	QVERIFY(map.fillRect(MAP_LAYERS, QRect(0, 0, 5, 5), PAINT).isEmpty());
+	/* clearing a rectangle releases the chunks that are left empty */
+	map.fillRect(1, QRect(0, 0, 50, 40), TileMap::NO_TILE);
+	QCOMPARE(map.allocatedChunks(), 0);
+}
+
+void FillTest::fillRectSharesFullChunks(void)
+{
+	TileMap map(100, 70);
+	map.fillLayer(0, PAINT);
+	/* the chunks covered completely share their cells, the ones at the map edges have their own */
+	QCOMPARE(map.chunkCells(0, 0, 0), map.chunkCells(0, 2, 1));
+	QVERIFY(map.chunkCells(0, 3, 0) != map.chunkCells(0, 0, 0));
+	QVERIFY(map.chunkCells(0, 0, 2) != map.chunkCells(0, 0, 0));
+	/* a shared chunk is copied before a cell in it changes */
+	map.setTile(0, 40, 40, WALL);
+	QCOMPARE(map.tile(0, 40, 40), WALL);
+	QCOMPARE(map.tile(0, 8, 8), PAINT);
+	QCOMPARE(map.tile(0, 72, 40), PAINT);
+}
+
+void FillTest::fillReversedRect(void)
+{
+	/* drags that end left of or above the cell they started at, by one cell and by more */
+	QCOMPARE(TileMap::cellsBetween(QPoint(5, 5), QPoint(4, 5)), QRect(4, 5, 2, 1));
+	QCOMPARE(TileMap::cellsBetween(QPoint(5, 5), QPoint(5, 4)), QRect(5, 4, 1, 2));
+	QCOMPARE(TileMap::cellsBetween(QPoint(5, 2), QPoint(2, 7)), QRect(2, 2, 4, 6));
+	QCOMPARE(TileMap::cellsBetween(QPoint(3, 3), QPoint(3, 3)), QRect(3, 3, 1, 1));
+	TileMap map(20, 20);
+	TileInfo tileInfo(4, 4);
+	EditHistory history(& map, & tileInfo);
+	QCOMPARE(history.setTiles(0, TileMap::cellsBetween(QPoint(9, 8), QPoint(3, 2)), PAINT), QRect(3, 2, 7, 7));
+	QCOMPARE(history.setTiles(1, TileMap::cellsBetween(QPoint(12, 6), QPoint(11, 6)), PAINT), QRect(11, 6, 2, 1));
+	for (int y = 0; y < map.height(); y ++)
+		for (int x = 0; x < map.width(); x ++)
+		{
+			QCOMPARE(map.tile(0, x, y), (x >= 3 && x <= 9 && y >= 2 && y <= 8) ? PAINT : TileMap::NO_TILE);
+			QCOMPARE(map.tile(1, x, y), ((x == 11 || x == 12) && y == 6) ? PAINT : TileMap::NO_TILE);
+		}
+}
+
+void FillTest::floodFill(void)
+{
+	auto map = combMap(70, 45);
+	QVector<QRect> spans;
+	QCOMPARE(map.floodFill(0, 4, 4, PAINT, & spans), QRect(0, 0, 70, 45));
+	int count = 0;
+	for (int y = 0; y < map.height(); y ++)
+		for (int x = 0; x < map.width(); x ++)
+		{
+			bool isOpen = !(y & 1) || !(x & 1);
+			QCOMPARE(map.tile(0, x, y), isOpen ? PAINT : WALL);
+			count += isOpen;
+		}
+	/* the spans are single rows, and cover every filled cell once */
+	int covered = 0;
+	for (const auto & span : spans)
+	{
+		QCOMPARE(span.height(), 1);
+		covered += span.width();
+		for (int x = span.left(); x <= span.right(); x ++)
+			QCOMPARE(map.tile(0, x, span.y()), PAINT);
+	}
+	QCOMPARE(covered, count);
+	/* filling with the tile that is already there changes nothing */
+	spans.clear();
+	QVERIFY(map.floodFill(0, 4, 4, PAINT, & spans).isEmpty());
+	QVERIFY(spans.isEmpty());
+	QVERIFY(map.floodFill(0, -1, 4, WALL).isEmpty());
+}
+
+void FillTest::floodFillStopsAtOtherTiles(void)
+{
+	/* a ring of walls across a chunk border, with a diagonal gap that does not connect the inside to the outside */
+	TileMap map(64, 64);
+	map.fillRect(0, QRect(28, 28, 8, 1), WALL);
+	map.fillRect(0, QRect(28, 35, 8, 1), WALL);
+	map.fillRect(0, QRect(28, 28, 1, 8), WALL);
+	map.fillRect(0, QRect(35, 28, 1, 7), WALL);
+	map.setTile(0, 35, 35, TileMap::NO_TILE);
+	map.setTile(1, 30, 30, WALL);
+	QCOMPARE(map.floodFill(0, 31, 31, PAINT), QRect(29, 29, 6, 6));
+	for (int y = 0; y < map.height(); y ++)
+		for (int x = 0; x < map.width(); x ++)
+			if (QRect(29, 29, 6, 6).contains(x, y))
+				QCOMPARE(map.tile(0, x, y), PAINT);
+			else
+				QVERIFY(map.tile(0, x, y) != PAINT);
+	/* the other layers are left alone */
+	QCOMPARE(map.tile(1, 30, 30), WALL);
+	QCOMPARE(map.tile(1, 31, 31), TileMap::NO_TILE);
+}
+
+void FillTest::undoFillRect(void)
+{
+	auto map = sampleMap(80, 60);
+	TileInfo tileInfo(4, 4);
+	EditHistory history(& map, & tileInfo);
+	auto before = map;
+	/* over tiles that differ, and then over a rectangle of the same tile */
+	QCOMPARE(history.setTiles(1, QRect(5, 20, 60, 30), PAINT), QRect(5, 20, 60, 30));
+	auto filled = map;
+	QCOMPARE(history.setTiles(1, QRect(10, 25, 20, 20), WALL), QRect(10, 25, 20, 20));
+	auto refilled = map;
+	/* a fill that changes nothing is not a command */
+	history.setTiles(1, QRect(10, 25, 5, 5), WALL);
+	QCOMPARE(history.commandCount(), 2);
+	history.undo();
+	QVERIFY(sameMap(map, filled));
+	history.undo();
+	QVERIFY(sameMap(map, before));
+	history.redo();
+	history.redo();
+	QVERIFY(sameMap(map, refilled));
+}
+
+void FillTest::undoFloodFill(void)
+{
+	auto map = combMap(100, 90);
+	map.setTile(1, 3, 3, WALL);
+	TileInfo tileInfo(4, 4);
+	EditHistory history(& map, & tileInfo);
+	auto before = map;
+	history.floodFill(0, 0, 0, PAINT);
+	auto comb = map;
+	/* a fill of a whole empty layer */
+	history.floodFill(2, 50, 50, PAINT);
+	auto filled = map;
+	QCOMPARE(history.commandCount(), 2);
+	history.undo();
+	QVERIFY(sameMap(map, comb));
+	history.undo();
+	QVERIFY(sameMap(map, before));
+	QVERIFY(!history.canUndo());
+	history.redo();
+	history.redo();
+	QVERIFY(sameMap(map, filled));
+	/* a fill inside a command of its own is recorded with the rest of it */
+	history.beginCommand();
+	history.setTile(1, 0, 0, WALL);
+	history.floodFill(0, 0, 0, WALL);
+	history.endCommand();
+	QCOMPARE(history.commandCount(), 3);
+	history.undo();
+	QVERIFY(sameMap(map, filled));
+}
+
+QTEST_GUILESS_MAIN(FillTest)
+
+#include "filltest.moc"
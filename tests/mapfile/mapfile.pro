@@ -0,0 +1,7 @@
+# the binary and json map file formats
+
+TARGET = MapFileTest
+
+SOURCES += mapfiletest.cxx
+
+include(../tests.pri)
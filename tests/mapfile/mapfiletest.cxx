@@ -0,0 +1,75 @@
+#include <QtTest>
+#include <QBuffer>
+#include <QTemporaryDir>
+#include <QJsonDocument>
+
+#include "testmaps.hxx"
+
+/* the binary and json map formats, written to memory and to files, and read back */
+
+class MapFileTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void binaryMapRoundTrip(void);
+	void jsonMapRoundTrip(void);
+	void mapFileRoundTrip(void);
+};
+
+void MapFileTest::binaryMapRoundTrip(void)
+{
+	auto map = sampleMap(100, 70);
+	for (bool compress : { false, true, })
+	{
+		QBuffer buffer;
+		buffer.open(QIODevice::WriteOnly);
+		QVERIFY(map.writeBinary(buffer, compress));
+		TileMap read;
+		QVERIFY(read.readBinary(reinterpret_cast<const uchar *>(buffer.data().constData()), buffer.data().size()));
+		QVERIFY(sameMap(map, read));
+		/* truncated files are rejected */
+		QVERIFY(!read.readBinary(reinterpret_cast<const uchar *>(buffer.data().constData()), buffer.data().size() - 4));
+	}
+}
+
+void MapFileTest::jsonMapRoundTrip(void)
+{
+	auto map = sampleMap(50, 45);
+	QJsonObject json;
+	map.writeJson(json);
+	TileMap read;
+	QVERIFY(read.readJson(json));
+	QVERIFY(sameMap(map, read));
+
+	/* the streamed json is the same map */
+	QBuffer buffer;
+	buffer.open(QIODevice::WriteOnly);
+	QVERIFY(map.writeJson(buffer));
+	QJsonParseError error;
+	auto document = QJsonDocument::fromJson(buffer.data(), & error);
+	QCOMPARE(error.error, QJsonParseError::NoError);
+	TileMap streamed;
+	QVERIFY(streamed.readJson(document.object()));
+	QVERIFY(sameMap(map, streamed));
+}
+
+void MapFileTest::mapFileRoundTrip(void)
+{
+	QTemporaryDir directory;
+	QVERIFY(directory.isValid());
+	auto map = sampleMap(33, 65);
+	for (auto name : { "map.json", "map.tmap", })
+	{
+		auto fileName = directory.filePath(name);
+		QVERIFY(map.save(fileName));
+		TileMap read;
+		QVERIFY(read.load(fileName));
+		QVERIFY(sameMap(map, read));
+	}
+	QVERIFY(TileMap::isBinaryFileName("map.tmap"));
+	QVERIFY(!TileMap::isBinaryFileName("map.json"));
+}
+
+QTEST_GUILESS_MAIN(MapFileTest)
+
+#include "mapfiletest.moc"
@@ -0,0 +1,7 @@
+# packs of maps baked for the game runtime
+
+TARGET = MapPackTest
+
+SOURCES += mappacktest.cxx
+
+include(../tests.pri)
@@ -0,0 +1,86 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <QImage>
+#include <QCryptographicHash>
+
+#include "mappack.hxx"
+
+/* the layout of a map pack file, and the hash of the inputs it was baked from */
+
+class MapPackTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void mapPackHeader(void);
+};
+
+void MapPackTest::mapPackHeader(void)
+{
+	enum { TILE_SIZE = 8, };
+	/* four by two tiles, each of its own colour */
+	QImage tileSet(4 * TILE_SIZE, 2 * TILE_SIZE, QImage::Format_ARGB32);
+	for (int y = 0; y < tileSet.height(); y ++)
+		for (int x = 0; x < tileSet.width(); x ++)
+			tileSet.setPixel(x, y, qRgb(x / TILE_SIZE * 60, y / TILE_SIZE * 200, 10));
+	TileInfo::terrainNames() = QStringList({ "grass", "solid", });
+	TileInfo tileInfo(4, 2);
+	tileInfo.setTerrain(3, 1, 2);
+	TileMap map(40, 40);
+	map.fillRect(0, QRect(0, 0, 40, 40), TileMap::tileIndex(3, 1));
+	map.setTile(1, 5, 5, TileMap::tileIndex(1, 0));
+	/* tiles outside the tile set are not packed */
+	map.setTile(1, 6, 5, TileMap::tileIndex(9, 9));
+	QCOMPARE(MapPack::usedTiles(map, 4, 2), QVector<TileIndex>({ TileMap::tileIndex(1, 0), TileMap::tileIndex(3, 1), }));
+
+	MapPack::Settings settings;
+	settings.tileWidth = settings.tileHeight = TILE_SIZE;
+	settings.solidTerrain = 2;
+	auto hash = QCryptographicHash::hash("inputs", QCryptographicHash::Sha1);
+	QTemporaryDir directory;
+	QVERIFY(directory.isValid());
+	auto fileName = directory.filePath("map.tpak");
+	QVERIFY(MapPack::save(fileName, map, tileSet, tileInfo, settings, hash));
+	QCOMPARE(MapPack::inputHash(fileName), hash);
+	QVERIFY(MapPack::inputHash(directory.filePath("missing.tpak")).isEmpty());
+	/* a wrong hash size is refused */
+	QVERIFY(!MapPack::save(directory.filePath("bad.tpak"), map, tileSet, tileInfo, settings, QByteArray("short")));
+
+	QFile f(fileName);
+	QVERIFY(f.open(QIODevice::ReadOnly));
+	auto data = f.readAll();
+	auto word = [&] (int i) { return qFromLittleEndian<quint32>(data.constData() + i * sizeof(quint32)); };
+	QVERIFY(data.size() >= MapPack::HEADER_WORDS * int(sizeof(quint32)));
+	QCOMPARE(data.size() % 4, 0);
+	QCOMPARE(word(0), quint32(MapPack::PACK_FILE_MAGIC));
+	QCOMPARE(data.left(4), QByteArray("TPAK"));
+	QCOMPARE(word(1), quint32(MapPack::PACK_FILE_VERSION));
+	QCOMPARE(data.mid(2 * sizeof(quint32), MapPack::INPUT_HASH_WORDS * sizeof(quint32)), hash);
+	int i = 2 + MapPack::INPUT_HASH_WORDS;
+	QCOMPARE(word(i ++), quint32(TILE_SIZE));
+	QCOMPARE(word(i ++), quint32(TILE_SIZE));
+	QCOMPARE(word(i ++), quint32(2));
+	auto columns = word(i ++);
+	QCOMPARE(columns, quint32(2));
+	QCOMPARE(word(i ++), quint32(2));
+	auto mapBytes = word(i ++), atlasBytes = word(i ++);
+	QCOMPARE(i, int(MapPack::HEADER_WORDS));
+	/* the terrains of the packed tiles */
+	QCOMPARE(word(i ++), quint32(0));
+	QCOMPARE(word(i ++), quint32(2));
+
+	TileMap packed;
+	QVERIFY(packed.readBinary(reinterpret_cast<const uchar *>(data.constData()) + i * sizeof(quint32), mapBytes));
+	QCOMPARE(packed.width(), 40);
+	QCOMPARE(packed.tile(0, 0, 0), TileIndex(1));
+	QCOMPARE(packed.tile(1, 5, 5), TileIndex(0));
+	QCOMPARE(packed.tile(1, 6, 5), TileMap::NO_TILE);
+	auto atlas = QImage::fromData(data.mid(i * sizeof(quint32) + mapBytes, atlasBytes), "png");
+	QCOMPARE(atlas.size(), QSize(2 * TILE_SIZE, TILE_SIZE));
+	QCOMPARE(atlas.pixel(0, 0), tileSet.pixel(1 * TILE_SIZE, 0));
+	QCOMPARE(atlas.pixel(TILE_SIZE, 0), tileSet.pixel(3 * TILE_SIZE, TILE_SIZE));
+}
+
+QTEST_GUILESS_MAIN(MapPackTest)
+
+#include "mappacktest.moc"
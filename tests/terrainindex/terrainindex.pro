@@ -0,0 +1,7 @@
+# the index of tiles by terrain
+
+TARGET = TerrainIndexTest
+
+SOURCES += terrainindextest.cxx
+
+include(../tests.pri)
@@ -0,0 +1,91 @@
+#include <QtTest>
+
+#include "terrainindex.hxx"
+
+/* the terrain queries of the index, checked against a scan of the tile information */
+
+static QVector<TileIndex> scan(const TileInfo & tileInfo, qint32 terrain, bool exactMatch)
+{
+	QVector<TileIndex> tiles;
+	for (int y = 0; y < tileInfo.height(); y ++)
+		for (int x = 0; x < tileInfo.width(); x ++)
+			if (exactMatch ? tileInfo.terrain(x, y) == terrain : bool(tileInfo.terrain(x, y) & terrain))
+				tiles << TileMap::tileIndex(x, y);
+	return tiles;
+}
+
+/* a tile set whose tile count is not a multiple of the bitset words, with a few terrains on each tile */
+static TileInfo terrainTiles(void)
+{
+	TileInfo tileInfo(13, 11);
+	for (int y = 0; y < tileInfo.height(); y ++)
+		for (int x = 0; x < tileInfo.width(); x ++)
+			tileInfo.setTerrain(x, y, ((x * 5 + y * 3) % 7) | (x == y ? 1 << 31 : 0) | ((x + y) % 4 ? 0 : 1 << 9));
+	return tileInfo;
+}
+
+class TerrainIndexTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void query(void);
+	void setTerrain(void);
+	void removeTerrain(void);
+};
+
+void TerrainIndexTest::query(void)
+{
+	auto tileInfo = terrainTiles();
+	TerrainIndex index;
+	index.rebuild(tileInfo);
+	for (qint32 terrain : { 0, 1, 2, 3, 5, 7, 1 << 9, (1 << 9) | 2, qint32(1u << 31), qint32((1u << 31) | 4), 1 << 20, (1 << 20) | 1, })
+		for (bool exactMatch : { false, true, })
+		{
+			auto tiles = scan(tileInfo, terrain, exactMatch);
+			auto result = index.query(terrain, exactMatch);
+			QCOMPARE(index.tiles(result), tiles);
+			QCOMPARE(index.tileCount(result), tiles.size());
+		}
+	/* tiles with terrains from the tenth one up */
+	QCOMPARE(index.tiles(index.tilesWithTerrainsFrom(9)), scan(tileInfo, ~ ((1 << 9) - 1), false));
+	QVERIFY(index.tiles(index.tilesWithTerrainsFrom(10)) != index.tiles(index.tilesWithTerrainsFrom(9)));
+}
+
+void TerrainIndexTest::setTerrain(void)
+{
+	auto tileInfo = terrainTiles();
+	TerrainIndex index;
+	index.rebuild(tileInfo);
+	/* a terrain that no tile had, and the last tile of the last bitset word */
+	for (auto change : { QPoint(4, 2), QPoint(12, 10), QPoint(0, 0), })
+	{
+		auto terrain = tileInfo.terrain(change.x(), change.y()) ^ ((1 << 20) | 2);
+		index.setTerrain(change.x(), change.y(), tileInfo.terrain(change.x(), change.y()), terrain);
+		tileInfo.setTerrain(change.x(), change.y(), terrain);
+	}
+	/* tiles outside the tile set are ignored */
+	index.setTerrain(13, 0, 0, 1);
+	index.setTerrain(-1, 0, 0, 1);
+	for (qint32 terrain : { 0, 1, 2, 1 << 20, (1 << 20) | 2, (1 << 20) | 3, })
+		for (bool exactMatch : { false, true, })
+			QCOMPARE(index.tiles(index.query(terrain, exactMatch)), scan(tileInfo, terrain, exactMatch));
+}
+
+void TerrainIndexTest::removeTerrain(void)
+{
+	auto tileInfo = terrainTiles();
+	TerrainIndex index;
+	index.rebuild(tileInfo);
+	/* the terrains above the removed one move down, in the index as in the tile information */
+	for (int y = 0; y < tileInfo.height(); y ++)
+		for (int x = 0; x < tileInfo.width(); x ++)
+			tileInfo.removeTerrain(x, y, 1);
+	index.removeTerrain(1);
+	for (qint32 terrain : { 0, 1, 2, 3, 1 << 8, (1 << 8) | 1, 1 << 30, 1 << 31, })
+		for (bool exactMatch : { false, true, })
+			QCOMPARE(index.tiles(index.query(terrain, exactMatch)), scan(tileInfo, terrain, exactMatch));
+}
+
+QTEST_GUILESS_MAIN(TerrainIndexTest)
+
+#include "terrainindextest.moc"
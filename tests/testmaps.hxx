@@ -0,0 +1,31 @@
+#ifndef TESTMAPS_HXX
+#define TESTMAPS_HXX
+
+#include "tilemap.hxx"
+
+/* maps shared by the model tests */
+
+inline bool sameMap(const TileMap & a, const TileMap & b)
+{
+	if (a.width() != b.width() || a.height() != b.height())
+		return false;
+	for (int layer = 0; layer < MAP_LAYERS; layer ++)
+		for (int y = 0; y < a.height(); y ++)
+			for (int x = 0; x < a.width(); x ++)
+				if (a.tile(layer, x, y) != b.tile(layer, x, y))
+					return false;
+	return true;
+}
+
+/* a map with runs of tiles, scattered tiles, and empty chunks */
+inline TileMap sampleMap(int width, int height)
+{
+	TileMap map(width, height);
+	map.fillRect(0, QRect(0, 0, width, height / 2), TileMap::tileIndex(1, 0));
+	for (int i = 0; i < width * height / 7; i ++)
+		map.setTile(1, i * 13 % width, i * 7 % height, TileMap::tileIndex(i % 5, i % 3));
+	map.setTile(MAP_LAYERS - 1, width - 1, height - 1, TileMap::tileIndex(3, 1));
+	return map;
+}
+
+#endif // TESTMAPS_HXX
@@ -0,0 +1,13 @@
+# the settings shared by the model test programs, which are built from the model alone
+
+QT       += core gui concurrent testlib
+QT       -= widgets
+
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD
+HEADERS += $$PWD/testmaps.hxx
+
+include(../model.pri)
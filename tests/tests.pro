@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# unit tests of the map and tile set model, a test program
+# for every part of it, run them all with 'make check'
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += edithistory \
+        mapfile \
+        tileinfo \
+        mappack \
+        fill \
+        autotiler \
+        brush \
+        terrainindex \
+        tileset
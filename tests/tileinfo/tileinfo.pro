@@ -0,0 +1,7 @@
+# the tile information file formats
+
+TARGET = TileInfoTest
+
+SOURCES += tileinfotest.cxx
+
+include(../tests.pri)
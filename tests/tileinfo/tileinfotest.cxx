@@ -0,0 +1,75 @@
+#include <QtTest>
+#include <QBuffer>
+#include <QJsonDocument>
+
+#include "tileinfo.hxx"
+
+/* reading the tile information files of the first versions of the editor, and of the current one */
+
+class TileInfoTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void legacyTileInfo(void);
+	void tileInfoRoundTrip(void);
+};
+
+void TileInfoTest::legacyTileInfo(void)
+{
+	/* as written by the first versions of the editor, an object for every tile */
+	auto json = QJsonDocument::fromJson(R"({
+		"tiles-x": 2, "tiles-y": 2,
+		"terrains": [ { "name": "grass" }, { "name": "solid" } ],
+		"tiles": [
+			{ "terrain": 1, "name": "meadow", "x": 0, "y": 0, "layer": 0 },
+			{ "terrain": 6, "name": "wall", "x": 1, "y": 0, "layer": 2 },
+			{ "terrain": 0, "name": "unassigned", "x": 0, "y": 1, "layer": 1 },
+			{ }
+		]
+	})").object();
+	TileInfo::terrainNames() = TileInfo::readTerrainNames(json);
+	QCOMPARE(TileInfo::terrainNames(), QStringList({ "grass", "solid", }));
+	TileInfo tileInfo;
+	QVERIFY(tileInfo.readJson(json));
+	QCOMPARE(tileInfo.width(), 2);
+	QCOMPARE(tileInfo.height(), 2);
+	QCOMPARE(tileInfo.terrain(0, 0), 1);
+	QCOMPARE(tileInfo.name(0, 0), QString("meadow"));
+	/* the bits above the known terrains are dropped */
+	QCOMPARE(tileInfo.terrain(1, 0), 2);
+	QCOMPARE(tileInfo.layer(1, 0), 2);
+	QCOMPARE(tileInfo.name(1, 0), QString("wall"));
+	QCOMPARE(tileInfo.layer(0, 1), 1);
+	/* a tile without fields has all the known terrains */
+	QCOMPARE(tileInfo.terrain(1, 1), 3);
+	QCOMPARE(tileInfo.name(1, 1), TileInfo::defaultName());
+}
+
+void TileInfoTest::tileInfoRoundTrip(void)
+{
+	TileInfo::terrainNames() = QStringList({ "grass", "water", "solid", });
+	TileInfo tileInfo(5, 3);
+	tileInfo.setTerrain(0, 0, 1);
+	tileInfo.setTerrain(4, 2, 6);
+	tileInfo.setLayer(4, 2, 3);
+	tileInfo.setName(2, 1, "bridge");
+	tileInfo.setName(3, 1, "bridge");
+	QBuffer buffer;
+	buffer.open(QIODevice::WriteOnly);
+	QVERIFY(tileInfo.writeJson(buffer, TileInfo::terrainNames()));
+	auto json = QJsonDocument::fromJson(buffer.data()).object();
+	QCOMPARE(TileInfo::readTerrainNames(json), TileInfo::terrainNames());
+	TileInfo read;
+	QVERIFY(read.readJson(json));
+	for (int y = 0; y < 3; y ++)
+		for (int x = 0; x < 5; x ++)
+		{
+			QCOMPARE(read.terrain(x, y), tileInfo.terrain(x, y));
+			QCOMPARE(read.layer(x, y), tileInfo.layer(x, y));
+			QCOMPARE(read.name(x, y), tileInfo.name(x, y));
+		}
+}
+
+QTEST_GUILESS_MAIN(TileInfoTest)
+
+#include "tileinfotest.moc"
@@ -0,0 +1,7 @@
+# the tile set indices that are updated a tile at a time
+
+TARGET = TileSetTest
+
+SOURCES += tilesettest.cxx
+
+include(../tests.pri)
@@ -0,0 +1,88 @@
+#include <QtTest>
+
+#include "tileslicer.hxx"
+#include "mipchain.hxx"
+
+/* the duplicate tile index and the mip chain of a tile set, updated after single tiles change, checked against rebuilt ones */
+
+enum
+{
+	TILE_SIZE = 4, COLUMNS = 6, ROWS = 5,
+};
+
+/* paints a tile in one of a few patterns, so that some of the tiles are copies of each other */
+static void paintTile(QImage & image, int x, int y, int pattern)
+{
+	for (int py = 0; py < TILE_SIZE; py ++)
+		for (int px = 0; px < TILE_SIZE; px ++)
+			image.setPixel(x * TILE_SIZE + px, y * TILE_SIZE + py, qRgba(pattern * 40, (px + py * pattern) * 16, 255 - pattern * 30, 255));
+}
+
+static QImage sheet(void)
+{
+	QImage image(COLUMNS * TILE_SIZE, ROWS * TILE_SIZE, QImage::Format_ARGB32);
+	for (int y = 0; y < ROWS; y ++)
+		for (int x = 0; x < COLUMNS; x ++)
+			paintTile(image, x, y, (x * 3 + y) % 5);
+	return image;
+}
+
+/* the same tiles are grouped together, with the same first copy standing for each group, whatever the ids are */
+static bool sameIndex(const TileSlicer::Index & a, const TileSlicer::Index & b)
+{
+	if (a.columns != b.columns || a.rows != b.rows || a.uniqueTiles.size() != b.uniqueTiles.size() || a.hashes != b.hashes)
+		return false;
+	for (int y = 0; y < a.rows; y ++)
+		for (int x = 0; x < a.columns; x ++)
+			if (a.canonicalTile(x, y) != b.canonicalTile(x, y))
+				return false;
+	return true;
+}
+
+class TileSetTest : public QObject
+{
+	Q_OBJECT
+private slots:
+	void updateIndex(void);
+	void updateMipChain(void);
+};
+
+void TileSetTest::updateIndex(void)
+{
+	auto image = sheet();
+	auto index = TileSlicer::index(image, TILE_SIZE, TILE_SIZE);
+	QCOMPARE(index.uniqueTiles.size(), 5);
+	/* the first copy of a tile, which then moves on to the next one, a tile without copies, whose id is given away,
+	 * a tile that becomes a copy of an earlier one, one that becomes the first copy of a later one, and a new tile */
+	struct { int x, y, pattern; } changes[] = { { 0, 0, 2 }, { 1, 0, 7 }, { 1, 0, 1 }, { 5, 4, 0 }, { 0, 0, 3 }, { 2, 3, 9 }, { 2, 3, 9 }, };
+	for (const auto & c : changes)
+	{
+		paintTile(image, c.x, c.y, c.pattern);
+		TileSlicer::updateTile(index, image, TILE_SIZE, TILE_SIZE, c.x, c.y);
+		QVERIFY(sameIndex(index, TileSlicer::index(image, TILE_SIZE, TILE_SIZE)));
+	}
+	/* tiles outside the grid are left alone */
+	TileSlicer::updateTile(index, image, TILE_SIZE, TILE_SIZE, COLUMNS, 0);
+	QVERIFY(sameIndex(index, TileSlicer::index(image, TILE_SIZE, TILE_SIZE)));
+}
+
+void TileSetTest::updateMipChain(void)
+{
+	auto image = sheet();
+	TileSetMipChain chain;
+	chain.build(image, TILE_SIZE, TILE_SIZE);
+	QCOMPARE(chain.levelCount(), 3);
+	/* level 0 is the atlas, which is not kept */
+	QVERIFY(chain.level(0).isNull());
+	paintTile(image, 4, 3, 7);
+	chain.updateTile(image.copy(4 * TILE_SIZE, 3 * TILE_SIZE, TILE_SIZE, TILE_SIZE), 4, 3);
+	TileSetMipChain rebuilt;
+	rebuilt.build(image, TILE_SIZE, TILE_SIZE);
+	for (int level = 1; level < chain.levelCount(); level ++)
+		QCOMPARE(chain.level(level), rebuilt.level(level));
+	QCOMPARE(chain.tileColours(), rebuilt.tileColours());
+}
+
+QTEST_GUILESS_MAIN(TileSetTest)
+
+#include "tilesettest.moc"
@@ -0,0 +1,155 @@
+#include "tileinfo.hxx"
+
+QStringList TileInfo::terrainTypeNames;
+
+static void appendJsonString(QByteArray & json, const QString & string)
+{
+	json += '"';
+	for (auto c : string.toUtf8())
+		switch (c)
+		{
+		case '"': json += "\\\""; break;
+		case '\\': json += "\\\\"; break;
+		case '\n': json += "\\n"; break;
+		case '\r': json += "\\r"; break;
+		case '\t': json += "\\t"; break;
+		default:
+			if (uchar(c) < 0x20)
+				json += QString("\\u%1").arg(int(c), 4, 16, QChar('0')).toLatin1();
+			else
+				json += c;
+			break;
+		}
+	json += '"';
+}
+
+void TileInfo::resize(int columns, int rows)
+{
+	this->columns = std::max(columns, 0);
+	this->rows = std::max(rows, 0);
+	int count = this->columns * this->rows;
+	terrainBitmaps.fill(0, count);
+	layers.fill(0, count);
+	nameIds.fill(0, count);
+	names = QStringList(defaultName());
+	nameIndex.clear();
+	nameIndex.insert(defaultName(), 0);
+}
+
+quint32 TileInfo::intern(const QString & name)
+{
+	auto i = nameIndex.constFind(name);
+	if (i != nameIndex.constEnd())
+		return * i;
+	names << name;
+	nameIndex.insert(name, names.size() - 1);
+	return names.size() - 1;
+}
+
+static qint32 terrainMask(int terrainCount)
+{
+	return terrainCount >= 32 ? -1 : (1 << terrainCount) - 1;
+}
+
+bool TileInfo::readLegacyJson(const QJsonObject & json)
+{
+	auto mask = terrainMask(terrainTypeNames.size());
+	int i = 0;
+	/* the tile positions in the file are not used, tiles are laid out by their order alone */
+	for (auto t : json["tiles"].toArray())
+	{
+		if (i >= columns * rows)
+			break;
+		auto tile = t.toObject();
+		terrainBitmaps[i] = tile["terrain"].toInt(-1) & mask;
+		nameIds[i] = intern(tile["name"].toString(defaultName()));
+		layers[i] = tile["layer"].toInt(0);
+		i ++;
+	}
+	return true;
+}
+
+QStringList TileInfo::readTerrainNames(const QJsonObject & json)
+{
+	QStringList names;
+	for (auto t : json["terrains"].toArray())
+		names << t.toObject()["name"].toString();
+	return names;
+}
+
+bool TileInfo::readJson(const QJsonObject & json)
+{
+	int x = json["tiles-x"].toInt(), y = json["tiles-y"].toInt();
+	if (x < 0 || y < 0 || qint64(x) * y > MAX_FILE_TILES)
+		return false;
+	resize(x, y);
+	if (json["version"].toInt(1) < 2)
+		return readLegacyJson(json);
+	auto mask = terrainMask(terrainTypeNames.size());
+	/* the name numbers in a file are its own, they are interned again here */
+	QVector<quint32> fileNameIds;
+	for (auto name : json["names"].toArray())
+		fileNameIds << intern(name.toString());
+	for (auto t : json["tiles"].toArray())
+	{
+		auto tile = t.toArray();
+		int i = tile.at(0).toInt(-1), name = tile.at(3).toInt(0);
+		if (tile.size() < 4 || i < 0 || i >= columns * rows)
+			return false;
+		terrainBitmaps[i] = tile.at(1).toInt() & mask;
+		layers[i] = tile.at(2).toInt();
+		nameIds[i] = name > 0 && name < fileNameIds.size() ? fileNameIds.at(name) : 0;
+	}
+	return true;
+}
+
+bool TileInfo::writeJson(QIODevice & device, const QStringList & terrainNames) const
+{
+	enum { FLUSH_SIZE = 1 << 16, };
+	QByteArray json;
+	const char * separator = "\n";
+	auto flush = [&] (void) -> bool { bool result = device.write(json) == json.size(); json.clear(); return result; };
+	/* only the names that are in use are written, numbered in the order of their first use */
+	QVector<int> fileNameIds(names.size(), -1);
+	QStringList fileNames(defaultName());
+	fileNameIds[0] = 0;
+	for (int i = 0; i < nameIds.size(); i ++)
+		if (fileNameIds.at(nameIds.at(i)) == -1)
+		{
+			fileNameIds[nameIds.at(i)] = fileNames.size();
+			fileNames << names.at(nameIds.at(i));
+		}
+
+	json += "{\n\"version\": " + QByteArray::number(int(FILE_VERSION)) + ",\n\"terrains\": [";
+	for (const auto & t : terrainNames)
+	{
+		json += separator;
+		json += "{\"name\": ";
+		appendJsonString(json, t);
+		json += "}";
+		separator = ",\n";
+	}
+	json += "\n],\n\"names\": [";
+	separator = "\n";
+	for (const auto & name : fileNames)
+	{
+		json += separator;
+		appendJsonString(json, name);
+		separator = ",\n";
+	}
+	json += "\n],\n\"tiles-x\": " + QByteArray::number(columns) + ",\n\"tiles-y\": " + QByteArray::number(rows) + ",\n\"tiles\": [";
+	separator = "\n";
+	for (int i = 0; i < columns * rows; i ++)
+	{
+		if (isDefault(i))
+			continue;
+		json += separator;
+		json += "[" + QByteArray::number(i) + ", " + QByteArray::number(terrainBitmaps.at(i)) + ", " + QByteArray::number(layers.at(i))
+				+ ", " + QByteArray::number(fileNameIds.at(nameIds.at(i))) + "]";
+		separator = ",\n";
+		if (json.size() >= FLUSH_SIZE && !flush())
+			return false;
+	}
+	json += "\n]\n}\n";
+	return flush();
+}
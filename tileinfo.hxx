@@ -0,0 +1,67 @@
+#ifndef TILEINFO_HXX
+#define TILEINFO_HXX
+
+#include <QVector>
+#include <QString>
+#include <QStringList>
+#include <QJsonObject>
+#include <QIODevice>
+#include <QHash>
+
+/* the information about all tiles of a tile set - it is kept in flat arrays, one element per tile, in row
+ * major order, and a tile is identified by its tile set position alone; tile names are interned, so that
+ * every distinct name is stored only once, however many tiles have it */
+class TileInfo
+{
+private:
+	enum
+	{
+		FILE_VERSION	=	2,
+		/* the most tiles accepted from a file */
+		MAX_FILE_TILES	=	1 << 24,
+	};
+	static QStringList terrainTypeNames;
+	int columns = 0, rows = 0;
+	/* these are bitmaps with elements in the 'terrainTypeNames' list above */
+	QVector<qint32> terrainBitmaps;
+	QVector<quint8> layers;
+	/* indices in 'names', the default name is always the first one */
+	QVector<quint32> nameIds;
+	QStringList names;
+	QHash<QString, quint32> nameIndex;
+	int index(int x, int y) const { return y * columns + x; }
+	quint32 intern(const QString & name);
+	bool isDefault(int i) const { return !terrainBitmaps.at(i) && !layers.at(i) && !nameIds.at(i); }
+	bool readLegacyJson(const QJsonObject & json);
+public:
+	static QStringList & terrainNames(void) { return terrainTypeNames; }
+	static QString defaultName(void) { return "unassigned"; }
+	TileInfo(void) { resize(0, 0); }
+	TileInfo(int columns, int rows) { resize(columns, rows); }
+	/* resizing also resets all tiles to the defaults */
+	void resize(int columns, int rows);
+	int width(void) const { return columns; }
+	int height(void) const { return rows; }
+	bool contains(int x, int y) const { return x >= 0 && y >= 0 && x < columns && y < rows; }
+	/* the getters return the defaults for tiles outside the tile set, and the setters ignore them */
+	qint32 terrain(int x, int y) const { return contains(x, y) ? terrainBitmaps.at(index(x, y)) : 0; }
+	void setTerrain(int x, int y, qint32 terrain) { if (contains(x, y)) terrainBitmaps[index(x, y)] = terrain; }
+	/* removes a terrain from the bitmap of a tile, the terrain bits above 'terrainIndex' move one position down */
+	void removeTerrain(int x, int y, int terrainIndex)
+	{ quint32 mask = (quint32(1) << terrainIndex) - 1, t = terrain(x, y); setTerrain(x, y, qint32((t & mask) | ((t >> 1) & ~ mask))); }
+	int layer(int x, int y) const { return contains(x, y) ? layers.at(index(x, y)) : 0; }
+	void setLayer(int x, int y, int layer) { if (contains(x, y)) layers[index(x, y)] = layer; }
+	const QString & name(int x, int y) const { return names.at(contains(x, y) ? nameIds.at(index(x, y)) : 0); }
+	void setName(int x, int y, const QString & name) { if (contains(x, y)) nameIds[index(x, y)] = intern(name); }
+
+	/* the terrain names listed in a tile information file */
+	static QStringList readTerrainNames(const QJsonObject & json);
+	/* reads both the sparse format written below, and the older format, with an object for every
+	 * tile; terrain bits above the current terrain names are dropped, so these must be read first */
+	bool readJson(const QJsonObject & json);
+	/* writes the tile information as json, without building a document in memory first - only the
+	 * tiles that differ from the defaults are written, as arrays of their index and fields */
+	bool writeJson(QIODevice & device, const QStringList & terrainNames) const;
+};
+
+#endif // TILEINFO_HXX
@@ -0,0 +1,453 @@
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+#include <QPoint>
+
+#include "tilemap.hxx"
+
+const TileIndex TileMap::NO_TILE;
+
+void TileMap::resize(int columns, int rows)
+{
+	this->columns = std::max(columns, 0);
+	this->rows = std::max(rows, 0);
+	chunkColumns = (this->columns + CHUNK_SIZE - 1) >> CHUNK_SIZE_LOG2;
+	chunkRows = (this->rows + CHUNK_SIZE - 1) >> CHUNK_SIZE_LOG2;
+	for (auto & layer : chunks)
+	{
+		layer.clear();
+		layer.resize(chunkColumns * chunkRows);
+	}
+}
+
+void TileMap::setTile(int layer, int x, int y, TileIndex tile)
+{
+	if (layer < 0 || layer >= MAP_LAYERS || !contains(x, y))
+		return;
+	auto & chunk = chunks[layer][chunkNumber(x, y)];
+	if (!chunk.constData())
+	{
+		if (tile == NO_TILE)
+			return;
+		chunk = new Chunk;
+	}
+	auto n = cellNumber(x, y);
+	auto old_tile = chunk.constData()->cells[n];
+	if (old_tile == tile)
+		return;
+	/* non-const access detaches the chunk, if it is shared with a copy of the map */
+	auto c = chunk.data();
+	if (old_tile == NO_TILE)
+		c->tileCount ++;
+	else if (tile == NO_TILE)
+		c->tileCount --;
+	c->cells[n] = tile;
+	if (!c->tileCount)
+		chunk = QSharedDataPointer<Chunk>();
+}
+
+void TileMap::setTiles(int layer, int x, int y, int count, TileIndex tile)
+{
+	if (layer < 0 || layer >= MAP_LAYERS || y < 0 || y >= rows)
+		return;
+	if (x < 0)
+		count += x, x = 0;
+	count = std::min(count, columns - x);
+	while (count > 0)
+	{
+		int i, n = std::min(count, CHUNK_SIZE - (x & (CHUNK_SIZE - 1)));
+		auto & chunk = chunks[layer][chunkNumber(x, y)];
+		if (!chunk.constData() && tile != NO_TILE)
+			chunk = new Chunk;
+		if (chunk.constData())
+		{
+			auto c = chunk.data();
+			auto cells = c->cells + cellNumber(x, y);
+			for (i = 0; i < n; i ++)
+			{
+				if (cells[i] == NO_TILE)
+					c->tileCount += (tile != NO_TILE);
+				else if (tile == NO_TILE)
+					c->tileCount --;
+				cells[i] = tile;
+			}
+			if (!c->tileCount)
+				chunk = QSharedDataPointer<Chunk>();
+		}
+		x += n, count -= n;
+	}
+}
+
+void TileMap::readRow(int layer, int y, TileIndex * tiles) const
+{
+	for (int x = 0; x < columns; x += CHUNK_SIZE)
+	{
+		int n = std::min(int(CHUNK_SIZE), columns - x);
+		auto chunk = chunks[layer].at(chunkNumber(x, y)).constData();
+		if (chunk)
+			std::copy(chunk->cells + cellNumber(x, y), chunk->cells + cellNumber(x, y) + n, tiles + x);
+		else
+			std::fill(tiles + x, tiles + x + n, NO_TILE);
+	}
+}
+
+void TileMap::setRun(int layer, qint64 cell, qint64 count, TileIndex tile)
+{
+	while (count > 0)
+	{
+		int x = cell % columns, y = cell / columns, n = std::min(qint64(columns - x), count);
+		setTiles(layer, x, y, n, tile);
+		cell += n, count -= n;
+	}
+}
+
+QRect TileMap::fillRect(int layer, const QRect & cells, TileIndex tile)
+{
+	auto r = cells & QRect(0, 0, columns, rows);
+	if (layer < 0 || layer >= MAP_LAYERS || r.isEmpty())
+		return QRect();
+	/* all full chunks share the same data, and get detached when a cell in them changes */
+	QSharedDataPointer<Chunk> full;
+	for (int y = r.top() >> CHUNK_SIZE_LOG2; y <= r.bottom() >> CHUNK_SIZE_LOG2; y ++)
+		for (int x = r.left() >> CHUNK_SIZE_LOG2; x <= r.right() >> CHUNK_SIZE_LOG2; x ++)
+		{
+			QRect chunkRect(x << CHUNK_SIZE_LOG2, y << CHUNK_SIZE_LOG2, CHUNK_SIZE, CHUNK_SIZE);
+			auto part = chunkRect & r;
+			if (part != chunkRect)
+			{
+				/* this includes the partial chunks at the right and bottom map edges, which only hold tiles in the cells inside the map */
+				for (int cy = part.top(); cy <= part.bottom(); cy ++)
+					setTiles(layer, part.left(), cy, part.width(), tile);
+				continue;
+			}
+			if (tile != NO_TILE && !full)
+			{
+				full = new Chunk;
+				std::fill(full->cells, full->cells + CHUNK_CELLS, tile);
+				full->tileCount = CHUNK_CELLS;
+			}
+			chunks[layer][y * chunkColumns + x] = full;
+		}
+	return r;
+}
+
+QRect TileMap::floodFill(int layer, int x, int y, TileIndex tile, QVector<QRect> * spans)
+{
+	if (layer < 0 || layer >= MAP_LAYERS || !contains(x, y))
+		return QRect();
+	auto target = this->tile(layer, x, y);
+	if (target == tile)
+		return QRect();
+	QRect dirty;
+	/* the seeds are the leftmost cells of runs of target tiles; a run is filled at once, and then
+	 * the runs of target tiles touching it in the rows above and below it are seeded */
+	QVector<QPoint> seeds;
+	seeds << QPoint(x, y);
+	while (!seeds.isEmpty())
+	{
+		auto seed = seeds.takeLast();
+		int left = seed.x(), right = seed.x(), row = seed.y();
+		if (this->tile(layer, left, row) != target)
+			continue;
+		while (left > 0 && this->tile(layer, left - 1, row) == target)
+			left --;
+		while (right < columns - 1 && this->tile(layer, right + 1, row) == target)
+			right ++;
+		setTiles(layer, left, row, right - left + 1, tile);
+		QRect span(left, row, right - left + 1, 1);
+		dirty |= span;
+		if (spans)
+			* spans << span;
+		for (auto y : { row - 1, row + 1, })
+			if (y >= 0 && y < rows)
+				for (int i = left; i <= right; i ++)
+					if (this->tile(layer, i, y) == target && (i == left || this->tile(layer, i - 1, y) != target))
+						seeds << QPoint(i, y);
+	}
+	return dirty;
+}
+
+void TileMap::remapTiles(const QHash<TileIndex, TileIndex> & remap)
+{
+	if (remap.isEmpty())
+		return;
+	for (auto & layer : chunks)
+		for (auto & chunk : layer)
+		{
+			if (!chunk.constData())
+				continue;
+			/* only detach the chunks that really change */
+			auto cells = chunk.constData()->cells;
+			if (std::none_of(cells, cells + CHUNK_CELLS, [&] (TileIndex tile) { return remap.contains(tile); }))
+				continue;
+			auto c = chunk.data();
+			c->tileCount = 0;
+			for (auto & tile : c->cells)
+			{
+				auto i = remap.constFind(tile);
+				if (i != remap.constEnd())
+					tile = * i;
+				c->tileCount += (tile != NO_TILE);
+			}
+			if (!c->tileCount)
+				chunk = QSharedDataPointer<Chunk>();
+		}
+}
+
+int TileMap::allocatedChunks(void) const
+{
+	int count = 0;
+	for (const auto & layer : chunks)
+		for (const auto & chunk : layer)
+			if (chunk.constData())
+				count ++;
+	return count;
+}
+
+qint64 TileMap::memoryUsage(void) const
+{
+	return qint64(allocatedChunks()) * sizeof(Chunk) + MAP_LAYERS * chunkColumns * chunkRows * sizeof(QSharedDataPointer<Chunk>);
+}
+
+bool TileMap::readJson(const QJsonObject & json)
+{
+	int columns = json["map-size-x"].toInt(-1), rows = json["map-size-y"].toInt(-1), layer, i;
+	if (columns <= 0 || rows <= 0)
+		return false;
+	resize(columns, rows);
+	QJsonArray map_layers = json["layers"].toArray();
+	for (layer = 0; layer < MAP_LAYERS && layer < map_layers.size(); layer ++)
+	{
+		auto map_layer = map_layers.at(layer).toArray();
+		auto cells = std::min(map_layer.size(), columns * rows);
+		for (i = 0; i < cells; i ++)
+		{
+			auto cell = map_layer.at(i).toObject();
+			int tx = cell["tile-set-x"].toInt(-1), ty = cell["tile-set-y"].toInt(-1);
+			if (tx >= 0 && ty >= 0)
+				setTile(layer, i % columns, i / columns, tileIndex(tx, ty));
+		}
+	}
+	return true;
+}
+
+void TileMap::writeJson(QJsonObject & json) const
+{
+	QJsonArray map_layers;
+	for (int layer = 0; layer < MAP_LAYERS; layer ++)
+	{
+		QJsonArray layer_tiles;
+		for (int y = 0; y < rows; y ++)
+			for (int x = 0; x < columns; x ++)
+			{
+				QJsonObject t;
+				auto tile = this->tile(layer, x, y);
+				t["x"] = x;
+				t["y"] = y;
+				t["tile-set-x"] = (tile == NO_TILE) ? -1 : tileSetX(tile);
+				t["tile-set-y"] = (tile == NO_TILE) ? -1 : tileSetY(tile);
+				layer_tiles.append(t);
+			}
+		map_layers.append(layer_tiles);
+	}
+	json["map-size-x"] = columns;
+	json["map-size-y"] = rows;
+	json["layers"] = map_layers;
+}
+
+bool TileMap::writeJson(QIODevice & device) const
+{
+	enum { FLUSH_SIZE = 1 << 16, };
+	QVector<TileIndex> row(columns);
+	QByteArray json;
+	auto flush = [&] (void) -> bool { bool result = device.write(json) == json.size(); json.clear(); return result; };
+	json += "{\n\"layers\": [";
+	for (int layer = 0; layer < MAP_LAYERS; layer ++)
+	{
+		json += layer ? ",\n[" : "\n[";
+		for (int y = 0; y < rows; y ++)
+		{
+			readRow(layer, y, row.data());
+			for (int x = 0; x < columns; x ++)
+			{
+				auto tile = row.at(x);
+				json += (x || y) ? ",\n{\"tile-set-x\": " : "\n{\"tile-set-x\": ";
+				json += QByteArray::number((tile == NO_TILE) ? -1 : tileSetX(tile));
+				json += ", \"tile-set-y\": " + QByteArray::number((tile == NO_TILE) ? -1 : tileSetY(tile));
+				json += ", \"x\": " + QByteArray::number(x) + ", \"y\": " + QByteArray::number(y) + "}";
+			}
+			if (json.size() >= FLUSH_SIZE && !flush())
+				return false;
+		}
+		json += "\n]";
+	}
+	json += "\n],\n\"map-size-x\": " + QByteArray::number(columns) + ",\n\"map-size-y\": " + QByteArray::number(rows) + "\n}\n";
+	return flush();
+}
+
+bool TileMap::readBinary(const uchar * data, qint64 size)
+{
+	qint64 words = size / sizeof(quint32), pos = MAP_FILE_HEADER_WORDS, cells, i;
+	auto word = [=] (qint64 i) -> quint32 { return qFromLittleEndian<quint32>(data + i * sizeof(quint32)); };
+	if (words < MAP_FILE_HEADER_WORDS || word(0) != MAP_FILE_MAGIC || word(1) != MAP_FILE_VERSION)
+		return false;
+	quint32 columns = word(2), rows = word(3), layers = word(4), layer;
+	if (!columns || !rows || columns > MAP_FILE_MAX_SIZE || rows > MAP_FILE_MAX_SIZE)
+		return false;
+	cells = qint64(columns) * rows;
+	/* decode to a new map, so that this one is left intact if the file turns out to be broken */
+	TileMap map(columns, rows);
+	for (layer = 0; layer < layers; layer ++)
+	{
+		if (pos + 2 > words)
+			return false;
+		qint64 encoding = word(pos), length = word(pos + 1), cell = 0;
+		pos += 2;
+		if (pos + length > words)
+			return false;
+		if (layer < MAP_LAYERS)
+		{
+			if (encoding == LAYER_ENCODING_RAW)
+			{
+				if (length != cells)
+					return false;
+				/* coalesce equal neighbouring cells, so that empty areas cost nothing to load */
+				for (i = 0; i < cells; cell = i)
+				{
+					TileIndex tile = word(pos + i);
+					while (++ i < cells && word(pos + i) == tile)
+						;
+					if (tile != NO_TILE)
+						map.setRun(layer, cell, i - cell, tile);
+				}
+			}
+			else if (encoding == LAYER_ENCODING_RLE)
+			{
+				for (i = 0; i + 1 < length; i += 2)
+				{
+					qint64 count = word(pos + i);
+					TileIndex tile = word(pos + i + 1);
+					if (cell + count > cells)
+						return false;
+					if (tile != NO_TILE)
+						map.setRun(layer, cell, count, tile);
+					cell += count;
+				}
+				if (cell != cells)
+					return false;
+			}
+			else
+				return false;
+		}
+		pos += length;
+	}
+	* this = map;
+	return true;
+}
+
+bool TileMap::writeBinary(QIODevice & device, bool compress) const
+{
+	enum { BUFFER_WORDS = 1 << 16, };
+	if (columns > MAP_FILE_MAX_SIZE || rows > MAP_FILE_MAX_SIZE)
+		return false;
+	QVector<TileIndex> row(columns);
+	QVector<quint32> buffer;
+	buffer.reserve(BUFFER_WORDS + columns * 2);
+	auto flush = [&] (void) -> bool
+	{
+		bool result = device.write(reinterpret_cast<const char *>(buffer.constData()), buffer.size() * sizeof(quint32)) == qint64(buffer.size() * sizeof(quint32));
+		buffer.clear();
+		return result;
+	};
+	buffer << qToLittleEndian<quint32>(MAP_FILE_MAGIC) << qToLittleEndian<quint32>(MAP_FILE_VERSION)
+		<< qToLittleEndian<quint32>(columns) << qToLittleEndian<quint32>(rows) << qToLittleEndian<quint32>(MAP_LAYERS);
+	for (int layer = 0; layer < MAP_LAYERS; layer ++)
+	{
+		int x, y;
+		qint64 runs = 0, cells = qint64(columns) * rows;
+		TileIndex last = NO_TILE;
+		/* count the runs first, and only use run length encoding if it is really smaller */
+		for (y = 0; y < rows; y ++)
+		{
+			readRow(layer, y, row.data());
+			for (x = 0; x < columns; x ++)
+				if ((!x && !y) || row.at(x) != last)
+					runs ++, last = row.at(x);
+		}
+		bool rle = compress && runs * 2 < cells;
+		buffer << qToLittleEndian<quint32>(rle ? LAYER_ENCODING_RLE : LAYER_ENCODING_RAW) << qToLittleEndian<quint32>(rle ? runs * 2 : cells);
+		quint32 count = 0;
+		for (y = 0; y < rows; y ++)
+		{
+			readRow(layer, y, row.data());
+			for (x = 0; x < columns; x ++)
+			{
+				if (!rle)
+					buffer << qToLittleEndian<quint32>(row.at(x));
+				else if (count && row.at(x) == last)
+					count ++;
+				else
+				{
+					if (count)
+						buffer << qToLittleEndian<quint32>(count) << qToLittleEndian<quint32>(last);
+					last = row.at(x), count = 1;
+				}
+			}
+			if (buffer.size() >= BUFFER_WORDS && !flush())
+				return false;
+		}
+		if (count)
+			buffer << qToLittleEndian<quint32>(count) << qToLittleEndian<quint32>(last);
+	}
+	return flush();
+}
+
+bool TileMap::isBinaryFileName(const QString & fileName)
+{
+	return QFileInfo(fileName).suffix() == "tmap";
+}
+
+bool TileMap::load(const QString & fileName)
+{
+	QFile f(fileName);
+	if (!f.open(QFile::ReadOnly))
+		return false;
+	if (isBinaryFileName(fileName))
+	{
+		auto size = f.size();
+		if (auto data = f.map(0, size))
+		{
+			bool result = readBinary(data, size);
+			f.unmap(data);
+			return result;
+		}
+		auto bytes = f.readAll();
+		return readBinary(reinterpret_cast<const uchar *>(bytes.constData()), bytes.size());
+	}
+	QJsonDocument jdoc = QJsonDocument::fromJson(f.readAll());
+	return !jdoc.isNull() && readJson(jdoc.object());
+}
+
+bool TileMap::save(const QString & fileName) const
+{
+	QSaveFile f(fileName);
+	if (!f.open(QIODevice::WriteOnly))
+		return false;
+	if (isBinaryFileName(fileName))
+	{
+		if (!writeBinary(f))
+		{
+			f.cancelWriting();
+			return false;
+		}
+	}
+	else if (!writeJson(f))
+	{
+		f.cancelWriting();
+		return false;
+	}
+	return f.commit();
+}
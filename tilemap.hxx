@@ -0,0 +1,124 @@
+#ifndef TILEMAP_HXX
+#define TILEMAP_HXX
+
+#include <QVector>
+#include <QSharedData>
+#include <QSharedDataPointer>
+#include <QJsonObject>
+#include <QIODevice>
+#include <QHash>
+#include <QRect>
+
+#include <algorithm>
+
+enum
+{
+	MAP_LAYERS = 4,
+};
+
+/* a map cell refers to a tile in the tile set - the tile set row is in the upper 16 bits, the tile set column is in the lower 16 bits */
+typedef quint32 TileIndex;
+
+/* the tile map model - every layer is split in square chunks of cells, a chunk is only allocated once a tile is placed in it,
+ * and is released again when its last tile is removed, so that memory scales with the number of painted tiles, and not with
+ * the map size; chunks are implicitly shared, so copying a map is cheap */
+class TileMap
+{
+public:
+	enum
+	{
+		CHUNK_SIZE_LOG2	=	5,
+		CHUNK_SIZE	=	1 << CHUNK_SIZE_LOG2,
+		CHUNK_CELLS	=	CHUNK_SIZE * CHUNK_SIZE,
+	};
+	static const TileIndex NO_TILE = 0xffffffff;
+	static TileIndex tileIndex(int tileSetX, int tileSetY) { return (TileIndex(tileSetY) << 16) | (tileSetX & 0xffff); }
+	static int tileSetX(TileIndex tile) { return tile & 0xffff; }
+	static int tileSetY(TileIndex tile) { return tile >> 16; }
+	/* the rectangle of cells with opposite corners at 'a' and 'b', whichever way round they are */
+	static QRect cellsBetween(const QPoint & a, const QPoint & b)
+	{ return QRect(QPoint(std::min(a.x(), b.x()), std::min(a.y(), b.y())), QPoint(std::max(a.x(), b.x()), std::max(a.y(), b.y()))); }
+private:
+	class Chunk : public QSharedData
+	{
+	public:
+		/* number of non-empty cells in the chunk */
+		int tileCount = 0;
+		TileIndex cells[CHUNK_CELLS];
+		Chunk(void) { std::fill(cells, cells + CHUNK_CELLS, NO_TILE); }
+	};
+	int columns = 0, rows = 0, chunkColumns = 0, chunkRows = 0;
+	QVector<QSharedDataPointer<Chunk>> chunks[MAP_LAYERS];
+	int chunkNumber(int x, int y) const { return (y >> CHUNK_SIZE_LOG2) * chunkColumns + (x >> CHUNK_SIZE_LOG2); }
+	static int cellNumber(int x, int y) { return ((y & (CHUNK_SIZE - 1)) << CHUNK_SIZE_LOG2) + (x & (CHUNK_SIZE - 1)); }
+	/* binary map file layout, all values are little endian 32 bit words:
+	 *	header:		magic ("TMAP"), version, columns, rows, layer count
+	 *	each layer:	encoding (one of the enumerators below), payload size in words, payload
+	 * a raw payload holds one tile index per cell, in row major order, a run length encoded
+	 * payload holds (run length, tile index) pairs covering the cells in the same order */
+	enum
+	{
+		MAP_FILE_MAGIC		=	0x50414d54,
+		MAP_FILE_VERSION	=	1,
+		MAP_FILE_HEADER_WORDS	=	5,
+		/* the largest map size accepted from a binary file */
+		MAP_FILE_MAX_SIZE	=	1 << 15,
+		LAYER_ENCODING_RAW	=	0,
+		LAYER_ENCODING_RLE	=	1,
+	};
+	void setRun(int layer, qint64 cell, qint64 count, TileIndex tile);
+public:
+	/* map files with this suffix are in the binary format, all others are json */
+	static bool isBinaryFileName(const QString & fileName);
+	TileMap(void) {}
+	TileMap(int columns, int rows) { resize(columns, rows); }
+	/* resizing a map also clears it */
+	void resize(int columns, int rows);
+	void clear(void) { resize(columns, rows); }
+	int width(void) const { return columns; }
+	int height(void) const { return rows; }
+	bool contains(int x, int y) const { return x >= 0 && y >= 0 && x < columns && y < rows; }
+	TileIndex tile(int layer, int x, int y) const
+	{
+		if (layer < 0 || layer >= MAP_LAYERS || !contains(x, y))
+			return NO_TILE;
+		auto chunk = chunks[layer].at(chunkNumber(x, y)).constData();
+		return chunk ? chunk->cells[cellNumber(x, y)] : NO_TILE;
+	}
+	void setTile(int layer, int x, int y, TileIndex tile);
+	/* sets 'count' cells of a row, starting at column 'x' */
+	void setTiles(int layer, int x, int y, int count, TileIndex tile);
+	/* copies a whole row of a layer to 'tiles', which must have room for width() elements */
+	void readRow(int layer, int y, TileIndex * tiles) const;
+	void fillLayer(int layer, TileIndex tile) { fillRect(layer, QRect(0, 0, columns, rows), tile); }
+	/* sets all cells of a rectangle, and returns the part of it inside the map - the chunks that the
+	 * rectangle covers completely all share the same cells, so only the cells at its edges are written */
+	QRect fillRect(int layer, const QRect & cells, TileIndex tile);
+	/* replaces the tile at (x, y), and all the same tiles connected to it horizontally and vertically,
+	 * with 'tile'; returns the bounding rectangle of the changed cells, and appends the filled runs
+	 * of each row to 'spans', when that is not null */
+	QRect floodFill(int layer, int x, int y, TileIndex tile, QVector<QRect> * spans = 0);
+	/* replaces the tiles found in 'remap' in all layers */
+	void remapTiles(const QHash<TileIndex, TileIndex> & remap);
+
+	int chunkCountX(void) const { return chunkColumns; }
+	int chunkCountY(void) const { return chunkRows; }
+	/* returns the cells of a chunk, in row major order, or a null pointer if there are no tiles in the chunk */
+	const TileIndex * chunkCells(int layer, int chunkX, int chunkY) const
+	{ auto chunk = chunks[layer].at(chunkY * chunkColumns + chunkX).constData(); return chunk ? chunk->cells : 0; }
+	int allocatedChunks(void) const;
+	qint64 memoryUsage(void) const;
+
+	bool readJson(const QJsonObject & json);
+	void writeJson(QJsonObject & json) const;
+	/* writes the same json as above, without building a document in memory first */
+	bool writeJson(QIODevice & device) const;
+	bool readBinary(const uchar * data, qint64 size);
+	bool writeBinary(QIODevice & device, bool compress = true) const;
+	/* these pick the file format from the file name suffix; saving goes through a temporary
+	 * file, so an existing map file is only replaced once the new one is completely written */
+	bool load(const QString & fileName);
+	bool save(const QString & fileName) const;
+};
+
+#endif // TILEMAP_HXX
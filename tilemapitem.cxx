@@ -0,0 +1,391 @@
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QtConcurrent>
+
+#include "mapeditor.hxx"
+
+TileMapItem::TileMapItem(const TileMap * tileMap, TileSet * tileSet, QGraphicsItem * parent) : QGraphicsObject(parent)
+{
+	this->tileMap = tileMap;
+	this->tileSet = tileSet;
+	chunkCache.setMaxCost(CHUNK_CACHE_SIZE);
+	setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+	/* the overview waits for the tile colours of the mip chain */
+	connect(tileSet, & TileSet::mipChainReady, this, [=] { update(); if (!overviewValid) overview(); });
+}
+
+QImage TileMapItem::backgroundTile(int w, int h)
+{
+	QLinearGradient gradient(QPointF(0, 0), QPointF(w, h));
+	gradient.setColorAt(0, Qt::black);
+	gradient.setColorAt(1, Qt::white);
+	QImage tile(w, h, QImage::Format_ARGB32_Premultiplied);
+	QPainter p(& tile);
+	p.fillRect(tile.rect(), QBrush(gradient));
+	return tile;
+}
+
+const QImage & TileMapItem::background(int w, int h)
+{
+	if (backgroundImage.size() != QSize(w, h))
+		backgroundImage = backgroundTile(w, h);
+	return backgroundImage;
+}
+
+QColor TileMapItem::backgroundColour(void)
+{
+	return background(tileSet->tileWidth(), tileSet->tileHeight()).scaled(1, 1, Qt::IgnoreAspectRatio, Qt::SmoothTransformation).pixelColor(0, 0);
+}
+
+QImage TileMapItem::composeChunk(const TileMap & tileMap, const QImage & atlas, const QImage & background, int chunkX, int chunkY, int w, int h)
+{
+	Profiler::Scope scope("compose-chunk");
+	int x0 = chunkX * TileMap::CHUNK_SIZE, y0 = chunkY * TileMap::CHUNK_SIZE, x, y;
+	int columns = std::min(int(TileMap::CHUNK_SIZE), tileMap.width() - x0), rows = std::min(int(TileMap::CHUNK_SIZE), tileMap.height() - y0);
+	QImage chunk(columns * w, rows * h, QImage::Format_ARGB32_Premultiplied);
+	QPainter p(& chunk);
+	for (y = 0; y < rows; y ++)
+		for (x = 0; x < columns; x ++)
+			p.drawImage(x * w, y * h, background);
+	for (int layer = 0; layer < MAP_LAYERS; layer ++)
+	{
+		/* empty chunks of the upper layers are not even allocated, so they cost nothing to skip here */
+		auto cells = tileMap.chunkCells(layer, chunkX, chunkY);
+		if (!cells)
+			continue;
+		for (y = 0; y < rows; y ++)
+			for (x = 0; x < columns; x ++)
+			{
+				auto tile = cells[y * TileMap::CHUNK_SIZE + x];
+				if (tile != TileMap::NO_TILE)
+					p.drawImage(QRect(x * w, y * h, w, h), atlas, QRect(TileMap::tileSetX(tile) * w, TileMap::tileSetY(tile) * h, w, h));
+			}
+	}
+	return chunk;
+}
+
+QRectF TileMapItem::boundingRect(void) const
+{
+	return QRectF(0, 0, tileMap->width() * tileSet->tileWidth(), tileMap->height() * tileSet->tileHeight());
+}
+
+void TileMapItem::paint(QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * widget)
+{
+	Q_UNUSED(widget);
+	Profiler::Scope scope("paint-map");
+	int w = tileSet->tileWidth(), h = tileSet->tileHeight(), cw = w * TileMap::CHUNK_SIZE, ch = h * TileMap::CHUNK_SIZE, x, y;
+	auto r = option->exposedRect.toAlignedRect() & boundingRect().toAlignedRect();
+	if (r.isEmpty())
+		return;
+	/* the mip level with the most detail that still has no more than a tile pixel per screen pixel */
+	auto lod = option->levelOfDetailFromTransform(painter->worldTransform());
+	int level = 0;
+	while (level < MAX_MIP_LEVELS - 1 && (2 << level) <= std::max(w, h) && lod * (2 << level) <= 1)
+		level ++;
+	if (lod * std::max(w, h) * MapOverview::blockSizeFor(* tileMap) <= 1)
+	{
+		auto & image = overview().image();
+		if (!overviewValid)
+		{
+			painter->fillRect(r, backgroundColour());
+			return;
+		}
+		auto pixel = overviewPixelSize();
+		QRectF source(QPointF(int(r.left() / pixel.width()), int(r.top() / pixel.height())),
+				QPointF(int(r.right() / pixel.width()) + 1, int(r.bottom() / pixel.height()) + 1));
+		source &= QRectF(image.rect());
+		painter->drawImage(QRectF(source.x() * pixel.width(), source.y() * pixel.height(), source.width() * pixel.width(),
+				source.height() * pixel.height()) & boundingRect(), image, source);
+		return;
+	}
+	auto & mipChain = tileSet->mipChain();
+	bool isLevelReady = level < mipChain.levelCount();
+	auto atlas = level && isLevelReady ? mipChain.level(level) : tileSet->atlas();
+	auto tileSize = level && isLevelReady ? mipChain.tileSize(level) : QSize(w, h);
+	auto bounds = boundingRect().toAlignedRect();
+	for (y = r.top() / ch; y <= r.bottom() / ch; y ++)
+		for (x = r.left() / cw; x <= r.right() / cw; x ++)
+		{
+			int chunkIndex = y * tileMap->chunkCountX() + x, key = cacheKey(chunkIndex, level);
+			QImage chunk;
+			if (auto cached = chunkCache.object(key))
+			{
+				chunk = * cached;
+				Profiler::count(Profiler::CHUNK_CACHE_HITS);
+			}
+			/* only full size chunks are streamed in, the smaller ones are cheap enough to compose here */
+			else if (streaming && !level && !editedChunks.contains(chunkIndex))
+				continue;
+			else if (level && !isLevelReady)
+			{
+				/* until the mip chain is ready, the chunks composed at full size are scaled down, the others are filled flat */
+				auto target = QRect(x * cw, y * ch, cw, ch) & bounds;
+				if (auto full = chunkCache.object(cacheKey(chunkIndex, 0)))
+					painter->drawImage(target, * full);
+				else
+					painter->fillRect(target, backgroundColour());
+				continue;
+			}
+			else
+			{
+				Profiler::count(Profiler::CHUNK_CACHE_MISSES);
+				chunk = composeChunk(* tileMap, atlas, background(tileSize.width(), tileSize.height()), x, y, tileSize.width(), tileSize.height());
+				chunkCache.insert(key, new QImage(chunk), chunkCost(chunk.width(), chunk.height()));
+			}
+			if (!level)
+			{
+				auto target = QRect(x * cw, y * ch, chunk.width(), chunk.height()) & r;
+				painter->drawImage(target, chunk, target.translated(- x * cw, - y * ch));
+			}
+			else
+				painter->drawImage(QRect(x * cw, y * ch, chunk.width() / tileSize.width() * w, chunk.height() / tileSize.height() * h), chunk);
+		}
+}
+
+void TileMapItem::cellChanged(int x, int y)
+{
+	cellsChanged(QRect(x, y, 1, 1));
+}
+
+void TileMapItem::cellsChanged(const QRect & cells)
+{
+	auto r = cells & QRect(0, 0, tileMap->width(), tileMap->height());
+	if (r.isEmpty())
+		return;
+	for (int y = r.top() >> TileMap::CHUNK_SIZE_LOG2; y <= r.bottom() >> TileMap::CHUNK_SIZE_LOG2; y ++)
+		for (int x = r.left() >> TileMap::CHUNK_SIZE_LOG2; x <= r.right() >> TileMap::CHUNK_SIZE_LOG2; x ++)
+		{
+			for (int level = 0; level < MAX_MIP_LEVELS; level ++)
+				chunkCache.remove(cacheKey(y * tileMap->chunkCountX() + x, level));
+			/* a chunk composed by a worker before the edit is out of date */
+			if (streaming)
+				editedChunks.insert(y * tileMap->chunkCountX() + x);
+			if (isTileIndexBuilt)
+				unindexedChunks.insert(y * tileMap->chunkCountX() + x);
+		}
+	int w = tileSet->tileWidth(), h = tileSet->tileHeight();
+	update(r.x() * w, r.y() * h, r.width() * w, r.height() * h);
+	if (overviewValid)
+	{
+		mapOverview.update(r);
+		emit overviewChanged();
+	}
+	else if (isBuildingOverview)
+		overviewDirtyCells |= r;
+}
+
+void TileMapItem::tileChanged(TileIndex tile)
+{
+	if (overviewValid)
+	{
+		auto & mipChain = tileSet->mipChain();
+		mapOverview.setTileColours(mipChain.isEmpty() ? QImage() : mipChain.tileColours());
+	}
+	if (!isTileIndexBuilt)
+	{
+		for (int chunk = 0; chunk < tileMap->chunkCountX() * tileMap->chunkCountY(); chunk ++)
+			indexChunk(chunk);
+		isTileIndexBuilt = true;
+	}
+	else
+		for (auto chunk : unindexedChunks)
+			indexChunk(chunk);
+	unindexedChunks.clear();
+	for (auto chunk : chunksByTile.value(tile))
+	{
+		int x = chunk % tileMap->chunkCountX(), y = chunk / tileMap->chunkCountX();
+		cellsChanged(QRect(x << TileMap::CHUNK_SIZE_LOG2, y << TileMap::CHUNK_SIZE_LOG2, TileMap::CHUNK_SIZE, TileMap::CHUNK_SIZE));
+	}
+	/* the cells of these did not change, only their image */
+	unindexedChunks.clear();
+}
+
+void TileMapItem::indexChunk(int chunk)
+{
+	for (auto tile : chunkTiles.take(chunk))
+	{
+		auto i = chunksByTile.find(tile);
+		i->remove(chunk);
+		if (i->isEmpty())
+			chunksByTile.erase(i);
+	}
+	int x = chunk % tileMap->chunkCountX(), y = chunk / tileMap->chunkCountX();
+	QVector<TileIndex> tiles;
+	for (int layer = 0; layer < MAP_LAYERS; layer ++)
+		if (auto cells = tileMap->chunkCells(layer, x, y))
+		{
+			tiles.resize(tiles.size() + TileMap::CHUNK_CELLS);
+			std::copy(cells, cells + TileMap::CHUNK_CELLS, tiles.end() - TileMap::CHUNK_CELLS);
+		}
+	std::sort(tiles.begin(), tiles.end());
+	tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+	tiles.removeOne(TileMap::NO_TILE);
+	if (tiles.isEmpty())
+		return;
+	for (auto tile : tiles)
+		chunksByTile[tile].insert(chunk);
+	chunkTiles.insert(chunk, tiles);
+}
+
+void TileMapItem::setChunkImage(int chunkX, int chunkY, const QImage & chunk)
+{
+	int key = chunkY * tileMap->chunkCountX() + chunkX;
+	if (!streaming || editedChunks.contains(key) || chunkX >= tileMap->chunkCountX() || chunkY >= tileMap->chunkCountY())
+		return;
+	chunkCache.insert(cacheKey(key, 0), new QImage(chunk), chunkCost(chunk.width(), chunk.height()));
+	int cw = tileSet->tileWidth() * TileMap::CHUNK_SIZE, ch = tileSet->tileHeight() * TileMap::CHUNK_SIZE;
+	update(chunkX * cw, chunkY * ch, chunk.width(), chunk.height());
+}
+
+int TileMapItem::cacheableChunks(void) const
+{
+	return chunkCache.maxCost() / chunkCost(tileSet->tileWidth() * TileMap::CHUNK_SIZE, tileSet->tileHeight() * TileMap::CHUNK_SIZE);
+}
+
+void TileMapItem::mapChanged(void)
+{
+	chunkCache.clear();
+	streaming = false;
+	/* a build that is still running is for the old map */
+	mapOverview = MapOverview();
+	overviewValid = false;
+	overviewBuild ++;
+	isBuildingOverview = false;
+	chunksByTile.clear();
+	chunkTiles.clear();
+	unindexedChunks.clear();
+	isTileIndexBuilt = false;
+	prepareGeometryChange();
+	update();
+	emit overviewChanged();
+}
+
+void TileMapItem::buildOverview(void)
+{
+	auto & mipChain = tileSet->mipChain();
+	/* started again once the mip chain is ready */
+	if (tileSet->isMipChainBuilding())
+		return;
+	int build = ++ overviewBuild;
+	isBuildingOverview = true;
+	overviewDirtyCells = QRect();
+	/* the copy shares the chunks of the map, until the map is edited */
+	auto map = * tileMap;
+	auto tileColours = mipChain.isEmpty() ? QImage() : mipChain.tileColours();
+	auto background = backgroundColour().rgba();
+	/* the watcher only reports on the last future it was given */
+	overviewWatcher.disconnect(this);
+	connect(& overviewWatcher, & QFutureWatcher<MapOverview>::finished, this, [=] { installOverview(build); });
+	overviewWatcher.setFuture(QtConcurrent::run([=] { MapOverview overview; overview.reset(& map, tileColours, background); return overview; }));
+}
+
+void TileMapItem::installOverview(int build)
+{
+	if (build != overviewBuild || !isBuildingOverview)
+		return;
+	isBuildingOverview = false;
+	mapOverview = overviewWatcher.result();
+	/* the watcher lets go of its copy, so that edits update the overview in place */
+	overviewWatcher.setFuture(QFuture<MapOverview>());
+	/* the overview still points to the copy of the map the worker read */
+	mapOverview.setTileMap(tileMap);
+	auto & mipChain = tileSet->mipChain();
+	mapOverview.setTileColours(mipChain.isEmpty() ? QImage() : mipChain.tileColours());
+	mapOverview.update(overviewDirtyCells);
+	overviewDirtyCells = QRect();
+	overviewValid = true;
+	update();
+	emit overviewChanged();
+}
+
+const MapOverview & TileMapItem::overview(void)
+{
+	if (!overviewValid && !isBuildingOverview)
+		buildOverview();
+	return mapOverview;
+}
+
+void TileMapItem::waitForOverview(void)
+{
+	tileSet->waitForMipChain();
+	overview();
+	overviewWatcher.waitForFinished();
+	installOverview(overviewBuild);
+}
+
+QSizeF TileMapItem::overviewPixelSize(void)
+{
+	int block = MapOverview::blockSizeFor(* tileMap);
+	return QSizeF(block * tileSet->tileWidth(), block * tileSet->tileHeight());
+}
+
+QPoint TileMapItem::cellAt(const QPointF & pos) const
+{
+	return QPoint(pos.x() / tileSet->tileWidth(), pos.y() / tileSet->tileHeight());
+}
+
+void TileMapItem::mousePressEvent(QGraphicsSceneMouseEvent * event)
+{
+	/* only the left button edits the map, and a press while another one is held is left alone */
+	if (event->button() != Qt::LeftButton || isPainting || isShiftDragging)
+	{
+		event->ignore();
+		return;
+	}
+	auto cell = cellAt(event->pos());
+	if (event->modifiers() & Qt::ShiftModifier)
+	{
+		/* accepting the press delivers the release to this item */
+		dragStart = cell;
+		isShiftDragging = true;
+		return;
+	}
+	if (event->modifiers() & Qt::ControlModifier) emit cellControlSelected(cell.x(), cell.y());
+	else if (event->modifiers() & Qt::AltModifier) emit cellAltSelected(cell.x(), cell.y());
+	else
+	{
+		/* a plain press is kept, so that the moves of a drag are delivered here */
+		isPainting = true;
+		paintCell = cell;
+		emit cellSelected(cell.x(), cell.y());
+		return;
+	}
+	event->ignore();
+}
+
+void TileMapItem::mouseMoveEvent(QGraphicsSceneMouseEvent * event)
+{
+	auto cell = cellAt(event->pos());
+	if (!isPainting || cell == paintCell)
+		return;
+	paintCell = cell;
+	emit cellDragged(cell.x(), cell.y());
+}
+
+void TileMapItem::mouseReleaseEvent(QGraphicsSceneMouseEvent * event)
+{
+	if (event->button() != Qt::LeftButton)
+		return;
+	if (isPainting)
+	{
+		isPainting = false;
+		emit paintingFinished();
+	}
+	else if (isShiftDragging)
+	{
+		isShiftDragging = false;
+		emit cellsShiftSelected(TileMap::cellsBetween(dragStart, cellAt(event->pos())));
+	}
+}
+
+void TileMapItem::ungrabMouseEvent(QEvent * event)
+{
+	/* the release never comes when the grab is taken away, by a popup or by another window, a shift-drag is dropped */
+	isShiftDragging = false;
+	if (isPainting)
+	{
+		isPainting = false;
+		emit paintingFinished();
+	}
+	QGraphicsObject::ungrabMouseEvent(event);
+}
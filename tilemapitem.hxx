@@ -0,0 +1,119 @@
+#ifndef TILEMAPITEM_HXX
+#define TILEMAPITEM_HXX
+
+#include <QGraphicsObject>
+#include <QGraphicsSceneMouseEvent>
+#include <QCache>
+#include <QImage>
+#include <QSet>
+#include <QHash>
+#include <QFutureWatcher>
+
+#include "tilemap.hxx"
+#include "mipchain.hxx"
+#include "profiler.hxx"
+
+class TileSet;
+
+/* draws a tile map as a single scene item - the map is drawn chunk by chunk, each chunk is composed
+ * from all map layers once, and then kept in a cache, until a cell in it changes; only the chunks
+ * that intersect the exposed rectangle are ever composed or drawn. Chunks are composed as images,
+ * so that they can also be composed on worker threads, and streamed in while a map loads. Zoomed out, chunks
+ * are composed from the smaller tiles of the tile set mip chain, so that they cost about as much as at full size,
+ * and once a cell is smaller than a screen pixel, the map overview is drawn instead of chunks. The mip chain and
+ * the overview are built on worker threads, until they are ready the chunks at full size are drawn scaled down,
+ * and the rest is filled with the average colour of the background */
+class TileMapItem : public QGraphicsObject
+{
+	Q_OBJECT
+	enum
+	{
+		/* in kilobytes */
+		CHUNK_CACHE_SIZE	=	256 * 1024,
+		/* more than the levels of the largest tiles */
+		MAX_MIP_LEVELS		=	16,
+	};
+	const TileMap * tileMap;
+	TileSet * tileSet;
+	QImage backgroundImage;
+	QCache<int, QImage> chunkCache;
+	/* while chunks are streamed in, the chunks missing from the cache are left blank, unless they were edited */
+	bool streaming = false;
+	QSet<int> editedChunks;
+	MapOverview mapOverview;
+	bool overviewValid = false;
+	/* the overview is built on a worker from a copy of the map, every build gets a number, and only the last one is kept;
+	 * the cells edited meanwhile are updated once it is ready */
+	QFutureWatcher<MapOverview> overviewWatcher;
+	int overviewBuild = 0;
+	bool isBuildingOverview = false;
+	QRect overviewDirtyCells;
+	void buildOverview(void);
+	void installOverview(int build);
+	/* the chunks every tile is used in, and the tiles of every chunk - built on the first tile change, after that
+	 * only the chunks edited since the last tile change are indexed again */
+	QHash<TileIndex, QSet<int>> chunksByTile;
+	QHash<int, QVector<TileIndex>> chunkTiles;
+	QSet<int> unindexedChunks;
+	bool isTileIndexBuilt = false;
+	void indexChunk(int chunk);
+	/* the cell a shift-drag started at, the flag is set between the shift-press and its release */
+	QPoint dragStart;
+	bool isShiftDragging = false;
+	/* set between a plain press and its release, the cell is the one last reported */
+	bool isPainting = false;
+	QPoint paintCell;
+	QPoint cellAt(const QPointF & pos) const;
+	const QImage & background(int w, int h);
+	/* drawn where the mip chain, or the overview, is not ready yet */
+	QColor backgroundColour(void);
+	/* in kilobytes, for a chunk image of the given size */
+	static int chunkCost(int width, int height) { return std::max(1, width * height * 4 / 1024); }
+	static int cacheKey(int chunk, int level) { return chunk * MAX_MIP_LEVELS + level; }
+public:
+	TileMapItem(const TileMap * tileMap, TileSet * tileSet, QGraphicsItem * parent = 0);
+	QRectF boundingRect(void) const override;
+	void paint(QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * widget = 0) override;
+	/* these do not use any pixmaps, so they can run on any thread; 'atlas' is the tile set image */
+	static QImage backgroundTile(int w, int h);
+	static QImage composeChunk(const TileMap & tileMap, const QImage & atlas, const QImage & background, int chunkX, int chunkY, int w, int h);
+	/* call these when the model, or the tile set, changes */
+	void mapChanged(void);
+	void cellChanged(int x, int y);
+	void cellsChanged(const QRect & cells);
+	/* the image of a tile set tile changed, only the chunks that use it are composed again */
+	void tileChanged(TileIndex tile);
+	/* composed chunks of the current map can be handed over between these two calls */
+	void beginStreaming(void) { streaming = true; editedChunks.clear(); }
+	void endStreaming(void) { streaming = false; editedChunks.clear(); update(); }
+	void setChunkImage(int chunkX, int chunkY, const QImage & chunk);
+	/* the number of chunks of the current tile size that fit in the cache */
+	int cacheableChunks(void) const;
+	/* in kilobytes */
+	int cachedChunkSize(void) const { return chunkCache.totalCost(); }
+	/* the whole map at one pixel per block of cells, rebuilt in the background when the map has changed as a whole -
+	 * its image is null until 'overviewChanged()' is emitted for the new one */
+	const MapOverview & overview(void);
+	/* blocks until the overview being built is ready, for callers without an event loop */
+	void waitForOverview(void);
+	/* in scene units, the size of an overview pixel */
+	QSizeF overviewPixelSize(void);
+signals:
+	void cellSelected(int x, int y);
+	/* the mouse moved to another cell after a plain press, while the button is held */
+	void cellDragged(int x, int y);
+	/* the button of a plain press was released, or the item lost the mouse before that */
+	void paintingFinished(void);
+	void cellControlSelected(int x, int y);
+	void cellAltSelected(int x, int y);
+	/* the rectangle of cells between a shift-press and the release of the mouse button */
+	void cellsShiftSelected(const QRect & cells);
+	void overviewChanged(void);
+protected:
+	void mousePressEvent(QGraphicsSceneMouseEvent * event) override;
+	void mouseMoveEvent(QGraphicsSceneMouseEvent * event) override;
+	void mouseReleaseEvent(QGraphicsSceneMouseEvent * event) override;
+	void ungrabMouseEvent(QEvent * event) override;
+};
+
+#endif // TILEMAPITEM_HXX
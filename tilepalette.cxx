@@ -0,0 +1,228 @@
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+
+#include "mapeditor.hxx"
+
+TilePaletteItem::TilePaletteItem(TileSet * tileSet, QGraphicsItem * parent) : QGraphicsObject(parent)
+{
+	this->tileSet = tileSet;
+	setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+	tileSetChanged();
+}
+
+int TilePaletteItem::rowCount(void) const
+{
+	return isFiltered ? rowStarts.size() - 1 : tileSet->tileCountY();
+}
+
+int TilePaletteItem::columnCount(void) const
+{
+	return isFiltered ? filteredColumns : tileSet->tileCountX();
+}
+
+TileIndex TilePaletteItem::tileAt(int column, int row) const
+{
+	if (column < 0 || row < 0 || column >= columnCount() || row >= rowCount())
+		return TileMap::NO_TILE;
+	if (!isFiltered)
+		return TileMap::tileIndex(column, row);
+	int i = rowStarts.at(row) + column;
+	return i < rowStarts.at(row + 1) ? filteredTiles.at(i) : TileMap::NO_TILE;
+}
+
+QPoint TilePaletteItem::paletteCellAt(const QPointF & pos) const
+{
+	return QPoint(std::floor(pos.x() / tileSet->tileWidth()), std::floor(pos.y() / tileSet->tileHeight()));
+}
+
+int TilePaletteItem::tileBit(TileIndex tile) const
+{
+	int x = TileMap::tileSetX(tile), y = TileMap::tileSetY(tile);
+	if (tile == TileMap::NO_TILE || x >= tileSet->tileCountX() || y >= tileSet->tileCountY())
+		return -1;
+	return y * tileSet->tileCountX() + x;
+}
+
+QRectF TilePaletteItem::boundingRect(void) const
+{
+	return QRectF(0, 0, columnCount() * tileSet->tileWidth(), rowCount() * tileSet->tileHeight());
+}
+
+void TilePaletteItem::drawTileBitmap(QPainter * painter, const QBitArray & bits, const QRect & cells, bool isMark)
+{
+	int w = tileSet->tileWidth(), h = tileSet->tileHeight();
+	for (int y = cells.top(); y <= cells.bottom(); y ++)
+		for (int x = cells.left(); x <= cells.right(); x ++)
+		{
+			int bit = tileBit(tileAt(x, y));
+			if (bit == -1 || !bits.testBit(bit))
+				continue;
+			if (isMark)
+				painter->drawEllipse(x * w, y * h, w, h);
+			else
+				painter->fillRect(x * w, y * h, w, h, QColor(0, 128, 255, 96));
+		}
+}
+
+void TilePaletteItem::paint(QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * widget)
+{
+	Q_UNUSED(widget);
+	int w = tileSet->tileWidth(), h = tileSet->tileHeight(), x, y;
+	auto r = option->exposedRect.toAlignedRect() & boundingRect().toAlignedRect();
+	if (r.isEmpty())
+		return;
+	QRect cells(QPoint(r.left() / w, r.top() / h), QPoint(r.right() / w, r.bottom() / h));
+	auto & atlas = tileSet->atlas();
+	if (!isFiltered)
+		painter->drawImage(r, atlas, r);
+	else
+		for (y = cells.top(); y <= cells.bottom(); y ++)
+			for (x = cells.left(); x <= cells.right(); x ++)
+			{
+				auto tile = tileAt(x, y);
+				if (tile != TileMap::NO_TILE)
+					painter->drawImage(QRect(x * w, y * h, w, h), atlas, QRect(TileMap::tileSetX(tile) * w, TileMap::tileSetY(tile) * h, w, h));
+			}
+	drawTileBitmap(painter, selection, cells, false);
+	painter->setPen(Qt::cyan);
+	drawTileBitmap(painter, marks, cells, true);
+	painter->setPen(gridColour);
+	for (x = cells.left(); x <= cells.right(); x ++)
+		painter->drawLine(x * w, cells.top() * h, x * w, (cells.bottom() + 1) * h - 1);
+	for (y = cells.top(); y <= cells.bottom(); y ++)
+		painter->drawLine(cells.left() * w, y * h, (cells.right() + 1) * w - 1, y * h);
+	if (isDragging)
+	{
+		auto band = TileMap::cellsBetween(dragStart, dragEnd);
+		painter->setPen(QPen(Qt::white, 0, Qt::DashLine));
+		painter->setBrush(QColor(255, 255, 255, 48));
+		painter->drawRect(band.x() * w, band.y() * h, band.width() * w - 1, band.height() * h - 1);
+	}
+}
+
+void TilePaletteItem::setFilter(const QVector<TileIndex> & tiles)
+{
+	prepareGeometryChange();
+	isFiltered = true;
+	filteredTiles = tiles;
+	rowStarts.clear();
+	filteredColumns = 0;
+	for (int i = 0; i < tiles.size(); i ++)
+		if (!i || TileMap::tileSetY(tiles.at(i)) != TileMap::tileSetY(tiles.at(i - 1)))
+		{
+			if (i)
+				filteredColumns = std::max(filteredColumns, i - rowStarts.last());
+			rowStarts << i;
+		}
+	if (!tiles.isEmpty())
+		filteredColumns = std::max(filteredColumns, tiles.size() - rowStarts.last());
+	rowStarts << tiles.size();
+	update();
+}
+
+QVector<TileIndex> TilePaletteItem::selectedTiles(void) const
+{
+	QVector<TileIndex> tiles;
+	int columns = tileSet->tileCountX();
+	for (int i = 0; i < selection.size(); i ++)
+		if (selection.testBit(i))
+			tiles << TileMap::tileIndex(i % columns, i / columns);
+	return tiles;
+}
+
+void TilePaletteItem::setMarkedTiles(const QVector<TileIndex> & tiles)
+{
+	marks.fill(false);
+	for (auto tile : tiles)
+	{
+		int bit = tileBit(tile);
+		if (bit != -1)
+			marks.setBit(bit);
+	}
+	update();
+}
+
+void TilePaletteItem::tileSetChanged(void)
+{
+	prepareGeometryChange();
+	int count = tileSet->tileCountX() * tileSet->tileCountY();
+	/* the bits do not mean the same tiles anymore */
+	if (selection.size() != count)
+	{
+		selection = QBitArray(count);
+		marks = QBitArray(count);
+	}
+	update();
+}
+
+void TilePaletteItem::selectCells(const QRect & cells)
+{
+	for (int y = cells.top(); y <= cells.bottom(); y ++)
+	{
+		int first = tileBit(tileAt(cells.left(), y));
+		/* the rows of the whole tile set are consecutive runs of bits */
+		if (!isFiltered && first != -1)
+			selection.fill(true, first, first + cells.width());
+		else
+			for (int x = cells.left(); x <= cells.right(); x ++)
+			{
+				int bit = tileBit(tileAt(x, y));
+				if (bit != -1)
+					selection.setBit(bit);
+			}
+	}
+}
+
+void TilePaletteItem::mousePressEvent(QGraphicsSceneMouseEvent * event)
+{
+	auto cell = paletteCellAt(event->pos());
+	auto tile = tileAt(cell.x(), cell.y());
+	if (event->modifiers() & Qt::ShiftModifier)
+	{
+		if (tile != TileMap::NO_TILE)
+			emit tileShiftSelected(TileMap::tileSetX(tile), TileMap::tileSetY(tile));
+		return;
+	}
+	isDragging = true;
+	dragStart = dragEnd = cell;
+	update();
+}
+
+void TilePaletteItem::mouseMoveEvent(QGraphicsSceneMouseEvent * event)
+{
+	if (!isDragging)
+		return;
+	auto cell = paletteCellAt(event->pos());
+	dragEnd = QPoint(qBound(0, cell.x(), std::max(columnCount() - 1, 0)), qBound(0, cell.y(), std::max(rowCount() - 1, 0)));
+	update();
+}
+
+void TilePaletteItem::mouseReleaseEvent(QGraphicsSceneMouseEvent * event)
+{
+	if (!isDragging)
+		return;
+	isDragging = false;
+	auto tile = tileAt(dragStart.x(), dragStart.y());
+	bool isAdding = event->modifiers() & Qt::ControlModifier;
+	if (dragStart == dragEnd && isAdding)
+	{
+		/* a control-click toggles a single tile */
+		int bit = tileBit(tile);
+		if (bit != -1)
+			selection.toggleBit(bit);
+	}
+	else if (dragStart == dragEnd)
+	{
+		selection.fill(false);
+		if (tile != TileMap::NO_TILE)
+			emit tileSelected(TileMap::tileSetX(tile), TileMap::tileSetY(tile));
+	}
+	else
+	{
+		if (!isAdding)
+			selection.fill(false);
+		selectCells(TileMap::cellsBetween(dragStart, dragEnd));
+	}
+	update();
+	emit selectionChanged();
+}
@@ -0,0 +1,63 @@
+#ifndef TILEPALETTE_HXX
+#define TILEPALETTE_HXX
+
+#include <QGraphicsObject>
+#include <QGraphicsSceneMouseEvent>
+#include <QBitArray>
+
+#include "tilemap.hxx"
+
+class TileSet;
+
+/* shows the tiles of a tile set as a single scene item - only the tiles and grid lines in the exposed
+ * rectangle are drawn, straight from the tile set image; clicks and rubber band drags are resolved
+ * to tiles by arithmetic on the grid, and the selection is kept as a bitmap, one bit per tile of the
+ * tile set. The palette shows either the whole tile set, as it is laid out in the image, or only the
+ * tiles of a list, with the tiles from each tile set row on a palette row of their own */
+class TilePaletteItem : public QGraphicsObject
+{
+	Q_OBJECT
+	TileSet * tileSet;
+	bool isFiltered = false;
+	QVector<TileIndex> filteredTiles;
+	/* the index in 'filteredTiles' of the first tile of every palette row, and one past the last tile */
+	QVector<int> rowStarts;
+	int filteredColumns = 0;
+	QBitArray selection, marks;
+	QColor gridColour = Qt::green;
+	/* the palette cells between a press and the current mouse position, while dragging */
+	bool isDragging = false;
+	QPoint dragStart, dragEnd;
+	int rowCount(void) const;
+	int columnCount(void) const;
+	QPoint paletteCellAt(const QPointF & pos) const;
+	/* the bit of a tile in the selection and mark bitmaps, -1 for tiles outside the tile set */
+	int tileBit(TileIndex tile) const;
+	void selectCells(const QRect & cells);
+	void drawTileBitmap(QPainter * painter, const QBitArray & bits, const QRect & cells, bool isMark);
+public:
+	TilePaletteItem(TileSet * tileSet, QGraphicsItem * parent = 0);
+	QRectF boundingRect(void) const override;
+	void paint(QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * widget = 0) override;
+	/* the tile at a palette row and column, NO_TILE for empty palette cells */
+	TileIndex tileAt(int column, int row) const;
+	/* shows only these tiles, which must be sorted by row, and then by column */
+	void setFilter(const QVector<TileIndex> & tiles);
+	void setGridColour(const QColor & colour) { gridColour = colour; update(); }
+	/* the selected tiles, sorted by row, and then by column */
+	QVector<TileIndex> selectedTiles(void) const;
+	void clearSelection(void) { selection.fill(false); update(); }
+	void setMarkedTiles(const QVector<TileIndex> & tiles);
+	/* call this when the tile set image, or the tile size, changes */
+	void tileSetChanged(void);
+signals:
+	void tileSelected(int x, int y);
+	void tileShiftSelected(int x, int y);
+	void selectionChanged(void);
+protected:
+	void mousePressEvent(QGraphicsSceneMouseEvent * event) override;
+	void mouseMoveEvent(QGraphicsSceneMouseEvent * event) override;
+	void mouseReleaseEvent(QGraphicsSceneMouseEvent * event) override;
+};
+
+#endif // TILEPALETTE_HXX
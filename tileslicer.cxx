@@ -0,0 +1,168 @@
+#include <QtConcurrent>
+#include <QHash>
+
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "tileslicer.hxx"
+
+/* the tile images must be in one of the 32 bit per pixel formats, so that a tile row is a contiguous run of bytes */
+static QImage pixelImage(const QImage & image)
+{
+	if (image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32)
+		return image;
+	return image.convertToFormat(QImage::Format_ARGB32);
+}
+
+static quint64 hashTile(const QImage & image, int x0, int y0, int w, int h)
+{
+	const quint64 PRIME = 0x100000001b3ull;
+	quint64 hash = 0xcbf29ce484222325ull;
+	int bytes = w * 4;
+#ifdef __SSE2__
+	/* two independent 64 bit lanes, each one takes in 8 bytes of a row per step */
+	__m128i acc = _mm_set_epi64x(0x9e3779b97f4a7c15ll, 0x2545f4914f6cdd1dll);
+	const __m128i k0 = _mm_set1_epi32(int(0x85ebca6b)), k1 = _mm_set1_epi32(int(0xc2b2ae35));
+#endif
+	for (int y = 0; y < h; y ++)
+	{
+		auto row = image.constScanLine(y0 + y) + x0 * 4;
+		int i = 0;
+#ifdef __SSE2__
+		for (; i + 16 <= bytes; i += 16)
+		{
+			acc = _mm_xor_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i)));
+			/* multiply both 32 bit halves of each lane, and fold the products back together */
+			acc = _mm_add_epi64(_mm_mul_epu32(acc, k0), _mm_mul_epu32(_mm_srli_epi64(acc, 32), k1));
+			acc = _mm_xor_si128(acc, _mm_srli_epi64(acc, 29));
+		}
+#endif
+		for (; i < bytes; i += 4)
+		{
+			quint32 pixel;
+			memcpy(& pixel, row + i, sizeof pixel);
+			hash = (hash ^ pixel) * PRIME;
+		}
+	}
+#ifdef __SSE2__
+	quint64 lanes[2];
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+	hash = ((hash ^ lanes[0]) * PRIME ^ lanes[1]) * PRIME;
+#endif
+	return hash;
+}
+
+static bool isSameTile(const QImage & image0, int x0, int y0, const QImage & image1, int x1, int y1, int w, int h)
+{
+	for (int y = 0; y < h; y ++)
+		if (memcmp(image0.constScanLine(y0 + y) + x0 * 4, image1.constScanLine(y1 + y) + x1 * 4, w * 4))
+			return false;
+	return true;
+}
+
+QVector<quint64> TileSlicer::hashTiles(const QImage & image, int tileWidth, int tileHeight)
+{
+	if (tileWidth <= 0 || tileHeight <= 0)
+		return QVector<quint64>();
+	int columns = image.width() / tileWidth, rows = image.height() / tileHeight;
+	const QImage pixels = pixelImage(image);
+	QVector<quint64> hashes(columns * rows);
+	QVector<int> gridRows(rows);
+	std::iota(gridRows.begin(), gridRows.end(), 0);
+	/* every grid row is hashed by a single thread, and each one writes only to its own part of the result */
+	QtConcurrent::blockingMap(gridRows, [&] (int row) {
+		for (int x = 0; x < columns; x ++)
+			hashes[row * columns + x] = hashTile(pixels, x * tileWidth, row * tileHeight, tileWidth, tileHeight);
+	});
+	return hashes;
+}
+
+TileSlicer::Index TileSlicer::index(const QImage & image, int tileWidth, int tileHeight)
+{
+	Index index;
+	auto hashes = hashTiles(image, tileWidth, tileHeight);
+	if (hashes.isEmpty())
+		return index;
+	const QImage pixels = pixelImage(image);
+	index.columns = image.width() / tileWidth;
+	index.rows = image.height() / tileHeight;
+	index.tileIds.resize(hashes.size());
+	index.hashes = hashes;
+	/* for each hash, the last unique tile found with it; unique tiles with the same hash are chained in 'nextWithHash' */
+	QHash<quint64, int> lastWithHash;
+	QVector<int> nextWithHash;
+	lastWithHash.reserve(hashes.size());
+	for (int cell = 0; cell < hashes.size(); cell ++)
+	{
+		int x = cell % index.columns, y = cell / index.columns, id = lastWithHash.value(hashes.at(cell), -1);
+		for (; id != -1; id = nextWithHash.at(id))
+		{
+			auto t = index.uniqueTiles.at(id);
+			if (isSameTile(pixels, TileMap::tileSetX(t) * tileWidth, TileMap::tileSetY(t) * tileHeight, pixels, x * tileWidth, y * tileHeight, tileWidth, tileHeight))
+				break;
+		}
+		if (id == -1)
+		{
+			id = index.uniqueTiles.size();
+			index.uniqueTiles << TileMap::tileIndex(x, y);
+			nextWithHash << lastWithHash.value(hashes.at(cell), -1);
+			lastWithHash[hashes.at(cell)] = id;
+		}
+		index.tileIds[cell] = id;
+	}
+	return index;
+}
+
+void TileSlicer::updateTile(Index & index, const QImage & image, int tileWidth, int tileHeight, int x, int y)
+{
+	if (x < 0 || y < 0 || x >= index.columns || y >= index.rows)
+		return;
+	/* only the tiles that are compared are converted, rather than the whole sheet */
+	auto tilePixels = [&] (TileIndex t) { return pixelImage(image.copy(TileMap::tileSetX(t) * tileWidth, TileMap::tileSetY(t) * tileHeight, tileWidth, tileHeight)); };
+	int cell = y * index.columns + x, oldId = index.tileIds.at(cell);
+	/* the tile leaves its old id, which moves on to the next copy of it, or is given to the tile of the last id if there is none */
+	index.tileIds[cell] = -1;
+	if (index.uniqueTiles.at(oldId) == TileMap::tileIndex(x, y))
+	{
+		int next = std::find(index.tileIds.constBegin() + cell + 1, index.tileIds.constEnd(), oldId) - index.tileIds.constBegin();
+		if (next < index.tileIds.size())
+			index.uniqueTiles[oldId] = TileMap::tileIndex(next % index.columns, next / index.columns);
+		else
+		{
+			int lastId = index.uniqueTiles.size() - 1;
+			if (oldId != lastId)
+			{
+				std::replace(index.tileIds.begin(), index.tileIds.end(), lastId, oldId);
+				index.uniqueTiles[oldId] = index.uniqueTiles.at(lastId);
+			}
+			index.uniqueTiles.removeLast();
+		}
+	}
+	auto pixels = tilePixels(TileMap::tileIndex(x, y));
+	auto hash = index.hashes[cell] = hashTile(pixels, 0, 0, tileWidth, tileHeight);
+	int id = 0;
+	for (; id < index.uniqueTiles.size(); id ++)
+	{
+		auto t = index.uniqueTiles.at(id);
+		if (index.hashes.at(TileMap::tileSetY(t) * index.columns + TileMap::tileSetX(t)) == hash
+				&& isSameTile(pixels, 0, 0, tilePixels(t), 0, 0, tileWidth, tileHeight))
+			break;
+	}
+	if (id == index.uniqueTiles.size())
+		index.uniqueTiles << TileMap::tileIndex(x, y);
+	/* the first copy in the sheet stands for the tile */
+	else if (TileMap::tileSetY(index.uniqueTiles.at(id)) * index.columns + TileMap::tileSetX(index.uniqueTiles.at(id)) > cell)
+		index.uniqueTiles[id] = TileMap::tileIndex(x, y);
+	index.tileIds[cell] = id;
+}
+
+QVector<QImage> TileSlicer::slice(const QImage & image, int tileWidth, int tileHeight, const QVector<TileIndex> & tiles)
+{
+	return QtConcurrent::blockingMapped<QVector<QImage>>(tiles, [=] (TileIndex t) {
+		return image.copy(TileMap::tileSetX(t) * tileWidth, TileMap::tileSetY(t) * tileHeight, tileWidth, tileHeight); });
+}
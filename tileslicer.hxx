@@ -0,0 +1,37 @@
+#ifndef TILESLICER_HXX
+#define TILESLICER_HXX
+
+#include <QImage>
+#include <QVector>
+
+#include "tilemap.hxx"
+
+/* splits a tile sheet in a grid of tiles, and finds the tiles that are identical */
+class TileSlicer
+{
+public:
+	struct Index
+	{
+		int columns = 0, rows = 0;
+		/* for each grid cell, in row major order, the id of the unique tile in it */
+		QVector<int> tileIds;
+		/* for each unique tile id, the grid position where the tile is first found */
+		QVector<TileIndex> uniqueTiles;
+		/* for each grid cell, the hash of its pixels */
+		QVector<quint64> hashes;
+		bool isEmpty(void) const { return tileIds.isEmpty(); }
+		int uniqueTileId(int x, int y) const { return tileIds.at(y * columns + x); }
+		/* the first tile in the sheet that is identical to the one at the given position */
+		TileIndex canonicalTile(int x, int y) const { return uniqueTiles.at(uniqueTileId(x, y)); }
+	};
+	/* hashes the pixels of every tile, spreading the work over all cores */
+	static QVector<quint64> hashTiles(const QImage & image, int tileWidth, int tileHeight);
+	/* tiles with equal hashes are compared pixel by pixel, so hash collisions never merge different tiles */
+	static Index index(const QImage & image, int tileWidth, int tileHeight);
+	/* updates the index of a sheet in which only the tile at (x, y) has changed, hashing only that tile */
+	static void updateTile(Index & index, const QImage & image, int tileWidth, int tileHeight, int x, int y);
+	/* copies the given tiles out of the sheet, in parallel */
+	static QVector<QImage> slice(const QImage & image, int tileWidth, int tileHeight, const QVector<TileIndex> & tiles);
+};
+
+#endif // TILESLICER_HXX